@@ -68,7 +68,7 @@ namespace SoftRPDemo {
 		SoftRP::Math::Vector3 m_lookAt{};
 		Camera m_camera{};
 		GDIRenderTarget m_renderTarget;
-		SoftRP::Texture2D<float> m_depthBuffer;
+		SoftRP::DepthBuffer m_depthBuffer;
 		SoftRP::ViewPort m_viewPort;
 		//Here, order of declarations matters. VertexLayout manages Vertex allocations
 		SoftRP::InputVertexLayout m_inputVertexLayout;
@@ -16,7 +16,7 @@ namespace SoftRPDemo
 								 const PSExecutionContext& psec,
 								 size_t instance, Math::Vector4* out) const override
 		{
-			const Math::Vector4* color = sc.constantBuffers()[0]->getField(1).asVector4();
+			const Math::Vector4* color = sc.constantBufferField(0, 1).asVector4();
 			for (unsigned int i = 0; i < 4; i++)
 			{
 				if ((psec.mask & (1 << i)) == 0)
@@ -13,17 +13,11 @@ namespace SoftRPDemo
 		LightVertexShader() = default;
 		virtual ~LightVertexShader() = default;
 
-#ifdef SOFTRP_MULTI_THREAD
-		virtual ThreadPool::Fence operator()(const ShaderContext& sc, const Vertex* input, Vertex* output,
-											 size_t vertexCount, size_t instance, ThreadPool& threadPool) const override
-		{
-#else
-		virtual void operator()(const ShaderContext& sc, const Vertex* input, Vertex* output,
+		virtual void shadeBatch(const ShaderContext& sc, const Vertex* input, Vertex* output,
 								size_t vertexCount, size_t instance) const override
 		{
-#endif
 
-			const Math::Matrix4* projViewWorld = sc.constantBuffers()[0]->getField(0, static_cast<unsigned int>(instance)).asMatrix4();
+			const Math::Matrix4* projViewWorld = sc.constantBufferField(0, 0, instance).asMatrix4();
 			const FMatrix fprojView = createFM(*projViewWorld);
 
 			for (size_t i = 0; i < vertexCount; i++, input++, output++)
@@ -50,10 +44,6 @@ namespace SoftRPDemo
 				for (unsigned int i = 0; i < 2; i++)
 					textCoords[i] = inputTextCoords[i];
 			}
-
-#ifdef SOFTRP_MULTI_THREAD
-			return threadPool.currFence();
-#endif
 		}
 	};
 }
\ No newline at end of file
@@ -15,7 +15,7 @@ namespace SoftRPDemo
 								 const PSExecutionContext& psec,
 								 size_t instance, Math::Vector4* out) const override
 		{
-			const Math::Vector4* color = sc.constantBuffers()[1]->getField(1, instance).asVector4();
+			const Math::Vector4* color = sc.constantBufferField(1, 1, instance).asVector4();
 			for (unsigned int i = 0; i < 4; i++)
 			{
 				if ((psec.mask & (1 << i)) == 0)
@@ -3,10 +3,29 @@
 #include "MathCommon.h"
 #include "FVector.h"
 #include "FMatrix.h"
+#include "CPUFeatures.h"
 
 using namespace SoftRP;
 using namespace Math;
 
+BinRasterizer::BinRasterizer(bool tileEdgeTest) : m_tileEdgeTest{ tileEdgeTest } {
+#ifdef SOFTRP_USE_SIMD
+	//there is no 16-wide kernel yet, AVX-512 hosts use the AVX2 one
+	switch (supportedSIMDLevel()) {
+	case SIMDLevel::AVX512:
+	case SIMDLevel::AVX2:
+		m_rasterizeBinKernel = &BinRasterizer::rasterizeBinAVX2;
+		break;
+	case SIMDLevel::SSE4:
+		m_rasterizeBinKernel = &BinRasterizer::rasterizeBinSSE;
+		break;
+	default:
+		m_rasterizeBinKernel = &BinRasterizer::rasterizeBinScalar;
+		break;
+	}
+#endif
+}
+
 void BinRasterizer::setRenderTarget(RenderTarget* renderTarget) {
 	bool changed = renderTarget != this->renderTarget() ||
 		renderTarget->width() != m_renderTargetWidth ||
@@ -32,25 +51,39 @@ void BinRasterizer::setRenderTarget(RenderTarget* renderTarget) {
 	}
 }
 
+Math::Vector2 BinRasterizer::guardBand() const {
+	/*
+	the ViewPort maps [-g, g] to [center - g*size/2, center + g*size/2] along each axis, where g is a guard 
+	band factor, so g*size/2 is limited by the maximum distance from the center.
+	*/
+	const ViewPort& vp = *viewPort();
+	const float limit = static_cast<float>(GUARD_BAND_LIMIT);
+	const float halfWidth = static_cast<float>(vp.getWidth()) * 0.5f;
+	const float halfHeight = static_cast<float>(vp.getHeight()) * 0.5f;
+	return Math::Vector2{ std::max(1.0f, limit / halfWidth), std::max(1.0f, limit / halfHeight) };
+}
+
 //helper functions forward declarations
-static bool intersectAABB(int32_t xMin1, int32_t xMax1, int32_t yMin1, int32_t yMax1,
-						  int32_t xMin2, int32_t xMax2, int32_t yMin2, int32_t yMax2);
+static int32_t blockExtent(int32_t xDecr, int32_t yDecr, int32_t blockWidth, int32_t blockHeight, bool maximum);
 
 template<int32_t fractionalSize>
 static int32_t fixedFromFloat(float x);
 template<>
-static int32_t fixedFromFloat<4>(float x);
+int32_t fixedFromFloat<4>(float x);
 
 template<int32_t fractionalSize>
 static float fixedToFloat(int32_t fixed);
 template<>
-static float fixedToFloat<4>(int32_t fixed);
+float fixedToFloat<4>(int32_t fixed);
 
 
 /*
 After the transformation to Screen space, each triangle's AABB (axis-aligned bounding box) is computed and binning is performed. 
 Binning consists of finding the set of bins that intersect the AABB of a triangle and add the latter to their list, so it can 
-be rasterized.
+be rasterized. Because the tiles form a regular grid, the range of tiles covered by the AABB is computed directly from its 
+coordinates. If the AABB spans more than one tile in both directions, the triangle may miss some of them (ex. a long, thin 
+diagonal triangle): if the tile edge test is enabled, each candidate tile is then classified as done for the blocks 
+(see below) and skipped if it is completely outside.
 Triangles are rasterized inside a bin with the aid of edge functions, which are used to determine if a given point (pixel)
 is inside the triangle.
 
@@ -116,6 +149,19 @@ Substracting 1 to alpha, beta or gamma, if they refer to a not-Top-Left edge, al
 with >= 0 independently of the nature of the edge. To do this, a bias is calculated for alpha, beta and gamma that 
 is added at the time of test.
 
+//hierarchical traversal
+
+Testing every pixel of a tile is wasteful for triangles that cover only a small part of it (nothing to do in most of the
+tile) or cover it entirely (tests always succeed). For this reason, a tile is traversed in blocks of
+BLOCK_WIDTH x BLOCK_HEIGHT pixels and, before visiting its pixels, a block is classified with respect to the triangle.
+Because the edge functions are linear, their minimum and maximum values over a block are found at its corners:
+-if the maximum of any (biased) edge function is negative, the block is completely outside and is skipped;
+-if the minimum of all (biased) edge functions is non-negative, the block is completely inside and its pixels are
+ visited without testing the edge functions;
+-otherwise, the block is partially covered and its pixels are tested as usual.
+The extremes are computed relative to the value of the edge functions at the top-left pixel of the block, so they
+are the same for all the blocks of a triangle.
+
 
 //References
 https://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/
@@ -123,11 +169,11 @@ http://forum.devmaster.net/t/advanced-rasterization/6145
 http://cse.taylor.edu/~zbethel/MSR/ModernApproachToSR.pdf
 */
 #ifdef SOFTRP_MULTI_THREAD
-ThreadPool::Fence BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint64_t>& indices,
-													size_t instance, ThreadPool& threadPool)
+ThreadPool::Fence BinRasterizer::rasterize(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+										   const uint32_t* groupIds, const TriangleGroup* groups, ThreadPool& threadPool)
 #else
-void BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint64_t>& indices,
-									   size_t instance)
+void BinRasterizer::rasterize(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+							  const uint32_t* groupIds, const TriangleGroup* groups)
 #endif
 														{
 	
@@ -139,15 +185,144 @@ void BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, cons
 		return;
 #endif
 
+	//triangles may exceed the ViewPort up to the guard band, only the pixels inside it are written
+	const ViewPort& vp = *viewPort();
+	m_scissorXMin = static_cast<int32_t>(std::min(vp.getX(), m_renderTargetWidth));
+	m_scissorYMin = static_cast<int32_t>(std::min(vp.getY(), m_renderTargetHeight));
+	m_scissorXMax = static_cast<int32_t>(std::min(vp.getX() + vp.getWidth(), m_renderTargetWidth));
+	m_scissorYMax = static_cast<int32_t>(std::min(vp.getY() + vp.getHeight(), m_renderTargetHeight));
+	m_originX = static_cast<int32_t>(vp.getX() + vp.getWidth() / 2);
+	m_originY = static_cast<int32_t>(vp.getY() + vp.getHeight() / 2);
+
+	m_groupIds = groupIds;
+	m_groups = groups;
+
 	m_triangles.resize(triangleCount);
-	const auto vertexCount = vertices.size();
+	const size_t vertexCount = vertices.size();
 	m_transformedVertices.resize(vertexCount);
 
+	m_attributeCount = vertices[0].vertexLayout().vertexStride() - 4;
+	m_paddedAttributeCount = (m_attributeCount + 3) & ~static_cast<size_t>(3);
+	m_planeStride = 4 + 3 * m_paddedAttributeCount;
+	m_attributePlanes.resize(triangleCount*m_planeStride);
+
+	/*
+	vertices transformation, triangles setup and binning are split in chunks which are processed in parallel.
+	each chunk of triangles has its own list of triangles for every bin; once all the chunks have been processed,
+	the lists of a bin are merged in chunk order, so the bin receives its triangles in primitive order.
+	*/
+#ifdef SOFTRP_MULTI_THREAD
+	const size_t chunkCount = std::max<size_t>(1, std::min(threadPool.taskConsumerCount(), triangleCount / SETUP_CHUNK_SIZE));
+#else
+	const size_t chunkCount = 1;
+#endif
+	m_binLists.resize(chunkCount*m_binsCount);
+
+#ifdef SOFTRP_MULTI_THREAD
+	const size_t vertexChunkSize = (vertexCount + chunkCount - 1) / chunkCount;
+	threadPool.parallelFor(chunkCount, [this, &vertices, vertexCount, vertexChunkSize](size_t chunk) {
+		const size_t first = std::min(chunk*vertexChunkSize, vertexCount);
+		const size_t last = std::min(first + vertexChunkSize, vertexCount);
+		transformVertices(vertices, first, last);
+	});
+
+	const size_t triangleChunkSize = (triangleCount + chunkCount - 1) / chunkCount;
+	threadPool.parallelFor(chunkCount, [this, &vertices, &indices, triangleCount, triangleChunkSize](size_t chunk) {
+		const size_t first = std::min(chunk*triangleChunkSize, triangleCount);
+		const size_t last = std::min(first + triangleChunkSize, triangleCount);
+		setupTriangles(vertices, indices, first, last, &m_binLists[chunk*m_binsCount]);
+	});
+#else
+	transformVertices(vertices, 0, vertexCount);
+	setupTriangles(vertices, indices, 0, triangleCount, m_binLists.data());
+#endif
+
+	//merge the lists of every bin
+	const std::vector<Vertex>* verticesPtr = &vertices;
+
+	for (size_t j = 0; j < m_binsCount; j++) {
+
+		bool empty = true;
+		for (size_t chunk = 0; chunk < chunkCount && empty; chunk++)
+			empty = m_binLists[chunk*m_binsCount + j].empty();
+		if (empty)
+			continue;
+
+		/*
+		keep track of which bin have some work to do. also, when multi-threading is 
+		active, a task is started for each of them.
+		*/
+		m_activeBins.push_back(j);
+		Bin& bin = m_bins[j];
+		bin.reset();
+#ifdef SOFTRP_MULTI_THREAD
+		//start the task immediately while adding the triangles to the bin and merging the others
+		Bin* pBin = &bin;
+		threadPool.addTask(
+			[this, pBin, verticesPtr]() {
+				rasterizeBin(*pBin, verticesPtr);
+			}
+		);
+#endif
+		for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+			std::vector<size_t>& binList = m_binLists[chunk*m_binsCount + j];
+			for (size_t i : binList)
+				bin.addTriangle(i);
+			binList.clear();
+		}
+#ifdef SOFTRP_MULTI_THREAD
+		//notify that no more triangles will be added to the list
+		bin.setDone();
+#endif
+	}
+
+#ifdef SOFTRP_MULTI_THREAD
+	m_activeBins.clear();
+	return threadPool.addFence();
+#else
+	for (size_t binIndex : m_activeBins)
+		rasterizeBin(m_bins[binIndex], verticesPtr);
+	m_activeBins.clear();
+#endif
+}
+
+#ifdef SOFTRP_MULTI_THREAD
+ThreadPool::Fence BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+													size_t instance, ThreadPool& threadPool) {
+	//all the triangles belong to a single group
+	m_defaultGroup = TriangleGroup{ instance, shaderContext() };
+	return rasterize(vertices, indices, nullptr, &m_defaultGroup, threadPool);
+}
+
+ThreadPool::Fence BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+													const std::vector<uint32_t>& groupIds, const std::vector<TriangleGroup>& groups,
+													ThreadPool& threadPool) {
+	return rasterize(vertices, indices, groupIds.data(), groups.data(), threadPool);
+}
+#else
+void BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+									   size_t instance) {
+	//all the triangles belong to a single group
+	m_defaultGroup = TriangleGroup{ instance, shaderContext() };
+	rasterize(vertices, indices, nullptr, &m_defaultGroup);
+}
+
+void BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+									   const std::vector<uint32_t>& groupIds, const std::vector<TriangleGroup>& groups) {
+	rasterize(vertices, indices, groupIds.data(), groups.data());
+}
+#endif
+
+inline const Rasterizer::TriangleGroup& BinRasterizer::triangleGroup(size_t i) const {
+	return m_groups[m_groupIds ? m_groupIds[i] : 0];
+}
+
+void BinRasterizer::transformVertices(const std::vector<Vertex>& vertices, size_t first, size_t last) {
 	/*
 	transform vertices to Screen space, keep 1/w for implementing perspective correct interpolation.	
 	*/
 	const FMatrix viewPortTransform = createFM(viewPort()->getTransform());
-	for (size_t i = 0; i < vertexCount; i++) {
+	for (size_t i = first; i < last; i++) {
 		TransformedVertex& transformedVertex = m_transformedVertices[i];		
 		const Vector4& srcPos = vertices[i].position();
 		const float invW = 1.0f / srcPos[3];
@@ -162,11 +337,16 @@ void BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, cons
 		dest = mulFV(dest, mulVec);
 		transformedVertex.position = createVector4FV(dest);
 	}
-	
-	//binning			
-	const std::vector<Vertex>* verticesPtr = &vertices;
-		
-	for (size_t i = 0, index = 0; i < triangleCount; i++, index += 3) {
+}
+
+void BinRasterizer::setupTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, 
+								   size_t first, size_t last, std::vector<size_t>* binLists) {
+
+	const int32_t tileWidth = static_cast<int32_t>(TILE_WIDTH);
+	const int32_t tileHeight = static_cast<int32_t>(TILE_HEIGHT);
+	const int32_t smallTriangleSize = static_cast<int32_t>(SMALL_TRIANGLE_SIZE);
+
+	for (size_t i = first, index = first * 3; i < last; i++, index += 3) {
 
 		Triangle& t = m_triangles[i];
 		t.i0 = indices[index];
@@ -177,13 +357,15 @@ void BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, cons
 		const TransformedVertex& v1 = m_transformedVertices[t.i1];
 		const TransformedVertex& v2 = m_transformedVertices[t.i2];
 
-		//convert coordinates to fixed-point notation
-		const int32_t v0x = fixedFromFloat<4>(v0.position[0]);
-		const int32_t v0y = fixedFromFloat<4>(v0.position[1]);
-		const int32_t v1x = fixedFromFloat<4>(v1.position[0]);
-		const int32_t v1y = fixedFromFloat<4>(v1.position[1]);
-		const int32_t v2x = fixedFromFloat<4>(v2.position[0]);
-		const int32_t v2y = fixedFromFloat<4>(v2.position[1]);
+		//convert coordinates to fixed-point notation, relative to the center of the ViewPort (see GUARD_BAND_LIMIT)
+		const int32_t originX = m_originX << 4;
+		const int32_t originY = m_originY << 4;
+		const int32_t v0x = fixedFromFloat<4>(v0.position[0]) - originX;
+		const int32_t v0y = fixedFromFloat<4>(v0.position[1]) - originY;
+		const int32_t v1x = fixedFromFloat<4>(v1.position[0]) - originX;
+		const int32_t v1y = fixedFromFloat<4>(v1.position[1]) - originY;
+		const int32_t v2x = fixedFromFloat<4>(v2.position[0]) - originX;
+		const int32_t v2y = fixedFromFloat<4>(v2.position[1]) - originY;
 		
 		/*
 		compute gamma decrements here because are part of the area computation.
@@ -195,7 +377,8 @@ void BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, cons
 		const int32_t gammaYdecr = -(v1x - v0x);
 
 		const int32_t temp = -v0x*v1y + v1x*v0y;
-		const int32_t twiceArea = 2 * (gammaXdecr*v2x + gammaYdecr*v2y + temp);
+		//E(v0, v1, v2), which is already twice the area
+		const int32_t twiceArea = gammaXdecr*v2x + gammaYdecr*v2y + temp;
 		if (twiceArea <= 0)
 			//discard triangle because back face or too small
 			continue;
@@ -221,158 +404,421 @@ void BinRasterizer::rasterizeTriangles(const std::vector<Vertex>& vertices, cons
 		t.gammaBias = (gammaXdecr > 0 || (t.gammaXdecr == 0 && t.gammaYdecr < 0)) ? 0 : -1;
 
 		/*
-		compute AABB, using the integral part of its coordinates because it is tested against
-		the bins coordinates, that are not expressed in fixed-point notation
+		compute the AABB of the pixels the triangle may cover. pixels are sampled at integer coordinates, so 
+		the AABB's minimum coordinates are rounded up and the maximum ones down. the AABB is then restricted to 
+		the scissor rectangle, which triangles inside the guard band may exceed. if no pixel is inside it, the 
+		triangle doesn't cover any
 		*/
-		const int32_t xMin = std::min({ v0x, v1x, v2x }) >> 4;
-		const int32_t xMax = std::max({ v0x, v1x, v2x }) >> 4;
-		const int32_t yMin = std::min({ v0y, v1y, v2y }) >> 4;
-		const int32_t yMax = std::max({ v0y, v1y, v2y }) >> 4;
-		
-		//find which bins are touched by the triangle
-		for (size_t j = 0; j < m_binsCount; j++) {
-			Bin& bin = m_bins[j];			
-			
-			if (intersectAABB(bin.xMin, bin.xMax, bin.yMin, bin.yMax, xMin, xMax, yMin, yMax)) {
-				
-				bin.addTriangle(i);
+		const int32_t xMin = std::max(((std::min({ v0x, v1x, v2x }) + 15) >> 4) + m_originX, m_scissorXMin);
+		const int32_t xMax = std::min((std::max({ v0x, v1x, v2x }) >> 4) + m_originX, m_scissorXMax - 1);
+		const int32_t yMin = std::max(((std::min({ v0y, v1y, v2y }) + 15) >> 4) + m_originY, m_scissorYMin);
+		const int32_t yMax = std::min((std::max({ v0y, v1y, v2y }) >> 4) + m_originY, m_scissorYMax - 1);
 
-				if (m_activeBins.find(j) == m_activeBins.end()) {
-					/*
-					first triangle that is added to the bin. this is done in order to 
-					keep track of which bin have some work to do. also, when multi-threading is 
-					active this is necessary to start at most one task per bin.
-					*/
-					m_activeBins.insert(j);
-#ifdef SOFTRP_MULTI_THREAD
-					//start the task immediately while testing other bins and other triangles
-					Bin* pBin = &bin;					
-					bin.setDone(false);
-					threadPool.addTask(
-						[this, pBin, verticesPtr, instance]() {
-							rasterizeBin(*pBin, verticesPtr, instance);
-						}						
-					);
-#endif
-				}
-			}
+		if (xMin > xMax || yMin > yMax)
+			continue;
+
+		t.xMin = xMin;
+		t.yMin = yMin;
+		t.xMax = xMax;
+		t.yMax = yMax;
+
+		/*
+		small triangles are common in dense meshes and many of them cover no pixel even if some is inside 
+		their AABB: test their few pixels now, before paying for their setup and binning
+		*/
+		t.small = xMax - xMin < smallTriangleSize && yMax - yMin < smallTriangleSize;
+		if (t.small && !coversPixels(t))
+			continue;
+
+		//depth is interpolated linearly, so it is never less than the vertices' minimum one
+		t.minDepth = std::min({ v0.position[2], v1.position[2], v2.position[2] });
+
+		t.planeX = xMin;
+		t.planeY = yMin;
+		/*
+		the plane equations are computed only for triangles which are added to some bin. they are not
+		needed if the pixels are not shaded during the rasterization
+		*/
+		bool planesReady = visibilityBuffer() != nullptr;
+
+		//find the range of tiles touched by the AABB
+		const int32_t tileXMin = xMin / tileWidth;
+		const int32_t tileXMax = xMax / tileWidth;
+		const int32_t tileYMin = yMin / tileHeight;
+		const int32_t tileYMax = yMax / tileHeight;
+
+		//a triangle always touches all the tiles of its AABB if they are in a single row or column
+		const bool testTiles = m_tileEdgeTest && tileXMax > tileXMin && tileYMax > tileYMin;
+
+		int32_t alphaTileMax = 0;
+		int32_t betaTileMax = 0;
+		int32_t gammaTileMax = 0;
+		if (testTiles) {
+			alphaTileMax = blockExtent(t.alphaXdecr << 4, t.alphaYdecr << 4, tileWidth, tileHeight, true) + t.alphaBias;
+			betaTileMax = blockExtent(t.betaXdecr << 4, t.betaYdecr << 4, tileWidth, tileHeight, true) + t.betaBias;
+			gammaTileMax = blockExtent(t.gammaXdecr << 4, t.gammaYdecr << 4, tileWidth, tileHeight, true) + t.gammaBias;
 		}
-	}
 
-#ifdef SOFTRP_MULTI_THREAD
+		for (int32_t tileY = tileYMin; tileY <= tileYMax; tileY++) {
+			for (int32_t tileX = tileXMin; tileX <= tileXMax; tileX++) {
 
-	ThreadPool::Fence f = threadPool.addFence();
+				//skip the tile if the triangle is occluded by the depth values already written there
+				if (t.minDepth >= depthBuffer()->tileMaxDepth(static_cast<unsigned int>(tileY), static_cast<unsigned int>(tileX)))
+					continue;
 
-	//notify that no more triangles will be added to the lists
-	for (size_t binIndex : m_activeBins)
-		m_bins[binIndex].setDone(true);
+				if (testTiles) {
+					//evaluate edge functions at the tile's top-left pixel and skip the tile if it is outside
+					const int32_t fixedX = (tileX * tileWidth - m_originX) << 4;
+					const int32_t fixedY = (tileY * tileHeight - m_originY) << 4;
+					const int32_t alpha = t.alpha0 + fixedX*t.alphaXdecr + fixedY*t.alphaYdecr;
+					const int32_t beta = t.beta0 + fixedX*t.betaXdecr + fixedY*t.betaYdecr;
+					const int32_t gamma = t.gamma0 + fixedX*t.gammaXdecr + fixedY*t.gammaYdecr;
+					if (((alpha + alphaTileMax) | (beta + betaTileMax) | (gamma + gammaTileMax)) < 0)
+						continue;
+				}
 
-	m_activeBins.clear();
+				if (!planesReady) {
+					setupAttributePlanes(vertices, t, i);
+					planesReady = true;
+				}
+				binLists[static_cast<size_t>(tileY)*m_tilesPerWidth + static_cast<size_t>(tileX)].push_back(i);
+			}
+		}
+	}
+}
 
-	return f;
-#else
-	for (size_t binIndex : m_activeBins)
-		rasterizeBin(m_bins[binIndex], verticesPtr, instance);
+bool BinRasterizer::coversPixels(const Triangle& t) const {
+	//the AABB is already restricted to the scissor rectangle
+	for (int32_t y = t.yMin; y <= t.yMax; y++) {
+		for (int32_t x = t.xMin; x <= t.xMax; x++) {
+			const int32_t fixedX = (x - m_originX) << 4;
+			const int32_t fixedY = (y - m_originY) << 4;
+			const int32_t alpha = t.alpha0 + fixedX*t.alphaXdecr + fixedY*t.alphaYdecr + t.alphaBias;
+			const int32_t beta = t.beta0 + fixedX*t.betaXdecr + fixedY*t.betaYdecr + t.betaBias;
+			const int32_t gamma = t.gamma0 + fixedX*t.gammaXdecr + fixedY*t.gammaYdecr + t.gammaBias;
+			//see the Top-Left fill convention in rasterizeBinScalar
+			if ((alpha | beta | gamma) >= 0)
+				return true;
+		}
+	}
+	return false;
+}
 
-#endif
+/*
+Perspective correct interpolation of a vertex field f is:
+let:
+A, B and C the barycentric coordinates of the pixel;
+f0, f1 and f2 the value of the field at the triangle's vertices;
+w0, w1 and w2 the w coordinates of the triangle's vertices in Clip space (before perspective division);
+
+f = (A*f0/w0 + B*f1/w1 + C*f2/w2)/(A/w0 + B/w1 + C/w2)
+
+Both the numerator and the denominator are linear functions of the pixel's Screen space coordinates, because A, B and 
+C are. So they are computed here once per triangle, as a value and two derivatives, and the rasterization kernels 
+only evaluate them at each pixel and divide.
+Because A = alpha/(2*area), the derivatives of A are the edge function's decrements divided by twice the area.
+*/
+void BinRasterizer::setupAttributePlanes(const std::vector<Vertex>& vertices, const Triangle& t, size_t i) {
+
+	const TransformedVertex& v0 = m_transformedVertices[t.i0];
+	const TransformedVertex& v1 = m_transformedVertices[t.i1];
+	const TransformedVertex& v2 = m_transformedVertices[t.i2];
+
+	//barycentric coordinates at the origin and their derivatives, divided by w
+	const int32_t fixedX = (t.planeX - m_originX) << 4;
+	const int32_t fixedY = (t.planeY - m_originY) << 4;
+	const float invTwiceArea = 1.0f / t.twiceArea;
+
+	const float aW0 = fixedToFloat<4>(t.alpha0 + fixedX*t.alphaXdecr + fixedY*t.alphaYdecr) * invTwiceArea * v0.invW;
+	const float bW1 = fixedToFloat<4>(t.beta0 + fixedX*t.betaXdecr + fixedY*t.betaYdecr) * invTwiceArea * v1.invW;
+	const float cW2 = fixedToFloat<4>(t.gamma0 + fixedX*t.gammaXdecr + fixedY*t.gammaYdecr) * invTwiceArea * v2.invW;
+	const float aDxW0 = static_cast<float>(t.alphaXdecr) * invTwiceArea * v0.invW;
+	const float bDxW1 = static_cast<float>(t.betaXdecr) * invTwiceArea * v1.invW;
+	const float cDxW2 = static_cast<float>(t.gammaXdecr) * invTwiceArea * v2.invW;
+	const float aDyW0 = static_cast<float>(t.alphaYdecr) * invTwiceArea * v0.invW;
+	const float bDyW1 = static_cast<float>(t.betaYdecr) * invTwiceArea * v1.invW;
+	const float cDyW2 = static_cast<float>(t.gammaYdecr) * invTwiceArea * v2.invW;
+
+	float* planes = &m_attributePlanes[i*m_planeStride];
+	planes[0] = aW0 + bW1 + cW2;
+	planes[1] = aDxW0 + bDxW1 + cDxW2;
+	planes[2] = aDyW0 + bDyW1 + cDyW2;
+	planes[3] = 0.0f;
+
+	float* values = planes + 4;
+	float* xDerivatives = values + m_paddedAttributeCount;
+	float* yDerivatives = xDerivatives + m_paddedAttributeCount;
+
+	//position excluded
+	const float* f0 = vertices[t.i0].vertexData() + 4;
+	const float* f1 = vertices[t.i1].vertexData() + 4;
+	const float* f2 = vertices[t.i2].vertexData() + 4;
+	for (size_t c = 0; c < m_attributeCount; c++) {
+		values[c] = aW0*f0[c] + bW1*f1[c] + cW2*f2[c];
+		xDerivatives[c] = aDxW0*f0[c] + bDxW1*f1[c] + cDxW2*f2[c];
+		yDerivatives[c] = aDyW0*f0[c] + bDyW1*f1[c] + cDyW2*f2[c];
+	}
+	//padding, so that the kernels can process 4 floats at the time
+	for (size_t c = m_attributeCount; c < m_paddedAttributeCount; c++) {
+		values[c] = 0.0f;
+		xDerivatives[c] = 0.0f;
+		yDerivatives[c] = 0.0f;
+	}
 }
 
-BinRasterizer::Bin::Bin(Bin&& bin) {	
+BinRasterizer::Bin::Bin(Bin&& bin) 
+	: xMin{ bin.xMin }, yMin{ bin.yMin }, xMax{ bin.xMax }, yMax{ bin.yMax }, firstChunk{ std::move(bin.firstChunk) },
+	interpolationBuffer{ std::move(bin.interpolationBuffer) } {
+}
+
+void BinRasterizer::Bin::reset() {
+	if (!firstChunk)
+		firstChunk.reset(new TriangleChunk{});
+	writeChunk = firstChunk.get();
+	writeCount = 0;
+	readChunk = firstChunk.get();
+	readCount = 0;
 #ifdef SOFTRP_MULTI_THREAD
-	//TODO: this shouldn't be necessary
-	std::lock_guard<std::mutex> lock{ mutex };
-	done = bin.done;
+	/*
+	the consumer is started after the reset, through the ThreadPool, which makes 
+	these stores visible to it
+	*/
+	count.store(0, std::memory_order_relaxed);
+	done.store(false, std::memory_order_relaxed);
 #endif
-	xMin = bin.xMin;
-	yMin = bin.yMin;
-	xMax = bin.xMax;
-	yMax = bin.yMax;
-	triangleQueue = std::move(bin.triangleQueue);
 }
 
 void BinRasterizer::Bin::addTriangle(size_t i) {
+	const size_t slot = writeCount % CHUNK_SIZE;
+	if (slot == 0 && writeCount != 0) {
+		//the current chunk is full, move to the next one, allocating it if it wasn't by a previous use
+		if (!writeChunk->next)
+			writeChunk->next.reset(new TriangleChunk{});
+		writeChunk = writeChunk->next.get();
+	}
+	writeChunk->triangles[slot] = i;
+	writeCount++;
 #ifdef SOFTRP_MULTI_THREAD
-{
-	std::lock_guard<std::mutex> lock{ mutex };
-#endif
-	triangleQueue.push(i);
-#ifdef SOFTRP_MULTI_THREAD
-}
-	existsNext.notify_one();
+	//publish the triangle (and the link to its chunk)
+	count.store(writeCount, std::memory_order_release);
 #endif
 }
 
 #ifdef SOFTRP_MULTI_THREAD
-void BinRasterizer::Bin::setDone(bool _done) {	
-	{
-		std::lock_guard<std::mutex> lock{ mutex };
-		done = _done;
-	}
-	if (_done)
-		existsNext.notify_one();
+void BinRasterizer::Bin::setDone() {
+	done.store(true, std::memory_order_release);
 }
 #endif
 
 bool BinRasterizer::Bin::hasNext() {
 #ifdef SOFTRP_MULTI_THREAD
-	std::unique_lock<std::mutex> lock{ mutex };
-
-	if (done && triangleQueue.size() == 0)
-		return false;
-
-	while (triangleQueue.size() == 0) {
-		existsNext.wait(lock);
-		if (done && triangleQueue.size() == 0)
+	/*
+	the producer adds all the triangles of the bin in a short burst, so wait spinning for a while
+	and then just yield the processor.
+	*/
+	for (unsigned int spin = 0; ; spin++) {
+		//done is loaded first: if it is set, count's value is final
+		const bool isDone = done.load(std::memory_order_acquire);
+		if (readCount < count.load(std::memory_order_acquire))
+			return true;
+		if (isDone)
 			return false;
+		if (spin >= SPIN_COUNT)
+			std::this_thread::yield();
 	}
 #else
-	if (triangleQueue.size() == 0)
-		return false;
+	return readCount < writeCount;
 #endif
-	return true;
+}
+
+float* BinRasterizer::Bin::interpolationData(size_t size) {
+	//a vector's data is always aligned to sizeof(float), so at most 3 floats are skipped
+	constexpr size_t alignment = 16;
+	if (interpolationBuffer.size() < size + 3)
+		interpolationBuffer.resize(size + 3);
+	const uintptr_t address = reinterpret_cast<uintptr_t>(interpolationBuffer.data());
+	const size_t offset = ((alignment - address % alignment) % alignment) / sizeof(float);
+	return interpolationBuffer.data() + offset;
 }
 
 size_t BinRasterizer::Bin::getNext() {
-#ifdef SOFTRP_MULTI_THREAD
-	std::unique_lock<std::mutex> lock{ mutex };
+	const size_t slot = readCount % CHUNK_SIZE;
+	if (slot == 0 && readCount != 0)
+		readChunk = readChunk->next.get();
+	readCount++;
+	return readChunk->triangles[slot];
+}
+
+void BinRasterizer::rasterizeBin(Bin& bin, const std::vector<Vertex>* vertices) {
+	(this->*m_rasterizeBinKernel)(bin, vertices);
+}
+
+void BinRasterizer::initQuadBatch(QuadBatch& batch, float* storage, VertexLayout* vertexLayout) {
+	batch.context.quadCount = 0;
+	batch.context.data = storage;
+	batch.group = nullptr;
+	batch.context.vertexLayout = vertexLayout;
+	batch.context.scratch = storage + (4 + m_attributeCount)*PSBatchContext::LANES;
+	batch.data = storage;
+}
+
+size_t BinRasterizer::quadBatchStorageSize() const {
+	//the quads' lanes, followed by the scratch vertices of the PixelShader
+	return (4 + m_attributeCount)*PSBatchContext::LANES + 4 * (4 + m_paddedAttributeCount);
+}
+
+void BinRasterizer::batchQuad(QuadBatch& batch, size_t i, const Math::Vector4& position,
+							  int32_t x, int32_t y, int32_t mask, const TriangleGroup& group) {
+
+	//a batch is shaded for a single group
+	if (batch.context.quadCount != 0 && batch.group != &group)
+		shadeQuadBatch(batch);
+	batch.group = &group;
+
+	const size_t quad = batch.context.quadCount;
+	batch.context.masks[quad] = mask;
+	batch.quadX[quad] = x;
+	batch.quadY[quad] = y;
+	float* lanes = batch.data + 4 * quad;
+
+	//the position is not interpolated, the one of the first vertex is given
+	for (unsigned int c = 0; c < 4; c++, lanes += PSBatchContext::LANES) {
+		for (unsigned int k = 0; k < 4; k++)
+			lanes[k] = position[c];
+	}
+
+	const Triangle& t = m_triangles[i];
+	const float* planes = &m_attributePlanes[i*m_planeStride];
+	const float* values = planes + 4;
+	const float* xDerivatives = values + m_paddedAttributeCount;
+	const float* yDerivatives = xDerivatives + m_paddedAttributeCount;
+
+	/*
+	evaluate the plane equations (see setupAttributePlanes) at the quad's pixels, an attribute's float
+	for all of them at the time. 1/q is computed exactly, once per quad.
+	*/
+	const float quadX = static_cast<float>(x - t.planeX);
+	const float quadY = static_cast<float>(y - t.planeY);
+#ifdef SOFTRP_USE_SIMD
+	const __m128 xOffsets = _mm_set_ps(quadX, quadX + 1.0f, quadX, quadX + 1.0f);
+	const __m128 yOffsets = _mm_set_ps(quadY, quadY, quadY + 1.0f, quadY + 1.0f);
+	const __m128 q = _mm_add_ps(_mm_add_ps(_mm_set_ps1(planes[0]), _mm_mul_ps(_mm_set_ps1(planes[1]), xOffsets)),
+								_mm_mul_ps(_mm_set_ps1(planes[2]), yOffsets));
+	const __m128 invQ = _mm_div_ps(_mm_set_ps1(1.0f), q);
+	for (size_t c = 0; c < m_attributeCount; c++, lanes += PSBatchContext::LANES) {
+		const __m128 value = _mm_add_ps(_mm_add_ps(_mm_set_ps1(values[c]), _mm_mul_ps(_mm_set_ps1(xDerivatives[c]), xOffsets)),
+										_mm_mul_ps(_mm_set_ps1(yDerivatives[c]), yOffsets));
+		_mm_store_ps(lanes, _mm_mul_ps(value, invQ));
+	}
+#else
+	const float xOffsets[4]{ quadX + 1.0f, quadX, quadX + 1.0f, quadX };
+	const float yOffsets[4]{ quadY + 1.0f, quadY + 1.0f, quadY, quadY };
+	float invQ[4];
+	for (unsigned int k = 0; k < 4; k++)
+		invQ[k] = 1.0f / (planes[0] + planes[1] * xOffsets[k] + planes[2] * yOffsets[k]);
+	for (size_t c = 0; c < m_attributeCount; c++, lanes += PSBatchContext::LANES) {
+		for (unsigned int k = 0; k < 4; k++)
+			lanes[k] = (values[c] + xDerivatives[c] * xOffsets[k] + yDerivatives[c] * yOffsets[k]) * invQ[k];
+	}
 #endif
-	size_t next = triangleQueue.front();
-	triangleQueue.pop();	
-	return next;
+
+	batch.context.quadCount++;
+	if (batch.context.quadCount == PSBatchContext::MAX_QUADS)
+		shadeQuadBatch(batch);
 }
 
-#ifndef SOFTRP_USE_SIMD
-void SoftRP::BinRasterizer::rasterizeBin(Bin& bin, const std::vector<Vertex>* vertices, size_t instance) {
+void BinRasterizer::shadeQuadBatch(QuadBatch& batch) {
+
+	if (batch.context.quadCount == 0)
+		return;
+
+	pixelShader()->shadeBatch(*batch.group->shaderContext, batch.context, batch.group->instance, batch.colors);
+
+	//write pixels that are found to be inside and passed the depth test, in the order the quads were added
+	for (size_t q = 0; q < batch.context.quadCount; q++) {
+		const int32_t mask = batch.context.masks[q];
+		const unsigned int x0 = static_cast<unsigned int>(batch.quadX[q]);
+		const unsigned int y0 = static_cast<unsigned int>(batch.quadY[q]);
+		const Math::Vector4* colors = batch.colors + 4 * q;
+		if ((mask & 0x1) != 0)
+			writePixel(y0 + 1, x0 + 1, colors[0]);
+		if ((mask & 0x2) != 0)
+			writePixel(y0 + 1, x0, colors[1]);
+		if ((mask & 0x4) != 0)
+			writePixel(y0, x0 + 1, colors[2]);
+		if ((mask & 0x8) != 0)
+			writePixel(y0, x0, colors[3]);
+	}
+
+	batch.context.quadCount = 0;
+}
 
-	Vertex vertexData2{};
-	Vertex vertexData3{};
+void SoftRP::BinRasterizer::rasterizeBinScalar(Bin& bin, const std::vector<Vertex>* vertices) {
 
+	/*
+	the interpolated vertices refer to the bin's storage, each in a slot large enough for the position 
+	and the padded attributes
+	*/
 	PSExecutionContext execContext{};
-	Vertex& interpolated0 = execContext.interpolated[0];
-	Vertex& interpolated1 = execContext.interpolated[1];
-	Vertex& interpolated2 = execContext.interpolated[2];
-	Vertex& interpolated3 = execContext.interpolated[3];
+	VertexLayout* vertexLayout = &(*vertices)[0].vertexLayout();
+	const size_t slotSize = 4 + m_paddedAttributeCount;
+	//a batched pixel shader is given the quads in batches, interpolated after the slots
+	const bool batched = pixelShader()->batched();
+	float* interpolationData = bin.interpolationData(4 * slotSize + (batched ? quadBatchStorageSize() : 0));
+	for (unsigned int k = 0; k < 4; k++)
+		execContext.interpolated[k].setVertexData(interpolationData + k*slotSize, vertexLayout);
+	QuadBatch batch;
+	initQuadBatch(batch, interpolationData + 4 * slotSize, vertexLayout);
 
 	const int32_t xMin = bin.xMin;
 	const int32_t xMax = bin.xMax;
 	const int32_t yMin = bin.yMin;
 	const int32_t yMax = bin.yMax;
 
-	const int32_t renderTargetWidthMinusOne = static_cast<int32_t>(m_renderTargetWidth) - 1;
-	const int32_t renderTargetHeightMinusOne = static_cast<int32_t>(m_renderTargetHeight) - 1;
+	const int32_t scissorXMin = m_scissorXMin;
+	const int32_t scissorYMin = m_scissorYMin;
+	const int32_t scissorXMaxMinusOne = m_scissorXMax - 1;
+	const int32_t scissorYMaxMinusOne = m_scissorYMax - 1;
+
+	static_assert((BLOCK_WIDTH % 2 == 0) && (BLOCK_HEIGHT % 2 == 0), "Invalid block size, it must be a multiple of 2.");
+	static_assert((TILE_WIDTH % BLOCK_WIDTH == 0) && (TILE_HEIGHT % BLOCK_HEIGHT == 0), "Invalid block size, it must divide the tile size.");
+	const int32_t blockWidth = static_cast<int32_t>(BLOCK_WIDTH);
+	const int32_t blockHeight = static_cast<int32_t>(BLOCK_HEIGHT);
+
+	const unsigned int tileI = static_cast<unsigned int>(yMin) / TILE_HEIGHT;
+	const unsigned int tileJ = static_cast<unsigned int>(xMin) / TILE_WIDTH;
+	bool binWritten = false;
 
 	while (bin.hasNext()) {
 
 		const size_t i = bin.getNext();
 		const Triangle& t = m_triangles[i];
+		const TriangleGroup& group = triangleGroup(i);
 
 		const TransformedVertex& v0 = m_transformedVertices[t.i0];
 		const TransformedVertex& v1 = m_transformedVertices[t.i1];
 		const TransformedVertex& v2 = m_transformedVertices[t.i2];
 
-		//evaluate edge functions at (xMin, yMin)		
-		const int32_t fixedXMin = xMin << 4;
-		const int32_t fixedYMin = yMin << 4;
+		const float* planes = &m_attributePlanes[i*m_planeStride];
+		const float* values = planes + 4;
+		const float* xDerivatives = values + m_paddedAttributeCount;
+		const float* yDerivatives = xDerivatives + m_paddedAttributeCount;
+
+		//the position is not interpolated, the one of the first vertex is given
+		const Math::Vector4& position = (*vertices)[t.i0].position();
+		for (unsigned int k = 0; k < 4; k++)
+			execContext.interpolated[k].position() = position;
+
+		/*
+		walk only the blocks touched by the triangle's AABB, instead of the whole tile.
+		evaluate edge functions at the top-left pixel of the first one
+		*/
+		const int32_t walkXMin = xMin + (std::max(t.xMin - xMin, 0) / blockWidth)*blockWidth;
+		const int32_t walkYMin = yMin + (std::max(t.yMin - yMin, 0) / blockHeight)*blockHeight;
+		const int32_t walkXMax = std::min(xMax, t.xMax + 1);
+		const int32_t walkYMax = std::min(yMax, t.yMax + 1);
+		const int32_t fixedXMin = (walkXMin - m_originX) << 4;
+		const int32_t fixedYMin = (walkYMin - m_originY) << 4;
 		int32_t alpha0 = t.alpha0 + fixedXMin*t.alphaXdecr + fixedYMin*t.alphaYdecr;
 		int32_t beta0 = t.beta0 + t.betaXdecr*fixedXMin + t.betaYdecr*fixedYMin;
 		int32_t gamma0 = t.gamma0 + t.gammaXdecr*fixedXMin + t.gammaYdecr*fixedYMin;
@@ -393,138 +839,208 @@ void SoftRP::BinRasterizer::rasterizeBin(Bin& bin, const std::vector<Vertex>* ve
 		const int32_t doubledGammaXdecr = gammaXdecr << 1;
 		const int32_t doubledGammaYdecr = gammaYdecr << 1;
 
-		//process a 2x2 pixel block at the time
-		for (int32_t y = yMin; y < yMax; y += 2,
-									 alpha0 += doubledAlphaYdecr,
-									 beta0 += doubledBetaYdecr,
-									 gamma0 += doubledGammaYdecr) {
-
-			//edge functions for all pixels in the block		
-			const int32_t alpha0PlusXdecr = alpha0 + alphaXdecr;			
-			const int32_t beta0PlusXdecr = beta0 + betaXdecr;			
-			const int32_t gamma0PlusXdecr = gamma0 + gammaXdecr;			
-			int32_t alpha[4]{ alpha0PlusXdecr + alphaYdecr, alpha0 + alphaYdecr, alpha0PlusXdecr, alpha0 };
-			int32_t beta[4]{ beta0PlusXdecr + betaYdecr,  beta0 + betaYdecr, beta0PlusXdecr, beta0};
-			int32_t gamma[4]{ gamma0PlusXdecr + gammaYdecr, gamma0 + gammaYdecr, gamma0PlusXdecr, gamma0};
-
-			for (int32_t x = xMin; x < xMax; x += 2) {
-
-				const int32_t xPositions[4]{ x + 1, x , x + 1, x };
-				const int32_t yPositions[4]{ y + 1 , y + 1 , y, y };
-
-				//alpha, beta and gamma in floating-point notation
-				float a[4];
-				float b[4];
-				float c[4];
-
-				int32_t writeMask = 0;
-
-				for (unsigned int k = 0; k < 4; k++) {
-
-					/*
-					Top-Left fill convention:
-					Testing mask >=0 is equivalent to ((alpha + alphaBias) >= 0 && (beta + betaBias) >= 0 && (gamma + gammaBias) >= 0).
-					This is because the sign bit of mask is 1 (negative) if any of the terms being ORed is.
-					*/
-					const int32_t mask = (alpha[k] + t.alphaBias) | (beta[k] + t.betaBias) | (gamma[k] + t.gammaBias);
-
-					/*
-					Inside render target test:
-					x >= width iff x + 1 > width iff width - 1 < x iff (width - 1) - x < 0
-					y >= height iff y + 1 > height iff height - 1 < y iff (height - 1) - y < 0
-					So, using the same trick used for mask (sign bit), boundMask is negative if x >= width || y >= height
-					*/
-					const int32_t boundMask = 
-						(renderTargetWidthMinusOne - xPositions[k]) | (renderTargetHeightMinusOne - yPositions[k]);
-
-					a[k] = fixedToFloat<4>(alpha[k]);
-					b[k] = fixedToFloat<4>(beta[k]);
-					c[k] = fixedToFloat<4>(gamma[k]);
-										
-					if ((mask | boundMask) >= 0) {
-						/*
-						compute depth by linearly interpolate the vertices' depths
-						Let A, B and C be the barycentric coordinates of the pixel, then:
-						depth = A*depth0 + B*depth1 + C*depth2
-						because A = alpha/(2*area), B = beta/(2*area) and C = gamma/(2*area), then:
-						depth = (alpha*depth0 + beta*depth1 + gamma*depth2)/(2*area)
-						*/
-						const float depth = (a[k]*v0.position[2] + b[k]*v1.position[2] + c[k]*v2.position[2]) / t.twiceArea;
-						if (depthTest(yPositions[k], xPositions[k], depth))
-							writeMask |= (1 << k);
-					}					
-				}
+		//decrements for movement 1 block wide
+		const int32_t blockAlphaXdecr = alphaXdecr * blockWidth;
+		const int32_t blockAlphaYdecr = alphaYdecr * blockHeight;
+		const int32_t blockBetaXdecr = betaXdecr * blockWidth;
+		const int32_t blockBetaYdecr = betaYdecr * blockHeight;
+		const int32_t blockGammaXdecr = gammaXdecr * blockWidth;
+		const int32_t blockGammaYdecr = gammaYdecr * blockHeight;
 
-				if (writeMask != 0) {
+		/*
+		extremes of the biased edge functions over a block, relative to their values at its top-left pixel.
+		a small triangle never covers a whole block and touches few of them: its blocks are not tested 
+		against the edge functions, only its quads are
+		*/
+		int32_t alphaBlockMin = 0;
+		int32_t alphaBlockMax = 0;
+		int32_t betaBlockMin = 0;
+		int32_t betaBlockMax = 0;
+		int32_t gammaBlockMin = 0;
+		int32_t gammaBlockMax = 0;
+		if (!t.small) {
+			alphaBlockMin = blockExtent(alphaXdecr, alphaYdecr, blockWidth, blockHeight, false) + t.alphaBias;
+			alphaBlockMax = blockExtent(alphaXdecr, alphaYdecr, blockWidth, blockHeight, true) + t.alphaBias;
+			betaBlockMin = blockExtent(betaXdecr, betaYdecr, blockWidth, blockHeight, false) + t.betaBias;
+			betaBlockMax = blockExtent(betaXdecr, betaYdecr, blockWidth, blockHeight, true) + t.betaBias;
+			gammaBlockMin = blockExtent(gammaXdecr, gammaYdecr, blockWidth, blockHeight, false) + t.gammaBias;
+			gammaBlockMax = blockExtent(gammaXdecr, gammaYdecr, blockWidth, blockHeight, true) + t.gammaBias;
+		}
 
-					//at least one pixel is inside the triangle and passed the depth test
-					
-					for (unsigned int k = 0; k < 4; k++) {
+		for (int32_t blockY = walkYMin; blockY < walkYMax; blockY += blockHeight,
+												   alpha0 += blockAlphaYdecr,
+												   beta0 += blockBetaYdecr,
+												   gamma0 += blockGammaYdecr) {
 
-						/*
-						interpolate vertices.
-						to achieve perspective correct interpolation, a vertex field f is computed as follows:
-						
-						let:
-						A, B and C the barycentric coordinates of the pixel;
-						f0, f1 and f2 the value of the field at the triangle's vertices;
-						w0, w1 and w2 the w coordinates of the triangle's vertices in Clip space (before perspective division);
-						
-						f = (A*f0/w0 + B*f1/w1 + C*f2/w2)/(A/w0 + B/w1 + C/w2)
-
-						because A = alpha/(2*area), B = beta/(2*area) and C = gamma/(2*area), then:
-						let A1 = alpha/w0, B1 = beta/w1, C1 = gamma/w2
-
-						f = [(A1*f0 + B1*f1 + C1*f2)/(2*area)] / [(A1 + B1 + C1) / (2*area)]
-						f = (A1*f0 + B1*f1 + C1*f2) / (A1 + B1 + C1)
-						*/
+			const int32_t blockYMax = std::min(blockY + blockHeight, walkYMax);
 
-						const float alphaOnW0 = v0.invW * a[k];
-						const float betaOnW1 = v1.invW * b[k];
-						const float gammaOnW2 = v2.invW * c[k];
+			int32_t blockAlpha = alpha0;
+			int32_t blockBeta = beta0;
+			int32_t blockGamma = gamma0;
 
-						Vertex& interpolated = execContext.interpolated[k];
+			for (int32_t blockX = walkXMin; blockX < walkXMax; blockX += blockWidth,
+													   blockAlpha += blockAlphaXdecr,
+													   blockBeta += blockBetaXdecr,
+													   blockGamma += blockGammaXdecr) {
 
-						interpolated = (*vertices)[t.i0];
-						vertexData2 = (*vertices)[t.i1];
-						vertexData3 = (*vertices)[t.i2];
+				//the block is outside if any of the edge functions is negative over all of it
+				if (!t.small && ((blockAlpha + alphaBlockMax) | (blockBeta + betaBlockMax) | (blockGamma + gammaBlockMax)) < 0)
+					continue;
 
-						interpolated.scaleVertexData(alphaOnW0);
-						vertexData2.scaleVertexData(betaOnW1);
-						vertexData3.scaleVertexData(gammaOnW2);
+				//the block is occluded if the triangle's minimum depth is not less than the block's maximum one
+				const unsigned int blockI = static_cast<unsigned int>(blockY) / BLOCK_HEIGHT;
+				const unsigned int blockJ = static_cast<unsigned int>(blockX) / BLOCK_WIDTH;
+				if (t.minDepth >= depthBuffer()->blockMaxDepth(blockI, blockJ))
+					continue;
 
-						interpolated.addVertexData(vertexData2);
-						interpolated.addVertexData(vertexData3);
-						interpolated.scaleVertexData(1.0f / (alphaOnW0 + betaOnW1 + gammaOnW2));
+				//the block is inside if all the edge functions are non-negative over all of it
+				const bool blockCovered = !t.small && ((blockAlpha + alphaBlockMin) | (blockBeta + betaBlockMin) | (blockGamma + gammaBlockMin)) >= 0;
+
+				const int32_t blockXMax = std::min(blockX + blockWidth, walkXMax);
+				bool blockWritten = false;
+
+				//skip the quads above and on the left of the triangle's AABB
+				const int32_t quadXMin = std::max(blockX, t.xMin & ~1);
+				const int32_t quadYMin = std::max(blockY, t.yMin & ~1);
+
+				int32_t rowAlpha = blockAlpha + (quadXMin - blockX)*alphaXdecr + (quadYMin - blockY)*alphaYdecr;
+				int32_t rowBeta = blockBeta + (quadXMin - blockX)*betaXdecr + (quadYMin - blockY)*betaYdecr;
+				int32_t rowGamma = blockGamma + (quadXMin - blockX)*gammaXdecr + (quadYMin - blockY)*gammaYdecr;
+
+				//process a 2x2 pixel block at the time
+				for (int32_t y = quadYMin; y < blockYMax; y += 2,
+											 rowAlpha += doubledAlphaYdecr,
+											 rowBeta += doubledBetaYdecr,
+											 rowGamma += doubledGammaYdecr) {
+
+					//edge functions for all pixels in the block
+					const int32_t alpha0PlusXdecr = rowAlpha + alphaXdecr;
+					const int32_t beta0PlusXdecr = rowBeta + betaXdecr;
+					const int32_t gamma0PlusXdecr = rowGamma + gammaXdecr;
+					int32_t alpha[4]{ alpha0PlusXdecr + alphaYdecr, rowAlpha + alphaYdecr, alpha0PlusXdecr, rowAlpha };
+					int32_t beta[4]{ beta0PlusXdecr + betaYdecr,  rowBeta + betaYdecr, beta0PlusXdecr, rowBeta};
+					int32_t gamma[4]{ gamma0PlusXdecr + gammaYdecr, rowGamma + gammaYdecr, gamma0PlusXdecr, rowGamma};
+
+					for (int32_t x = quadXMin; x < blockXMax; x += 2) {
+
+						const int32_t xPositions[4]{ x + 1, x , x + 1, x };
+						const int32_t yPositions[4]{ y + 1 , y + 1 , y, y };
+
+						//alpha, beta and gamma in floating-point notation
+						float a[4];
+						float b[4];
+						float c[4];
+
+						int32_t writeMask = 0;
+
+						for (unsigned int k = 0; k < 4; k++) {
+
+							/*
+							Top-Left fill convention:
+							Testing mask >=0 is equivalent to ((alpha + alphaBias) >= 0 && (beta + betaBias) >= 0 && (gamma + gammaBias) >= 0).
+							This is because the sign bit of mask is 1 (negative) if any of the terms being ORed is.
+							The test is skipped if the whole block is known to be inside.
+							*/
+							const int32_t mask = blockCovered ? 0 :
+								(alpha[k] + t.alphaBias) | (beta[k] + t.betaBias) | (gamma[k] + t.gammaBias);
+
+							/*
+							Inside scissor rectangle test:
+							x >= xMax iff x + 1 > xMax iff xMax - 1 < x iff (xMax - 1) - x < 0
+							x < xMin iff x - xMin < 0, and the same holds for y.
+							So, using the same trick used for mask (sign bit), boundMask is negative if the pixel is outside
+							*/
+							const int32_t boundMask = 
+								(scissorXMaxMinusOne - xPositions[k]) | (scissorYMaxMinusOne - yPositions[k]) |
+								(xPositions[k] - scissorXMin) | (yPositions[k] - scissorYMin);
+
+							a[k] = fixedToFloat<4>(alpha[k]);
+							b[k] = fixedToFloat<4>(beta[k]);
+							c[k] = fixedToFloat<4>(gamma[k]);
+												
+							if ((mask | boundMask) >= 0) {
+								/*
+								compute depth by linearly interpolate the vertices' depths
+								Let A, B and C be the barycentric coordinates of the pixel, then:
+								depth = A*depth0 + B*depth1 + C*depth2
+								because A = alpha/(2*area), B = beta/(2*area) and C = gamma/(2*area), then:
+								depth = (alpha*depth0 + beta*depth1 + gamma*depth2)/(2*area)
+								*/
+								const float depth = (a[k]*v0.position[2] + b[k]*v1.position[2] + c[k]*v2.position[2]) / t.twiceArea;
+								if (depthTest(yPositions[k], xPositions[k], depth))
+									writeMask |= (1 << k);
+							}					
+						}
+
+						if (writeMask != 0 && visibilityBuffer() != nullptr) {
+							blockWritten = true;
+
+							//the pixels are shaded later (see Renderer::resolveVisibility), only the triangle is written
+							for (unsigned int k = 0; k < 4; k++) {
+								if ((writeMask & (1 << k)) != 0)
+									writeVisibility(static_cast<unsigned int>(yPositions[k]), static_cast<unsigned int>(xPositions[k]), static_cast<uint32_t>(i));
+							}
+						} else if (writeMask != 0 && batched) {
+							blockWritten = true;
+							batchQuad(batch, i, position, x, y, writeMask, group);
+						} else if (writeMask != 0) {
+							blockWritten = true;
+
+							//at least one pixel is inside the triangle and passed the depth test
+							
+							/*
+							interpolate vertices, evaluating the triangle's plane equations (see setupAttributePlanes).
+							all the pixels are interpolated, the pixel shader may need them to compute derivatives.
+							*/
+							for (unsigned int k = 0; k < 4; k++) {
+								const float x = static_cast<float>(xPositions[k] - t.planeX);
+								const float y = static_cast<float>(yPositions[k] - t.planeY);
+								const float invQ = 1.0f / (planes[0] + planes[1] * x + planes[2] * y);
+								float* attributes = execContext.interpolated[k].vertexData() + 4;
+								for (size_t c = 0; c < m_attributeCount; c++)
+									attributes[c] = (values[c] + xDerivatives[c] * x + yDerivatives[c] * y) * invQ;
+							}
+
+							//execute pixel shader
+							execContext.mask = writeMask;
+							Math::Vector4 outColors[4];
+							(*pixelShader())(*group.shaderContext, execContext, group.instance, outColors);
+
+							//write pixels that are found to be inside and passed the depth test
+							if ((writeMask & 0x1) != 0)
+								writePixel(static_cast<unsigned int>(yPositions[0]), static_cast<unsigned int>(xPositions[0]), outColors[0]);
+							if ((writeMask & 0x2) != 0)
+								writePixel(static_cast<unsigned int>(yPositions[1]), static_cast<unsigned int>(xPositions[1]), outColors[1]);
+							if ((writeMask & 0x4) != 0)
+								writePixel(static_cast<unsigned int>(yPositions[2]), static_cast<unsigned int>(xPositions[2]), outColors[2]);
+							if ((writeMask & 0x8) != 0)
+								writePixel(static_cast<unsigned int>(yPositions[3]), static_cast<unsigned int>(xPositions[3]), outColors[3]);
+						}
+
+						for (unsigned int k = 0; k < 4; k++) {
+							alpha[k] += doubledAlphaXdecr;
+							beta[k] += doubledBetaXdecr;
+							gamma[k] += doubledGammaXdecr;
+						}
 					}
-
-					//execute pixel shader
-					execContext.mask = writeMask;
-					Math::Vector4 outColors[4];
-					(*pixelShader())(*shaderContext(), execContext, instance, outColors);
-
-					//write pixels that are found to be inside and passed the depth test
-					if ((writeMask & 0x1) != 0)
-						writePixel(static_cast<unsigned int>(yPositions[0]), static_cast<unsigned int>(xPositions[0]), outColors[0]);
-					if ((writeMask & 0x2) != 0)
-						writePixel(static_cast<unsigned int>(yPositions[1]), static_cast<unsigned int>(xPositions[1]), outColors[1]);
-					if ((writeMask & 0x4) != 0)
-						writePixel(static_cast<unsigned int>(yPositions[2]), static_cast<unsigned int>(xPositions[2]), outColors[2]);
-					if ((writeMask & 0x8) != 0)
-						writePixel(static_cast<unsigned int>(yPositions[3]), static_cast<unsigned int>(xPositions[3]), outColors[3]);
 				}
 
-				for (unsigned int k = 0; k < 4; k++) {
-					alpha[k] += doubledAlphaXdecr;
-					beta[k] += doubledBetaXdecr;
-					gamma[k] += doubledGammaXdecr;
+				//depth values have been lowered, so may have been the block's maximum
+				if (blockWritten) {
+					depthBuffer()->updateBlockMaxDepth(blockI, blockJ);
+					binWritten = true;
 				}
 			}
 		}
 	}
+
+	shadeQuadBatch(batch);
+
+	if (binWritten)
+		depthBuffer()->updateTileMaxDepth(tileI, tileJ);
 }
 
-#else
+#ifdef SOFTRP_USE_SIMD
 /*helper functions forward declarations*/
 inline static int32_t depthTest(DepthBuffer* depthBuffer,
 							const int32_t* i, const int32_t* j,
@@ -533,43 +1049,63 @@ inline static int32_t depthTest(DepthBuffer* depthBuffer,
 template<int32_t fractionalSize>
 static __m128 fixedToFloat(__m128i fixed);
 template<>
-static __m128 fixedToFloat<4>(__m128i fixed);
+__m128 fixedToFloat<4>(__m128i fixed);
 
-void SoftRP::BinRasterizer::rasterizeBin(Bin& bin, const std::vector<Vertex>* vertices, size_t instance) {
+SOFTRP_TARGET_SSE4
+void SoftRP::BinRasterizer::rasterizeBinSSE(Bin& bin, const std::vector<Vertex>* vertices) {
 
 	//the implementation follows the non-SIMD version. refer to it for details.
 
 	static_assert((TILE_WIDTH % 2 == 0) && (TILE_HEIGHT % 2 == 0), "Invalid tile size, it must be a multiple of 2.");
 
-	Vertex vertexData1{};
-	Vertex vertexData2{};
-	Vertex vertexData3{};
-
 	PSExecutionContext execContext{};
-	Vertex& interpolated0 = execContext.interpolated[0];
-	Vertex& interpolated1 = execContext.interpolated[1];
-	Vertex& interpolated2 = execContext.interpolated[2];
-	Vertex& interpolated3 = execContext.interpolated[3];
+	VertexLayout* vertexLayout = &(*vertices)[0].vertexLayout();
+	const size_t slotSize = 4 + m_paddedAttributeCount;
+	const bool batched = pixelShader()->batched();
+	float* interpolationData = bin.interpolationData(4 * slotSize + (batched ? quadBatchStorageSize() : 0));
+	float* quadAttributes[4];
+	for (unsigned int k = 0; k < 4; k++) {
+		execContext.interpolated[k].setVertexData(interpolationData + k*slotSize, vertexLayout);
+		quadAttributes[k] = interpolationData + k*slotSize + 4;
+	}
+	QuadBatch batch;
+	initQuadBatch(batch, interpolationData + 4 * slotSize, vertexLayout);
 
 	const int32_t xMin = bin.xMin;
 	const int32_t xMax = bin.xMax;
 	const int32_t yMin = bin.yMin;
 	const int32_t yMax = bin.yMax;
 
-	const int32_t renderTargetWidth = static_cast<int32_t>(m_renderTargetWidth);
-	const int32_t renderTargetHeight = static_cast<int32_t>(m_renderTargetHeight);
+	const __m128i xMinBoundMask = _mm_set1_epi32(m_scissorXMin - 1);
+	const __m128i yMinBoundMask = _mm_set1_epi32(m_scissorYMin - 1);
+	const __m128i xMaxBoundMask = _mm_set1_epi32(m_scissorXMax);
+	const __m128i yMaxBoundMask = _mm_set1_epi32(m_scissorYMax);
+
+	static_assert((BLOCK_WIDTH % 2 == 0) && (BLOCK_HEIGHT % 2 == 0), "Invalid block size, it must be a multiple of 2.");
+	static_assert((TILE_WIDTH % BLOCK_WIDTH == 0) && (TILE_HEIGHT % BLOCK_HEIGHT == 0), "Invalid block size, it must divide the tile size.");
+	const int32_t blockWidth = static_cast<int32_t>(BLOCK_WIDTH);
+	const int32_t blockHeight = static_cast<int32_t>(BLOCK_HEIGHT);
+
+	const unsigned int tileI = static_cast<unsigned int>(yMin) / TILE_HEIGHT;
+	const unsigned int tileJ = static_cast<unsigned int>(xMin) / TILE_WIDTH;
+	bool binWritten = false;
 
 	while (bin.hasNext()) {
 
 		size_t i = bin.getNext();
 		const Triangle& t = m_triangles[i];
+		const TriangleGroup& group = triangleGroup(i);
 
 		const TransformedVertex& v0 = m_transformedVertices[t.i0];
 		const TransformedVertex& v1 = m_transformedVertices[t.i1];
 		const TransformedVertex& v2 = m_transformedVertices[t.i2];
 
-		const int32_t fixedXMin = xMin << 4;
-		const int32_t fixedYMin = yMin << 4;
+		const int32_t walkXMin = xMin + (std::max(t.xMin - xMin, 0) / blockWidth)*blockWidth;
+		const int32_t walkYMin = yMin + (std::max(t.yMin - yMin, 0) / blockHeight)*blockHeight;
+		const int32_t walkXMax = std::min(xMax, t.xMax + 1);
+		const int32_t walkYMax = std::min(yMax, t.yMax + 1);
+		const int32_t fixedXMin = (walkXMin - m_originX) << 4;
+		const int32_t fixedYMin = (walkYMin - m_originY) << 4;
 		int32_t alpha0 = t.alpha0 + fixedXMin*t.alphaXdecr + fixedYMin*t.alphaYdecr;
 		int32_t beta0 = t.beta0 + t.betaXdecr*fixedXMin + t.betaYdecr*fixedYMin;
 		int32_t gamma0 = t.gamma0 + t.gammaXdecr*fixedXMin + t.gammaYdecr*fixedYMin;
@@ -585,12 +1121,10 @@ void SoftRP::BinRasterizer::rasterizeBin(Bin& bin, const std::vector<Vertex>* ve
 		const __m128i betaBiasVec = _mm_set1_epi32(t.betaBias);
 		const __m128i gammaBiasVec = _mm_set1_epi32(t.gammaBias);
 
-		const int32_t alpha0PlusXdecr = alpha0 + alphaXdecr;
-		__m128i alpha0Vec = _mm_set_epi32(alpha0, alpha0PlusXdecr, alpha0 + alphaYdecr, alpha0PlusXdecr + alphaYdecr);
-		const int32_t beta0PlusXdecr = beta0 + betaXdecr;
-		__m128i beta0Vec = _mm_set_epi32(beta0, beta0PlusXdecr, beta0 + betaYdecr, beta0PlusXdecr + betaYdecr);
-		const int32_t gamma0PlusXdecr = gamma0 + gammaXdecr;
-		__m128i gamma0Vec = _mm_set_epi32(gamma0, gamma0PlusXdecr, gamma0 + gammaYdecr, gamma0PlusXdecr + gammaYdecr);
+		//offsets of the edge functions of the pixels of a 2x2 block with respect to its top-left pixel
+		const __m128i alphaQuadOffsets = _mm_set_epi32(0, alphaXdecr, alphaYdecr, alphaXdecr + alphaYdecr);
+		const __m128i betaQuadOffsets = _mm_set_epi32(0, betaXdecr, betaYdecr, betaXdecr + betaYdecr);
+		const __m128i gammaQuadOffsets = _mm_set_epi32(0, gammaXdecr, gammaYdecr, gammaXdecr + gammaYdecr);
 
 		const __m128i alphaXdecrVec = _mm_set1_epi32(alphaXdecr << 1);
 		const __m128i alphaYdecrVec = _mm_set1_epi32(alphaYdecr << 1);
@@ -605,197 +1139,610 @@ void SoftRP::BinRasterizer::rasterizeBin(Bin& bin, const std::vector<Vertex>* ve
 		const __m128 v0Z = _mm_set_ps1(v0.position[2]);
 		const __m128 v1Z = _mm_set_ps1(v1.position[2]);
 		const __m128 v2Z = _mm_set_ps1(v2.position[2]);
-		const __m128 invW0 = _mm_set_ps1(v0.invW);
-		const __m128 invW1 = _mm_set_ps1(v1.invW);
-		const __m128 invW2 = _mm_set_ps1(v2.invW);
-
-		vertexData1 = (*vertices)[t.i0];
-		vertexData2 = (*vertices)[t.i1];
-		vertexData3 = (*vertices)[t.i2];
-
-		interpolated0 = vertexData1;
-		interpolated1 = vertexData1;
-		interpolated2 = vertexData1;
-		interpolated3 = vertexData1;
-
-		for (int32_t y = yMin; y < yMax; y += 2,
-									 alpha0Vec = _mm_add_epi32(alpha0Vec, alphaYdecrVec),
-									 beta0Vec = _mm_add_epi32(beta0Vec, betaYdecrVec),
-									 gamma0Vec = _mm_add_epi32(gamma0Vec, gammaYdecrVec)) {
-
-			__m128i alpha = alpha0Vec;
-			__m128i beta = beta0Vec;
-			__m128i gamma = gamma0Vec;
-
-			for (int32_t x = xMin; x < xMax; x += 2,
-										 alpha = _mm_add_epi32(alpha, alphaXdecrVec),
-										 beta = _mm_add_epi32(beta, betaXdecrVec),
-										 gamma = _mm_add_epi32(gamma, gammaXdecrVec)) {
-
-				const __m128i mask = _mm_or_si128(_mm_or_si128(_mm_add_epi32(alpha, alphaBiasVec), _mm_add_epi32(beta, betaBiasVec)),
-												  _mm_add_epi32(gamma, gammaBiasVec));
-				// for each 32-bit integer : 0xFFFFFFFF if test failed (mask < 0), 0 otherwise.
-				__m128i compInside = _mm_cmplt_epi32(mask, inverseTest);
-				//create mask with the most significant bit of all 8-bit integers packed in argument
-				const int test = _mm_movemask_epi8(compInside); 
-
-				if (test == 0xFFFF)//all failed?
+
+		const float* planes = &m_attributePlanes[i*m_planeStride];
+		const float* values = planes + 4;
+		const float* xDerivatives = values + m_paddedAttributeCount;
+		const float* yDerivatives = xDerivatives + m_paddedAttributeCount;
+		const __m128 qQuadOffsets = _mm_set_ps(0.0f, planes[1], planes[2], planes[1] + planes[2]);
+
+		const Math::Vector4& position = (*vertices)[t.i0].position();
+		for (unsigned int k = 0; k < 4; k++)
+			execContext.interpolated[k].position() = position;
+
+		const int32_t blockAlphaXdecr = alphaXdecr * blockWidth;
+		const int32_t blockAlphaYdecr = alphaYdecr * blockHeight;
+		const int32_t blockBetaXdecr = betaXdecr * blockWidth;
+		const int32_t blockBetaYdecr = betaYdecr * blockHeight;
+		const int32_t blockGammaXdecr = gammaXdecr * blockWidth;
+		const int32_t blockGammaYdecr = gammaYdecr * blockHeight;
+
+		int32_t alphaBlockMin = 0;
+		int32_t alphaBlockMax = 0;
+		int32_t betaBlockMin = 0;
+		int32_t betaBlockMax = 0;
+		int32_t gammaBlockMin = 0;
+		int32_t gammaBlockMax = 0;
+		if (!t.small) {
+			alphaBlockMin = blockExtent(alphaXdecr, alphaYdecr, blockWidth, blockHeight, false) + t.alphaBias;
+			alphaBlockMax = blockExtent(alphaXdecr, alphaYdecr, blockWidth, blockHeight, true) + t.alphaBias;
+			betaBlockMin = blockExtent(betaXdecr, betaYdecr, blockWidth, blockHeight, false) + t.betaBias;
+			betaBlockMax = blockExtent(betaXdecr, betaYdecr, blockWidth, blockHeight, true) + t.betaBias;
+			gammaBlockMin = blockExtent(gammaXdecr, gammaYdecr, blockWidth, blockHeight, false) + t.gammaBias;
+			gammaBlockMax = blockExtent(gammaXdecr, gammaYdecr, blockWidth, blockHeight, true) + t.gammaBias;
+		}
+
+		for (int32_t blockY = walkYMin; blockY < walkYMax; blockY += blockHeight,
+												   alpha0 += blockAlphaYdecr,
+												   beta0 += blockBetaYdecr,
+												   gamma0 += blockGammaYdecr) {
+
+			const int32_t blockYMax = std::min(blockY + blockHeight, walkYMax);
+
+			int32_t blockAlpha = alpha0;
+			int32_t blockBeta = beta0;
+			int32_t blockGamma = gamma0;
+
+			for (int32_t blockX = walkXMin; blockX < walkXMax; blockX += blockWidth,
+													   blockAlpha += blockAlphaXdecr,
+													   blockBeta += blockBetaXdecr,
+													   blockGamma += blockGammaXdecr) {
+
+				if (!t.small && ((blockAlpha + alphaBlockMax) | (blockBeta + betaBlockMax) | (blockGamma + gammaBlockMax)) < 0)
 					continue;
 
-				const int32_t x0 = x + 1;
-				const int32_t y0 = y + 1;
-				const int32_t x1 = x;
-				const int32_t y1 = y0;
-				const int32_t x2 = x0;
-				const int32_t y2 = y;
-				const int32_t x3 = x;
-				const int32_t y3 = y;
-																
-				const __m128i xPositionsVec = _mm_set_epi32(x3, x2, x1, x0);
-				const __m128i yPositionsVec = _mm_set_epi32(y3, y2, y1, y0);
-				const __m128i widthBoundMask = _mm_set1_epi32(renderTargetWidth);
-				const __m128i heightBoundMask = _mm_set1_epi32(renderTargetHeight);
-
-				// for each x,y coordinate : 0xFFFFFFFF if inside rendertarget (x < width && y < height), 0 otherwise.
-				const __m128i boundMask =
-					_mm_and_si128(
-						_mm_cmplt_epi32(xPositionsVec, widthBoundMask),
-						_mm_cmplt_epi32(yPositionsVec, heightBoundMask));
-
-				//since compInside == 0 means success, then write pixel iff ((~compInside == 0xFFFFFFFF) & boundMask ) == 0xFFFFFFFF
-				__m128i comp = _mm_andnot_si128(compInside, boundMask);
-
-				const __m128 a = fixedToFloat<4>(alpha);
-				const __m128 b = fixedToFloat<4>(beta);
-				const __m128 c = fixedToFloat<4>(gamma);
-
-				const __m128 depthV0 = _mm_mul_ps(v0Z, a);
-				const __m128 depthV1 = _mm_mul_ps(v1Z, b);
-				const __m128 depthV2 = _mm_mul_ps(v2Z, c);
-				const __m128 depth = _mm_div_ps(_mm_add_ps(_mm_add_ps(depthV0, depthV1), depthV2), twiceArea);
-
-				const int32_t xPositions[4]{ x0, x1, x2, x3	};
-				const int32_t yPositions[4]{ y0, y1, y2, y3	};
-				const int32_t depthTestRes = ::depthTest(depthBuffer(), yPositions, xPositions, depth, comp);
-
-				if (depthTestRes == 0x0)//all failed?
+				//the block is occluded if the triangle's minimum depth is not less than the block's maximum one
+				const unsigned int blockI = static_cast<unsigned int>(blockY) / BLOCK_HEIGHT;
+				const unsigned int blockJ = static_cast<unsigned int>(blockX) / BLOCK_WIDTH;
+				if (t.minDepth >= depthBuffer()->blockMaxDepth(blockI, blockJ))
 					continue;
 
-				const __m128 alphaOnW0 = _mm_mul_ps(invW0, a);
-				const __m128 betaOnW1 = _mm_mul_ps(invW1, b);
-				const __m128 gammaOnW2 = _mm_mul_ps(invW2, c);
+				const bool blockCovered = !t.small && ((blockAlpha + alphaBlockMin) | (blockBeta + betaBlockMin) | (blockGamma + gammaBlockMin)) >= 0;
+
+				const int32_t blockXMax = std::min(blockX + blockWidth, walkXMax);
+				bool blockWritten = false;
+
+				const int32_t quadXMin = std::max(blockX, t.xMin & ~1);
+				const int32_t quadYMin = std::max(blockY, t.yMin & ~1);
+				__m128i alpha0Vec = _mm_add_epi32(_mm_set1_epi32(blockAlpha + (quadXMin - blockX)*alphaXdecr + (quadYMin - blockY)*alphaYdecr), alphaQuadOffsets);
+				__m128i beta0Vec = _mm_add_epi32(_mm_set1_epi32(blockBeta + (quadXMin - blockX)*betaXdecr + (quadYMin - blockY)*betaYdecr), betaQuadOffsets);
+				__m128i gamma0Vec = _mm_add_epi32(_mm_set1_epi32(blockGamma + (quadXMin - blockX)*gammaXdecr + (quadYMin - blockY)*gammaYdecr), gammaQuadOffsets);
+
+				for (int32_t y = quadYMin; y < blockYMax; y += 2,
+											 alpha0Vec = _mm_add_epi32(alpha0Vec, alphaYdecrVec),
+											 beta0Vec = _mm_add_epi32(beta0Vec, betaYdecrVec),
+											 gamma0Vec = _mm_add_epi32(gamma0Vec, gammaYdecrVec)) {
+
+					__m128i alpha = alpha0Vec;
+					__m128i beta = beta0Vec;
+					__m128i gamma = gamma0Vec;
+
+					for (int32_t x = quadXMin; x < blockXMax; x += 2,
+												 alpha = _mm_add_epi32(alpha, alphaXdecrVec),
+												 beta = _mm_add_epi32(beta, betaXdecrVec),
+												 gamma = _mm_add_epi32(gamma, gammaXdecrVec)) {
+
+						// for each 32-bit integer : 0xFFFFFFFF if test failed (mask < 0), 0 otherwise.
+						__m128i compInside = inverseTest;
+						if (!blockCovered) {
+							const __m128i mask = _mm_or_si128(_mm_or_si128(_mm_add_epi32(alpha, alphaBiasVec), _mm_add_epi32(beta, betaBiasVec)),
+															  _mm_add_epi32(gamma, gammaBiasVec));
+							compInside = _mm_cmplt_epi32(mask, inverseTest);
+							//create mask with the most significant bit of all 8-bit integers packed in argument
+							const int test = _mm_movemask_epi8(compInside);
+
+							if (test == 0xFFFF)//all failed?
+								continue;
+						}
+
+						const int32_t x0 = x + 1;
+						const int32_t y0 = y + 1;
+						const int32_t x1 = x;
+						const int32_t y1 = y0;
+						const int32_t x2 = x0;
+						const int32_t y2 = y;
+						const int32_t x3 = x;
+						const int32_t y3 = y;
+																		
+						const __m128i xPositionsVec = _mm_set_epi32(x3, x2, x1, x0);
+						const __m128i yPositionsVec = _mm_set_epi32(y3, y2, y1, y0);
+
+						// for each x,y coordinate : 0xFFFFFFFF if inside the scissor rectangle (xMin <= x < xMax && yMin <= y < yMax), 0 otherwise.
+						const __m128i boundMask =
+							_mm_and_si128(
+								_mm_and_si128(
+									_mm_cmplt_epi32(xPositionsVec, xMaxBoundMask),
+									_mm_cmplt_epi32(yPositionsVec, yMaxBoundMask)),
+								_mm_and_si128(
+									_mm_cmpgt_epi32(xPositionsVec, xMinBoundMask),
+									_mm_cmpgt_epi32(yPositionsVec, yMinBoundMask)));
+
+						//since compInside == 0 means success, then write pixel iff ((~compInside == 0xFFFFFFFF) & boundMask ) == 0xFFFFFFFF
+						__m128i comp = _mm_andnot_si128(compInside, boundMask);
+
+						const __m128 a = fixedToFloat<4>(alpha);
+						const __m128 b = fixedToFloat<4>(beta);
+						const __m128 c = fixedToFloat<4>(gamma);
+
+						const __m128 depthV0 = _mm_mul_ps(v0Z, a);
+						const __m128 depthV1 = _mm_mul_ps(v1Z, b);
+						const __m128 depthV2 = _mm_mul_ps(v2Z, c);
+						const __m128 depth = _mm_div_ps(_mm_add_ps(_mm_add_ps(depthV0, depthV1), depthV2), twiceArea);
+
+						const int32_t xPositions[4]{ x0, x1, x2, x3	};
+						const int32_t yPositions[4]{ y0, y1, y2, y3	};
+						const int32_t depthTestRes = ::depthTest(depthBuffer(), yPositions, xPositions, depth, comp);
+
+						if (depthTestRes == 0x0)//all failed?
+							continue;
+						blockWritten = true;
+
+						if (visibilityBuffer() != nullptr) {
+							//the pixels are shaded later (see Renderer::resolveVisibility), only the triangle is written
+							for (unsigned int k = 0; k < 4; k++) {
+								if ((depthTestRes & (1 << k)) != 0)
+									writeVisibility(static_cast<unsigned int>(yPositions[k]), static_cast<unsigned int>(xPositions[k]), static_cast<uint32_t>(i));
+							}
+							continue;
+						}
+
+						if (batched) {
+							batchQuad(batch, i, position, x, y, depthTestRes, group);
+							continue;
+						}
+
+						//offset of the quad's top-left pixel from the planes' origin
+						const float quadX = static_cast<float>(x - t.planeX);
+						const float quadY = static_cast<float>(y - t.planeY);
+						const __m128 quadXVec = _mm_set_ps1(quadX);
+						const __m128 quadYVec = _mm_set_ps1(quadY);
+
+						const __m128 q = _mm_add_ps(_mm_set_ps1(planes[0] + planes[1] * quadX + planes[2] * quadY), qQuadOffsets);
+						const __m128 invQ = _mm_rcp_ps(q);
+
+						//splat the values of each pixel
+						const __m128 invQ0 = _mm_shuffle_ps(invQ, invQ, _MM_SHUFFLE(0, 0, 0, 0));
+						const __m128 invQ1 = _mm_shuffle_ps(invQ, invQ, _MM_SHUFFLE(1, 1, 1, 1));
+						const __m128 invQ2 = _mm_shuffle_ps(invQ, invQ, _MM_SHUFFLE(2, 2, 2, 2));
+						const __m128 invQ3 = _mm_shuffle_ps(invQ, invQ, _MM_SHUFFLE(3, 3, 3, 3));
+
+						//interpolate vertices, 4 floats at the time, evaluating the plane equations (see setupAttributePlanes)
+						for (size_t c = 0; c < m_paddedAttributeCount; c += 4) {
+							const __m128 xDerivative = _mm_loadu_ps(xDerivatives + c);
+							const __m128 yDerivative = _mm_loadu_ps(yDerivatives + c);
+							const __m128 value3 = _mm_add_ps(_mm_loadu_ps(values + c), 
+															 _mm_add_ps(_mm_mul_ps(xDerivative, quadXVec), _mm_mul_ps(yDerivative, quadYVec)));
+							const __m128 value2 = _mm_add_ps(value3, xDerivative);
+							const __m128 value1 = _mm_add_ps(value3, yDerivative);
+							const __m128 value0 = _mm_add_ps(value2, yDerivative);
+
+							_mm_store_ps(quadAttributes[0] + c, _mm_mul_ps(value0, invQ0));
+							_mm_store_ps(quadAttributes[1] + c, _mm_mul_ps(value1, invQ1));
+							_mm_store_ps(quadAttributes[2] + c, _mm_mul_ps(value2, invQ2));
+							_mm_store_ps(quadAttributes[3] + c, _mm_mul_ps(value3, invQ3));
+						}
+
+						//execute pixel shader
+						const PixelShader& ps = *pixelShader();
+						execContext.mask = depthTestRes;
+										
+						Math::Vector4 outColors[4];
+						ps(*group.shaderContext, execContext, group.instance, outColors);
+
+						//write pixels that are found to be inside and passed the depth test
+						if ((depthTestRes & 0x1) != 0)
+							writePixel(static_cast<unsigned int>(yPositions[0]), static_cast<unsigned int>(xPositions[0]), outColors[0]);
+						if ((depthTestRes & 0x2) != 0)
+							writePixel(static_cast<unsigned int>(yPositions[1]), static_cast<unsigned int>(xPositions[1]), outColors[1]);
+						if ((depthTestRes & 0x4) != 0)
+							writePixel(static_cast<unsigned int>(yPositions[2]), static_cast<unsigned int>(xPositions[2]), outColors[2]);
+						if ((depthTestRes & 0x8) != 0)
+							writePixel(static_cast<unsigned int>(yPositions[3]), static_cast<unsigned int>(xPositions[3]), outColors[3]);
+					}
+				}
 
-				const __m128 onWSumInv = _mm_rcp_ps(_mm_add_ps(_mm_add_ps(alphaOnW0, betaOnW1), gammaOnW2));
+				//depth values have been lowered, so may have been the block's maximum
+				if (blockWritten) {
+					depthBuffer()->updateBlockMaxDepth(blockI, blockJ);
+					binWritten = true;
+				}
+			}
+		}
+	}
 
-				const __m128 splatOnW00 = _mm_set_ps1(alphaOnW0.m128_f32[0]);
-				const __m128 splatOnW01 = _mm_set_ps1(alphaOnW0.m128_f32[1]);
-				const __m128 splatOnW02 = _mm_set_ps1(alphaOnW0.m128_f32[2]);
-				const __m128 splatOnW03 = _mm_set_ps1(alphaOnW0.m128_f32[3]);
+	shadeQuadBatch(batch);
 
-				const __m128 splatOnW10 = _mm_set_ps1(betaOnW1.m128_f32[0]);
-				const __m128 splatOnW11 = _mm_set_ps1(betaOnW1.m128_f32[1]);
-				const __m128 splatOnW12 = _mm_set_ps1(betaOnW1.m128_f32[2]);
-				const __m128 splatOnW13 = _mm_set_ps1(betaOnW1.m128_f32[3]);
+	if (binWritten)
+		depthBuffer()->updateTileMaxDepth(tileI, tileJ);
+}
 
-				const __m128 splatOnW20 = _mm_set_ps1(gammaOnW2.m128_f32[0]);
-				const __m128 splatOnW21 = _mm_set_ps1(gammaOnW2.m128_f32[1]);
-				const __m128 splatOnW22 = _mm_set_ps1(gammaOnW2.m128_f32[2]);
-				const __m128 splatOnW23 = _mm_set_ps1(gammaOnW2.m128_f32[3]);
+/*helper functions forward declarations*/
+SOFTRP_TARGET_AVX2
+inline static int32_t depthTest(DepthBuffer* depthBuffer, int32_t i, int32_t j, const __m256 compare, const __m256i mask);
 
-				const __m256 splatOnW0_01 = _mm256_set_m128(splatOnW00, splatOnW01);
-				const __m256 splatOnW0_23 = _mm256_set_m128(splatOnW02, splatOnW03);
-				const __m256 splatOnW1_01 = _mm256_set_m128(splatOnW10, splatOnW11);
-				const __m256 splatOnW1_23 = _mm256_set_m128(splatOnW12, splatOnW13);
-				const __m256 splatOnW2_01 = _mm256_set_m128(splatOnW20, splatOnW21);
-				const __m256 splatOnW2_23 = _mm256_set_m128(splatOnW22, splatOnW23);
+template<int32_t fractionalSize>
+SOFTRP_TARGET_AVX2 static __m256 fixedToFloat(__m256i fixed);
+template<>
+SOFTRP_TARGET_AVX2 __m256 fixedToFloat<4>(__m256i fixed);
+
+/*
+AVX2 implementation: pixels are processed 8 at the time, in blocks of 4x2 pixels made of two adjacent 2x2 blocks (quads).
+The 8 lanes of the vectors follow the memory layout of the block: lanes 0-3 are the pixels (x, y)...(x + 3, y),
+lanes 4-7 are the pixels (x, y + 1)...(x + 3, y + 1). This allows to load and store the depth buffer with masked
+moves. The pixel shader still executes a quad at the time, so the lanes are mapped to the quads' pixels when
+interpolating the vertices and writing the pixels.
+*/
+SOFTRP_TARGET_AVX2
+void SoftRP::BinRasterizer::rasterizeBinAVX2(Bin& bin, const std::vector<Vertex>* vertices) {
+
+	//the implementation follows the non-SIMD version. refer to it for details.
+
+	static_assert((TILE_WIDTH % 4 == 0) && (TILE_HEIGHT % 2 == 0), "Invalid tile size, it must be a multiple of 4x2.");
 
-				const __m128 onWSumInv0 = _mm_set_ps1(onWSumInv.m128_f32[0]);
-				const __m128 onWSumInv1 = _mm_set_ps1(onWSumInv.m128_f32[1]);
-				const __m128 onWSumInv2 = _mm_set_ps1(onWSumInv.m128_f32[2]);
-				const __m128 onWSumInv3 = _mm_set_ps1(onWSumInv.m128_f32[3]);
+	//execution contexts of the left and right quads
+	PSExecutionContext execContexts[2]{};
 
-				const __m256 doubledOnWSumInv01 = _mm256_set_m128(onWSumInv0, onWSumInv1);
-				const __m256 doubledOnWSumInv23 = _mm256_set_m128(onWSumInv2, onWSumInv3);
+	/*
+	vertex interpolated for each lane. 
+	in a quad, the pixels are ordered as (x + 1, y + 1), (x, y + 1), (x + 1, y), (x, y)
+	*/
+	Vertex* const laneInterpolated[8]{
+		&execContexts[0].interpolated[3], &execContexts[0].interpolated[2],
+		&execContexts[1].interpolated[3], &execContexts[1].interpolated[2],
+		&execContexts[0].interpolated[1], &execContexts[0].interpolated[0],
+		&execContexts[1].interpolated[1], &execContexts[1].interpolated[0]
+	};
+
+	//attributes of the vertex interpolated for each lane, in the bin's storage
+	VertexLayout* vertexLayout = &(*vertices)[0].vertexLayout();
+	const size_t slotSize = 4 + m_paddedAttributeCount;
+	const bool batched = pixelShader()->batched();
+	float* interpolationData = bin.interpolationData(8 * slotSize + (batched ? quadBatchStorageSize() : 0));
+	float* laneAttributes[8];
+	for (unsigned int l = 0; l < 8; l++) {
+		laneInterpolated[l]->setVertexData(interpolationData + l*slotSize, vertexLayout);
+		laneAttributes[l] = interpolationData + l*slotSize + 4;
+	}
+	QuadBatch batch;
+	initQuadBatch(batch, interpolationData + 8 * slotSize, vertexLayout);
+
+	const int32_t xMin = bin.xMin;
+	const int32_t xMax = bin.xMax;
+	const int32_t yMin = bin.yMin;
+	const int32_t yMax = bin.yMax;
 
-				const size_t fieldCount = vertexData1.fieldCount();
+	static_assert((BLOCK_WIDTH % 4 == 0) && (BLOCK_HEIGHT % 2 == 0), "Invalid block size, it must be a multiple of 4x2.");
+	static_assert((TILE_WIDTH % BLOCK_WIDTH == 0) && (TILE_HEIGHT % BLOCK_HEIGHT == 0), "Invalid block size, it must divide the tile size.");
+	const int32_t blockWidth = static_cast<int32_t>(BLOCK_WIDTH);
+	const int32_t blockHeight = static_cast<int32_t>(BLOCK_HEIGHT);
+
+	const unsigned int tileI = static_cast<unsigned int>(yMin) / TILE_HEIGHT;
+	const unsigned int tileJ = static_cast<unsigned int>(xMin) / TILE_WIDTH;
+	bool binWritten = false;
+
+	const __m256i xMinBoundMask = _mm256_set1_epi32(m_scissorXMin - 1);
+	const __m256i yMinBoundMask = _mm256_set1_epi32(m_scissorYMin - 1);
+	const __m256i xMaxBoundMask = _mm256_set1_epi32(m_scissorXMax);
+	const __m256i yMaxBoundMask = _mm256_set1_epi32(m_scissorYMax);
+
+	//offsets of the lanes' pixels with respect to the top-left pixel of the 4x2 block
+	const __m256i laneXOffsets = _mm256_set_epi32(3, 2, 1, 0, 3, 2, 1, 0);
+	const __m256i laneYOffsets = _mm256_set_epi32(1, 1, 1, 1, 0, 0, 0, 0);
+
+	//indices used to broadcast the values of a pair of lanes to the two halves of a vector
+	const __m256i pairPermutations[4]{
+		_mm256_set_epi32(1, 1, 1, 1, 0, 0, 0, 0),
+		_mm256_set_epi32(3, 3, 3, 3, 2, 2, 2, 2),
+		_mm256_set_epi32(5, 5, 5, 5, 4, 4, 4, 4),
+		_mm256_set_epi32(7, 7, 7, 7, 6, 6, 6, 6)
+	};
+	//x offsets of a pair of lanes, each broadcast to an half of a vector. pairs 0 and 2 are the left ones
+	const __m256 pairXOffsets[2]{
+		_mm256_set_ps(1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		_mm256_set_ps(3.0f, 3.0f, 3.0f, 3.0f, 2.0f, 2.0f, 2.0f, 2.0f)
+	};
+	const __m256 laneXOffsetsPS = _mm256_cvtepi32_ps(laneXOffsets);
+	const __m256 laneYOffsetsPS = _mm256_cvtepi32_ps(laneYOffsets);
+
+	const __m256i inverseTest = _mm256_setzero_si256();
 
-				//interpolate vertices, excluding position
-				for (size_t f = 1; f < fieldCount; f++) {
-					const float* field1 = vertexData1.getField(f);
-					const float* field2 = vertexData2.getField(f);
-					const float* field3 = vertexData3.getField(f);
+	while (bin.hasNext()) {
 
-					const __m128 field1Vec = _mm_load_ps(field1);
-					const __m128 field2Vec = _mm_load_ps(field2);
-					const __m128 field3Vec = _mm_load_ps(field3);
+		size_t i = bin.getNext();
+		const Triangle& t = m_triangles[i];
+		const TriangleGroup& group = triangleGroup(i);
 
-					//process 2 adjacent pixels at the time
-					const __m256 doubledField1 = _mm256_set_m128(field1Vec, field1Vec);
-					const __m256 doubledField2 = _mm256_set_m128(field2Vec, field2Vec);
-					const __m256 doubledField3 = _mm256_set_m128(field3Vec, field3Vec);
+		const TransformedVertex& v0 = m_transformedVertices[t.i0];
+		const TransformedVertex& v1 = m_transformedVertices[t.i1];
+		const TransformedVertex& v2 = m_transformedVertices[t.i2];
 
-					__m256 scale1 = _mm256_mul_ps(doubledField1, splatOnW0_01);
-					__m256 scale2 = _mm256_mul_ps(doubledField2, splatOnW1_01);
-					__m256 scale3 = _mm256_mul_ps(doubledField3, splatOnW2_01);
+		const int32_t walkXMin = xMin + (std::max(t.xMin - xMin, 0) / blockWidth)*blockWidth;
+		const int32_t walkYMin = yMin + (std::max(t.yMin - yMin, 0) / blockHeight)*blockHeight;
+		const int32_t walkXMax = std::min(xMax, t.xMax + 1);
+		const int32_t walkYMax = std::min(yMax, t.yMax + 1);
+		const int32_t fixedXMin = (walkXMin - m_originX) << 4;
+		const int32_t fixedYMin = (walkYMin - m_originY) << 4;
+		int32_t alpha0 = t.alpha0 + fixedXMin*t.alphaXdecr + fixedYMin*t.alphaYdecr;
+		int32_t beta0 = t.beta0 + t.betaXdecr*fixedXMin + t.betaYdecr*fixedYMin;
+		int32_t gamma0 = t.gamma0 + t.gammaXdecr*fixedXMin + t.gammaYdecr*fixedYMin;
 
-					scale1 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(scale1, scale2), scale3), doubledOnWSumInv01);
+		const int32_t alphaXdecr = t.alphaXdecr << 4;
+		const int32_t alphaYdecr = t.alphaYdecr << 4;
+		const int32_t betaXdecr = t.betaXdecr << 4;
+		const int32_t betaYdecr = t.betaYdecr << 4;
+		const int32_t gammaXdecr = t.gammaXdecr << 4;
+		const int32_t gammaYdecr = t.gammaYdecr << 4;
 
-					float* target0 = interpolated0.getField(f);
-					float* target1 = interpolated1.getField(f);
-					_mm256_storeu2_m128(target1, target0, scale1);
+		const __m256i alphaBiasVec = _mm256_set1_epi32(t.alphaBias);
+		const __m256i betaBiasVec = _mm256_set1_epi32(t.betaBias);
+		const __m256i gammaBiasVec = _mm256_set1_epi32(t.gammaBias);
+
+		//offsets of the edge functions of the lanes' pixels with respect to the top-left pixel of the 4x2 block
+		const __m256i alphaLaneOffsets = _mm256_add_epi32(_mm256_mullo_epi32(laneXOffsets, _mm256_set1_epi32(alphaXdecr)),
+														  _mm256_mullo_epi32(laneYOffsets, _mm256_set1_epi32(alphaYdecr)));
+		const __m256i betaLaneOffsets = _mm256_add_epi32(_mm256_mullo_epi32(laneXOffsets, _mm256_set1_epi32(betaXdecr)),
+														 _mm256_mullo_epi32(laneYOffsets, _mm256_set1_epi32(betaYdecr)));
+		const __m256i gammaLaneOffsets = _mm256_add_epi32(_mm256_mullo_epi32(laneXOffsets, _mm256_set1_epi32(gammaXdecr)),
+														  _mm256_mullo_epi32(laneYOffsets, _mm256_set1_epi32(gammaYdecr)));
+
+		//decrements for movements 4 pixels wide and 2 pixels high
+		const __m256i alphaXdecrVec = _mm256_set1_epi32(alphaXdecr << 2);
+		const __m256i alphaYdecrVec = _mm256_set1_epi32(alphaYdecr << 1);
+		const __m256i betaXdecrVec = _mm256_set1_epi32(betaXdecr << 2);
+		const __m256i betaYdecrVec = _mm256_set1_epi32(betaYdecr << 1);
+		const __m256i gammaXdecrVec = _mm256_set1_epi32(gammaXdecr << 2);
+		const __m256i gammaYdecrVec = _mm256_set1_epi32(gammaYdecr << 1);
+
+		const __m256 twiceArea = _mm256_set1_ps(t.twiceArea);
+
+		const __m256 v0Z = _mm256_set1_ps(v0.position[2]);
+		const __m256 v1Z = _mm256_set1_ps(v1.position[2]);
+		const __m256 v2Z = _mm256_set1_ps(v2.position[2]);
+		const float* planes = &m_attributePlanes[i*m_planeStride];
+		const float* values = planes + 4;
+		const float* xDerivatives = values + m_paddedAttributeCount;
+		const float* yDerivatives = xDerivatives + m_paddedAttributeCount;
+		const __m256 qValue = _mm256_set1_ps(planes[0]);
+		const __m256 qXDerivative = _mm256_set1_ps(planes[1]);
+		const __m256 qYDerivative = _mm256_set1_ps(planes[2]);
+
+		const Math::Vector4& position = (*vertices)[t.i0].position();
+		for (unsigned int l = 0; l < 8; l++)
+			laneInterpolated[l]->position() = position;
+
+		const int32_t blockAlphaXdecr = alphaXdecr * blockWidth;
+		const int32_t blockAlphaYdecr = alphaYdecr * blockHeight;
+		const int32_t blockBetaXdecr = betaXdecr * blockWidth;
+		const int32_t blockBetaYdecr = betaYdecr * blockHeight;
+		const int32_t blockGammaXdecr = gammaXdecr * blockWidth;
+		const int32_t blockGammaYdecr = gammaYdecr * blockHeight;
+
+		int32_t alphaBlockMin = 0;
+		int32_t alphaBlockMax = 0;
+		int32_t betaBlockMin = 0;
+		int32_t betaBlockMax = 0;
+		int32_t gammaBlockMin = 0;
+		int32_t gammaBlockMax = 0;
+		if (!t.small) {
+			alphaBlockMin = blockExtent(alphaXdecr, alphaYdecr, blockWidth, blockHeight, false) + t.alphaBias;
+			alphaBlockMax = blockExtent(alphaXdecr, alphaYdecr, blockWidth, blockHeight, true) + t.alphaBias;
+			betaBlockMin = blockExtent(betaXdecr, betaYdecr, blockWidth, blockHeight, false) + t.betaBias;
+			betaBlockMax = blockExtent(betaXdecr, betaYdecr, blockWidth, blockHeight, true) + t.betaBias;
+			gammaBlockMin = blockExtent(gammaXdecr, gammaYdecr, blockWidth, blockHeight, false) + t.gammaBias;
+			gammaBlockMax = blockExtent(gammaXdecr, gammaYdecr, blockWidth, blockHeight, true) + t.gammaBias;
+		}
 
-					scale1 = _mm256_mul_ps(doubledField1, splatOnW0_23);
-					scale2 = _mm256_mul_ps(doubledField2, splatOnW1_23);
-					scale3 = _mm256_mul_ps(doubledField3, splatOnW2_23);
+		for (int32_t blockY = walkYMin; blockY < walkYMax; blockY += blockHeight,
+												   alpha0 += blockAlphaYdecr,
+												   beta0 += blockBetaYdecr,
+												   gamma0 += blockGammaYdecr) {
 
-					scale1 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(scale1, scale2), scale3), doubledOnWSumInv23);
+			const int32_t blockYMax = std::min(blockY + blockHeight, walkYMax);
 
-					float* target2 = interpolated2.getField(f);
-					float* target3 = interpolated3.getField(f);
-					_mm256_storeu2_m128(target3, target2, scale1);
+			int32_t blockAlpha = alpha0;
+			int32_t blockBeta = beta0;
+			int32_t blockGamma = gamma0;
+
+			for (int32_t blockX = walkXMin; blockX < walkXMax; blockX += blockWidth,
+													   blockAlpha += blockAlphaXdecr,
+													   blockBeta += blockBetaXdecr,
+													   blockGamma += blockGammaXdecr) {
+
+				if (!t.small && ((blockAlpha + alphaBlockMax) | (blockBeta + betaBlockMax) | (blockGamma + gammaBlockMax)) < 0)
+					continue;
+
+				//the block is occluded if the triangle's minimum depth is not less than the block's maximum one
+				const unsigned int blockI = static_cast<unsigned int>(blockY) / BLOCK_HEIGHT;
+				const unsigned int blockJ = static_cast<unsigned int>(blockX) / BLOCK_WIDTH;
+				if (t.minDepth >= depthBuffer()->blockMaxDepth(blockI, blockJ))
+					continue;
+
+				const bool blockCovered = !t.small && ((blockAlpha + alphaBlockMin) | (blockBeta + betaBlockMin) | (blockGamma + gammaBlockMin)) >= 0;
+
+				const int32_t blockXMax = std::min(blockX + blockWidth, walkXMax);
+				bool blockWritten = false;
+
+				const int32_t quadXMin = std::max(blockX, t.xMin & ~3);
+				const int32_t quadYMin = std::max(blockY, t.yMin & ~1);
+				__m256i alpha0Vec = _mm256_add_epi32(_mm256_set1_epi32(blockAlpha + (quadXMin - blockX)*alphaXdecr + (quadYMin - blockY)*alphaYdecr), alphaLaneOffsets);
+				__m256i beta0Vec = _mm256_add_epi32(_mm256_set1_epi32(blockBeta + (quadXMin - blockX)*betaXdecr + (quadYMin - blockY)*betaYdecr), betaLaneOffsets);
+				__m256i gamma0Vec = _mm256_add_epi32(_mm256_set1_epi32(blockGamma + (quadXMin - blockX)*gammaXdecr + (quadYMin - blockY)*gammaYdecr), gammaLaneOffsets);
+
+				for (int32_t y = quadYMin; y < blockYMax; y += 2,
+											 alpha0Vec = _mm256_add_epi32(alpha0Vec, alphaYdecrVec),
+											 beta0Vec = _mm256_add_epi32(beta0Vec, betaYdecrVec),
+											 gamma0Vec = _mm256_add_epi32(gamma0Vec, gammaYdecrVec)) {
+
+					__m256i alpha = alpha0Vec;
+					__m256i beta = beta0Vec;
+					__m256i gamma = gamma0Vec;
+
+					const __m256i yPositionsVec = _mm256_add_epi32(_mm256_set1_epi32(y), laneYOffsets);
+					const __m256i yBoundMask = _mm256_and_si256(_mm256_cmpgt_epi32(yMaxBoundMask, yPositionsVec),
+																 _mm256_cmpgt_epi32(yPositionsVec, yMinBoundMask));
+
+					for (int32_t x = quadXMin; x < blockXMax; x += 4,
+												 alpha = _mm256_add_epi32(alpha, alphaXdecrVec),
+												 beta = _mm256_add_epi32(beta, betaXdecrVec),
+												 gamma = _mm256_add_epi32(gamma, gammaXdecrVec)) {
+
+						// for each 32-bit integer : 0xFFFFFFFF if test failed (mask < 0), 0 otherwise.
+						__m256i compInside = inverseTest;
+						if (!blockCovered) {
+							const __m256i mask = _mm256_or_si256(_mm256_or_si256(_mm256_add_epi32(alpha, alphaBiasVec), _mm256_add_epi32(beta, betaBiasVec)),
+																 _mm256_add_epi32(gamma, gammaBiasVec));
+							compInside = _mm256_cmpgt_epi32(inverseTest, mask);
+							if (_mm256_movemask_epi8(compInside) == -1)//all failed?
+								continue;
+						}
+
+						// for each x,y coordinate : 0xFFFFFFFF if inside the scissor rectangle, 0 otherwise.
+						const __m256i xPositionsVec = _mm256_add_epi32(_mm256_set1_epi32(x), laneXOffsets);
+						const __m256i xBoundMask = _mm256_and_si256(_mm256_cmpgt_epi32(xMaxBoundMask, xPositionsVec),
+																	_mm256_cmpgt_epi32(xPositionsVec, xMinBoundMask));
+						const __m256i boundMask = _mm256_and_si256(xBoundMask, yBoundMask);
+
+						const __m256i comp = _mm256_andnot_si256(compInside, boundMask);
+
+						const __m256 a = fixedToFloat<4>(alpha);
+						const __m256 b = fixedToFloat<4>(beta);
+						const __m256 c = fixedToFloat<4>(gamma);
+
+						const __m256 depthV0 = _mm256_mul_ps(v0Z, a);
+						const __m256 depthV1 = _mm256_mul_ps(v1Z, b);
+						const __m256 depthV2 = _mm256_mul_ps(v2Z, c);
+						const __m256 depth = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(depthV0, depthV1), depthV2), twiceArea);
+
+						const int32_t depthTestRes = ::depthTest(depthBuffer(), y, x, depth, comp);
+
+						if (depthTestRes == 0x0)//all failed?
+							continue;
+						blockWritten = true;
+
+						if (visibilityBuffer() != nullptr) {
+							//the pixels are shaded later (see Renderer::resolveVisibility), only the triangle is written
+							for (int32_t l = 0; l < 8; l++) {
+								if ((depthTestRes & (1 << l)) != 0)
+									writeVisibility(static_cast<unsigned int>(y + l / 4), static_cast<unsigned int>(x + l % 4), static_cast<uint32_t>(i));
+							}
+							continue;
+						}
+
+						//masks of the left and right quads, whose pixels are ordered as in PSExecutionContext
+						int32_t quadMasks[2];
+						for (int32_t q = 0; q < 2; q++) {
+							//lanes of the top-left pixel of the quad in the two rows
+							const int32_t lane = 2 * q;
+							quadMasks[q] = ((depthTestRes >> (lane + 5)) & 0x1) |
+										   (((depthTestRes >> (lane + 4)) & 0x1) << 1) |
+										   (((depthTestRes >> (lane + 1)) & 0x1) << 2) |
+										   (((depthTestRes >> lane) & 0x1) << 3);
+						}
+
+						if (batched) {
+							for (int32_t q = 0; q < 2; q++) {
+								if (quadMasks[q] != 0)
+									batchQuad(batch, i, position, x + 2 * q, y, quadMasks[q], group);
+							}
+							continue;
+						}
+
+						//offset of the block's top-left pixel from the planes' origin
+						const __m256 blockXVec = _mm256_set1_ps(static_cast<float>(x - t.planeX));
+						const __m256 blockYVec = _mm256_set1_ps(static_cast<float>(y - t.planeY));
+
+						const __m256 q = _mm256_fmadd_ps(qYDerivative, _mm256_add_ps(blockYVec, laneYOffsetsPS),
+														 _mm256_fmadd_ps(qXDerivative, _mm256_add_ps(blockXVec, laneXOffsetsPS), qValue));
+						const __m256 invQ = _mm256_rcp_ps(q);
+
+						//1/q of a pair of lanes, each broadcast to an half of the vector
+						__m256 pairInvQ[4];
+						for (unsigned int p = 0; p < 4; p++)
+							pairInvQ[p] = _mm256_permutevar8x32_ps(invQ, pairPermutations[p]);
+
+						/*
+						interpolate vertices, 4 floats for two lanes at the time, evaluating the plane 
+						equations (see setupAttributePlanes)
+						*/
+						for (size_t c = 0; c < m_paddedAttributeCount; c += 4) {
+
+							const __m256 xDerivative = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(xDerivatives + c));
+							const __m256 yDerivative = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(yDerivatives + c));
+							const __m256 value = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(values + c));
+
+							//values at the first pixel of the top and bottom rows
+							const __m256 topValue = _mm256_fmadd_ps(yDerivative, blockYVec, _mm256_fmadd_ps(xDerivative, blockXVec, value));
+							const __m256 bottomValue = _mm256_add_ps(topValue, yDerivative);
+
+							for (unsigned int p = 0; p < 4; p++) {
+								const __m256 field = _mm256_mul_ps(_mm256_fmadd_ps(xDerivative, pairXOffsets[p % 2], p < 2 ? topValue : bottomValue), 
+																   pairInvQ[p]);
+								_mm256_storeu2_m128(laneAttributes[2 * p + 1] + c, laneAttributes[2 * p] + c, field);
+							}
+						}
+
+						//execute pixel shader on the quads with pixels that are found to be inside and passed the depth test
+						const PixelShader& ps = *pixelShader();
+
+						for (int32_t q = 0; q < 2; q++) {
+
+							const int32_t quadMask = quadMasks[q];
+							if (quadMask == 0)
+								continue;
+
+							PSExecutionContext& execContext = execContexts[q];
+							execContext.mask = quadMask;
+
+							Math::Vector4 outColors[4];
+							ps(*group.shaderContext, execContext, group.instance, outColors);
+
+							const unsigned int x0 = static_cast<unsigned int>(x + 2 * q);
+							const unsigned int y0 = static_cast<unsigned int>(y);
+
+							if ((quadMask & 0x1) != 0)
+								writePixel(y0 + 1, x0 + 1, outColors[0]);
+							if ((quadMask & 0x2) != 0)
+								writePixel(y0 + 1, x0, outColors[1]);
+							if ((quadMask & 0x4) != 0)
+								writePixel(y0, x0 + 1, outColors[2]);
+							if ((quadMask & 0x8) != 0)
+								writePixel(y0, x0, outColors[3]);
+						}
+					}
 				}
 
-				//execute pixel shader
-				const PixelShader& ps = *pixelShader();
-				execContext.mask = depthTestRes;
-								
-				Math::Vector4 outColors[4];
-				ps(*shaderContext(), execContext, instance, outColors);
-
-				//write pixels that are found to be inside and passed the depth test
-				if ((depthTestRes & 0x1) != 0)
-					writePixel(static_cast<unsigned int>(yPositions[0]), static_cast<unsigned int>(xPositions[0]), outColors[0]);
-				if ((depthTestRes & 0x2) != 0)
-					writePixel(static_cast<unsigned int>(yPositions[1]), static_cast<unsigned int>(xPositions[1]), outColors[1]);
-				if ((depthTestRes & 0x4) != 0)
-					writePixel(static_cast<unsigned int>(yPositions[2]), static_cast<unsigned int>(xPositions[2]), outColors[2]);
-				if ((depthTestRes & 0x8) != 0)
-					writePixel(static_cast<unsigned int>(yPositions[3]), static_cast<unsigned int>(xPositions[3]), outColors[3]);
+				//depth values have been lowered, so may have been the block's maximum
+				if (blockWritten) {
+					depthBuffer()->updateBlockMaxDepth(blockI, blockJ);
+					binWritten = true;
+				}
 			}
 		}
 	}
-}
-#endif
-
-inline static bool intersectAABB(int32_t xMin1, int32_t xMax1, int32_t yMin1, int32_t yMax1, int32_t xMin2, int32_t xMax2, int32_t yMin2, int32_t yMax2) {
-	if (xMin2 > xMax1)
-		return false;
 
-	if (xMin1 > xMax2)
-		return false;
+	shadeQuadBatch(batch);
 
-	if (yMin2 > yMax1)
-		return false;
-
-	if (yMin1 > yMax2)
-		return false;
+	if (binWritten)
+		depthBuffer()->updateTileMaxDepth(tileI, tileJ);
+}
+#endif
 
-	return true;
+/*
+Returns the minimum (or maximum, if requested) increment of an edge function over a block of blockWidth x blockHeight pixels,
+with respect to its value at the top-left pixel of the block. xDecr and yDecr are the edge function's decrements for a movement
+of 1 pixel.
+*/
+inline static int32_t blockExtent(int32_t xDecr, int32_t yDecr, int32_t blockWidth, int32_t blockHeight, bool maximum) {
+	const int32_t xExtent = xDecr * (blockWidth - 1);
+	const int32_t yExtent = yDecr * (blockHeight - 1);
+	if (maximum)
+		return std::max(xExtent, 0) + std::max(yExtent, 0);
+	return std::min(xExtent, 0) + std::min(yExtent, 0);
 }
 
 template<int32_t fractionalSize>
 inline static int32_t fixedFromFloat(float x) {
-	throw std::runtime_error{ "Missing implementation" }:
+	throw std::runtime_error{ "Missing implementation" };
 }
 
 inline static int iRound(float x) {
@@ -803,17 +1750,17 @@ inline static int iRound(float x) {
 }
 
 template<>
-inline static int32_t fixedFromFloat<4>(float x) {
+inline int32_t fixedFromFloat<4>(float x) {
 	return iRound(x * 16.0f);
 }
 
 template<int32_t fractionalSize>
 inline static float fixedToFloat(int32_t fixed) {
-	throw std::runtime_error{ "Missing implementation" }:
+	throw std::runtime_error{ "Missing implementation" };
 }
 
 template<>
-inline static float fixedToFloat<4>(int32_t fixed) {
+inline float fixedToFloat<4>(int32_t fixed) {
 	int32_t integralPart = fixed >> 4;
 	fixed &= 0x0000000F;
 	return static_cast<float>(integralPart) + (static_cast<float>(fixed) / 16.0f);
@@ -822,13 +1769,13 @@ inline static float fixedToFloat<4>(int32_t fixed) {
 #ifdef SOFTRP_USE_SIMD
 template<int32_t fractionalSize>
 inline static __m128 fixedToFloat(__m128i fixed) {
-	throw std::runtime_error{ "Missing implementation" }:
+	throw std::runtime_error{ "Missing implementation" };
 }
 
 template<>
-inline static __m128 fixedToFloat<4>(__m128i fixed) {
-	const __m128i integralPart = _mm_set_epi32(fixed.m128i_i32[3] >> 4, fixed.m128i_i32[2] >> 4, fixed.m128i_i32[1] >> 4, fixed.m128i_i32[0] >> 4);
-	//const __m128i integralPart = _mm_srli_epi32(fixed, 4); Can't understand why this line is not equivalent to the one above.
+inline __m128 fixedToFloat<4>(__m128i fixed) {
+	//arithmetic shift, to preserve the sign as the scalar version does
+	const __m128i integralPart = _mm_srai_epi32(fixed, 4);
 	const __m128i fractionalMask = _mm_set1_epi32(0x0000000F);
 	fixed = _mm_and_si128(fixed, fractionalMask);
 	const __m128 fractional = _mm_cvtepi32_ps(fixed);
@@ -842,12 +1789,12 @@ inline static int32_t depthTest(DepthBuffer* depthBuffer, const int32_t* i, cons
 	int32_t res = 0;
 
 	for (unsigned int k = 0; k < 4; k++, curr <<= 1) {
-		if (mask.m128i_i32[k] == 0)
+		if (laneI32(mask, k) == 0)
 			continue;
 		const unsigned int row = static_cast<unsigned int>(i[k]);
 		const unsigned int column = static_cast<unsigned int>(j[k]);
 		const float currDepth = depthBuffer->get(row, column);
-		const float compareVal = compare.m128_f32[k];
+		const float compareVal = laneF32(compare, k);
 		if (currDepth > compareVal) {
 			depthBuffer->set(row, column, compareVal);
 			res |= curr;
@@ -857,4 +1804,45 @@ inline static int32_t depthTest(DepthBuffer* depthBuffer, const int32_t* i, cons
 	return res;
 }
 
-#endif
\ No newline at end of file
+template<int32_t fractionalSize>
+SOFTRP_TARGET_AVX2 inline static __m256 fixedToFloat(__m256i fixed) {
+	throw std::runtime_error{ "Missing implementation" };
+}
+
+template<>
+SOFTRP_TARGET_AVX2 inline __m256 fixedToFloat<4>(__m256i fixed) {
+	//the integral and the fractional parts are converted separately, as in the scalar version
+	const __m256i integralPart = _mm256_srai_epi32(fixed, 4);
+	const __m256i fractionalPart = _mm256_and_si256(fixed, _mm256_set1_epi32(0x0000000F));
+	const __m256 divisor = _mm256_set1_ps(16.0f);
+	return _mm256_add_ps(_mm256_cvtepi32_ps(integralPart), _mm256_div_ps(_mm256_cvtepi32_ps(fractionalPart), divisor));
+}
+
+/*
+Depth test of the 4x2 block whose top-left pixel is (i, j), for the lanes enabled in mask.
+Returns a bit mask of the lanes which passed the test.
+*/
+SOFTRP_TARGET_AVX2
+inline static int32_t depthTest(DepthBuffer* depthBuffer, int32_t i, int32_t j, const __m256 compare, const __m256i mask) {
+	
+	const unsigned int width = depthBuffer->width();
+	float* row0 = depthBuffer->getData() + static_cast<unsigned int>(i)*width + static_cast<unsigned int>(j);
+	//if the second row is outside the depth buffer, its lanes are all disabled
+	float* row1 = static_cast<unsigned int>(i + 1) < depthBuffer->height() ? row0 + width : row0;
+
+	//masked loads and stores don't access the memory of disabled lanes, i.e. pixels outside the depth buffer
+	const __m128i mask0 = _mm256_castsi256_si128(mask);
+	const __m128i mask1 = _mm256_extracti128_si256(mask, 1);
+	const __m256 currDepth = _mm256_set_m128(_mm_maskload_ps(row1, mask1), _mm_maskload_ps(row0, mask0));
+
+	const __m256 passed = _mm256_and_ps(_mm256_cmp_ps(currDepth, compare, _CMP_GT_OQ), _mm256_castsi256_ps(mask));
+	const int32_t res = _mm256_movemask_ps(passed);
+	if (res == 0)
+		return 0;
+
+	const __m256i passedMask = _mm256_castps_si256(passed);
+	_mm_maskstore_ps(row0, _mm256_castsi256_si128(passedMask), _mm256_castps256_ps128(compare));
+	_mm_maskstore_ps(row1, _mm256_extracti128_si256(passedMask, 1), _mm256_extractf128_ps(compare, 1));
+	return res;
+}
+#endif
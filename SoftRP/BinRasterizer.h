@@ -4,10 +4,10 @@
 #include "Vector.h"
 #ifdef SOFTRP_MULTI_THREAD
 #include "ThreadPool.h"
-#include <mutex>
+#include <atomic>
+#include <thread>
 #endif
-#include <unordered_set>
-#include <queue>
+#include <memory>
 namespace SoftRP {
 
 	/*
@@ -16,27 +16,48 @@ namespace SoftRP {
 	collectively to a tile and its list.
 	Once a primitive is transformed to Screen space, it is added to all the bins it covers, completely or partially. 
 	Then for all nonempty bins, all the primitives on the list are rasterized on the correspondent tile.
+	Primitives are tested against the maximum depths kept by the DepthBuffer: they are not added to the bins of the 
+	tiles where they are occluded, nor rasterized on the blocks of a tile where they are occluded. The maximum depths 
+	are lowered as depth values are written.
 	*/
 
 	class BinRasterizer : public Rasterizer{
 	public:
 
-		BinRasterizer() = default;			
+		/*
+		If tileEdgeTest is true, a triangle is added to a bin only if its edges do not exclude the bin's tile entirely.
+		Otherwise, triangles are added to all the bins their AABB touches.
+		*/
+		BinRasterizer(bool tileEdgeTest = true);
 		virtual ~BinRasterizer() = default;
 				
 		/*
 		If SOFTRP_USE_SIMD is defined, the implementation requires Vertexs' data to be 16-byte aligned.
 		*/
 #ifdef SOFTRP_MULTI_THREAD
-		virtual ThreadPool::Fence rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint64_t>& indices, 
+		virtual ThreadPool::Fence rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, 
 													 size_t instance, ThreadPool& threadPool) override final;
 #else
-		virtual void rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint64_t>& indices,
+		virtual void rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
 										size_t instance) override final;
 #endif
+#ifdef SOFTRP_MULTI_THREAD
+		virtual ThreadPool::Fence rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+													 const std::vector<uint32_t>& groupIds, const std::vector<TriangleGroup>& groups,
+													 ThreadPool& threadPool) override final;
+#else
+		virtual void rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+										const std::vector<uint32_t>& groupIds, const std::vector<TriangleGroup>& groups) override final;
+#endif
 		
 		virtual void setRenderTarget(RenderTarget* renderTarget) override final;
 
+		/*
+		Triangles are scissored to the ViewPort during the rasterization, so they can extend beyond it up to 
+		GUARD_BAND_LIMIT pixels away from its center, in every direction.
+		*/
+		virtual Math::Vector2 guardBand() const override final;
+
 	protected:
 		BinRasterizer(const BinRasterizer&) = delete;
 		BinRasterizer& operator=(const BinRasterizer&) = delete;
@@ -47,22 +68,118 @@ namespace SoftRP {
 
 		static constexpr unsigned int TILE_WIDTH = 64;
 		static constexpr unsigned int TILE_HEIGHT = 64;
+		//size of the blocks a tile is divided into, for hierarchical coverage tests
+		static constexpr unsigned int BLOCK_WIDTH = 8;
+		static constexpr unsigned int BLOCK_HEIGHT = 8;
 
-		struct Bin;
-		void rasterizeBin(Bin& bin, const std::vector<Vertex>* vertices, size_t instance);
+		//tiles and blocks are occlusion-culled against the DepthBuffer's maximum depths of the same areas
+		static_assert(TILE_WIDTH == DepthBuffer::TILE_SIZE && TILE_HEIGHT == DepthBuffer::TILE_SIZE, 
+					  "Invalid tile size, it must match the DepthBuffer's one.");
+		static_assert(BLOCK_WIDTH == DepthBuffer::BLOCK_SIZE && BLOCK_HEIGHT == DepthBuffer::BLOCK_SIZE, 
+					  "Invalid block size, it must match the DepthBuffer's one.");
 
+		//minimum number of triangles processed by a chunk during setup and binning
+		static constexpr size_t SETUP_CHUNK_SIZE = 1024;
+		/*
+		triangles whose AABB is less than SMALL_TRIANGLE_SIZE pixels wide and high are small: they are culled 
+		during setup if they cover no pixel and are rasterized testing only the quads of their AABB
+		*/
+		static constexpr unsigned int SMALL_TRIANGLE_SIZE = 4;
+		/*
+		maximum distance of the vertices from the center of the ViewPort, in pixels, along each axis. the 28.4 
+		fixed-point coordinates are relative to that center, and the edge functions are evaluated at the vertices 
+		and at pixels at most a tile away from the ViewPort, so all these points lie in a square whose side is 
+		2*(GUARD_BAND_LIMIT + TILE_WIDTH) pixels, i.e. 45056 in 28.4 notation. an edge function's value, as well 
+		as any partial sum of its evaluation, is twice the signed area of a triangle inside that square, hence less 
+		than 45056^2 < 2^31 in magnitude. ViewPorts larger than 2*GUARD_BAND_LIMIT pixels get no guard band
+		*/
+		static constexpr unsigned int GUARD_BAND_LIMIT = 1344;
+
+		//rasterize the triangles, the i-th one of groups[groupIds[i]], or of groups[0] if groupIds is null
+#ifdef SOFTRP_MULTI_THREAD
+		ThreadPool::Fence rasterize(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+									const uint32_t* groupIds, const TriangleGroup* groups, ThreadPool& threadPool);
+#else
+		void rasterize(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+					   const uint32_t* groupIds, const TriangleGroup* groups);
+#endif
+		//group of the i-th triangle
+		const TriangleGroup& triangleGroup(size_t i) const;
+
+		//transform vertices in [first, last) to Screen space
+		void transformVertices(const std::vector<Vertex>& vertices, size_t first, size_t last);
+		//setup triangles in [first, last) and add them to binLists, one list per bin
+		void setupTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, 
+							size_t first, size_t last, std::vector<size_t>* binLists);
 		struct Triangle;
+		//test if any pixel of t's AABB is covered by t
+		bool coversPixels(const Triangle& t) const;
+		//compute the plane equations of the i-th triangle's attributes, evaluated at (t.planeX, t.planeY)
+		void setupAttributePlanes(const std::vector<Vertex>& vertices, const Triangle& t, size_t i);
+
+		struct Bin;
+		//rasterize bin's triangles with the kernel selected for the host at construction
+		void rasterizeBin(Bin& bin, const std::vector<Vertex>* vertices);
+		void rasterizeBinScalar(Bin& bin, const std::vector<Vertex>* vertices);
+#ifdef SOFTRP_USE_SIMD
+		void rasterizeBinSSE(Bin& bin, const std::vector<Vertex>* vertices);
+		void rasterizeBinAVX2(Bin& bin, const std::vector<Vertex>* vertices);
+#endif
+		using RasterizeBinKernel = void (BinRasterizer::*)(Bin&, const std::vector<Vertex>*);
+
+		struct QuadBatch;
+		//prepare batch to collect the quads of a bin, using storage for their interpolated vertices
+		void initQuadBatch(QuadBatch& batch, float* storage, VertexLayout* vertexLayout);
+		//size of the storage required by initQuadBatch, in floats
+		size_t quadBatchStorageSize() const;
+		/*
+		interpolate the i-th triangle's vertices at the quad whose top-left pixel is (x, y) and add it to batch, 
+		shading the batch if it is full or if it holds quads of another group
+		*/
+		void batchQuad(QuadBatch& batch, size_t i, const Math::Vector4& position, int32_t x, int32_t y, int32_t mask, 
+					   const TriangleGroup& group);
+		//shade the quads in batch and write their pixels
+		void shadeQuadBatch(QuadBatch& batch);
+
 		struct TransformedVertex;
 
+		bool m_tileEdgeTest{ true };
+		RasterizeBinKernel m_rasterizeBinKernel{ &BinRasterizer::rasterizeBinScalar };
 		unsigned int m_tilesPerWidth{ 0 };
 		unsigned int m_tilesPerHeight{ 0 };
 		unsigned int m_renderTargetWidth{ 0 };
 		unsigned int m_renderTargetHeight{ 0 };
+		//intersection of the ViewPort and the RenderTarget, the pixels written by rasterizeTriangles. maximums are exclusive
+		int32_t m_scissorXMin{ 0 };
+		int32_t m_scissorYMin{ 0 };
+		int32_t m_scissorXMax{ 0 };
+		int32_t m_scissorYMax{ 0 };
+		//center of the ViewPort, in pixels, which is the origin of the fixed-point coordinates
+		int32_t m_originX{ 0 };
+		int32_t m_originY{ 0 };
 		size_t m_binsCount{ 0 };		
 		std::vector<Bin> m_bins{};
 		std::vector<TransformedVertex> m_transformedVertices{};
 		std::vector<Triangle> m_triangles{};
-		std::unordered_set<size_t> m_activeBins{};
+		/*
+		plane equations of the triangles' attributes, m_planeStride floats per triangle. 
+		Let (x, y) be a pixel's offset from the triangle's (planeX, planeY), the first 4 floats are the 
+		coefficients (q, dq/dx, dq/dy, unused) of q = A/w0 + B/w1 + C/w2, where A, B and C are the pixel's 
+		barycentric coordinates. They are followed by the values at the origin of f' = A*f0/w0 + B*f1/w1 + C*f2/w2, 
+		for each interpolated float f, then by the values of df'/dx and df'/dy. An attribute is then f'/q.
+		*/
+		std::vector<float> m_attributePlanes{};
+		//number of floats interpolated per vertex (position excluded) and the same number rounded up to a multiple of 4
+		size_t m_attributeCount{ 0 };
+		size_t m_paddedAttributeCount{ 0 };
+		size_t m_planeStride{ 0 };
+		std::vector<std::vector<size_t>> m_binLists{};//m_binsCount lists of indices in m_triangles per setup chunk
+		std::vector<size_t> m_activeBins{};
+		//groups of the triangles rasterized and the group of each one, if any
+		const TriangleGroup* m_groups{ nullptr };
+		const uint32_t* m_groupIds{ nullptr };
+		//the group of the triangles rasterized with an instance and the ShaderContext set
+		TriangleGroup m_defaultGroup{ 0, nullptr };
 		
 		struct TransformedVertex {
 			float invW;
@@ -83,33 +200,92 @@ namespace SoftRP {
 			int32_t betaBias;
 			int32_t gammaBias;
 			float twiceArea;
-			uint64_t i0;
-			uint64_t i1;
-			uint64_t i2;
+			float minDepth;
+			//pixel where the attributes' plane equations are evaluated, the top-left corner of the AABB
+			int32_t planeX;
+			int32_t planeY;
+			//AABB of the pixels the triangle may cover inside the scissor rectangle, the maximums are inclusive
+			int32_t xMin;
+			int32_t yMin;
+			int32_t xMax;
+			int32_t yMax;
+			bool small;
+			uint32_t i0;
+			uint32_t i1;
+			uint32_t i2;
 		};
 
+		/*
+		A bin's list of triangles is written by a single producer (the thread executing rasterizeTriangles) and read by 
+		a single consumer (the task executing rasterizeBin), while the former is still adding triangles.
+		It is an append-only list of fixed-size chunks: a triangle is published by storing the new count of triangles 
+		after it has been written, so the consumer never needs a lock to read it. The chunks are kept, and reused, 
+		across resets.
+		*/
 		struct Bin {
 			Bin() = default;
 			~Bin() = default;
 			Bin(Bin&&);
 
+			//prepare the bin for a new list of triangles. it must not be called while a consumer is active
+			void reset();
 			void addTriangle(size_t i);
 			bool hasNext();
-			size_t getNext();			
-#ifdef SOFTRP_MULTI_THREAD						
-			void setDone(bool _done);
+			size_t getNext();
+#ifdef SOFTRP_MULTI_THREAD
+			//notify that no more triangles will be added
+			void setDone();
 #endif
+			/*
+			get a 16-byte aligned storage of at least size floats for the consumer's interpolated vertices.
+			it is kept across uses, so that the consumer doesn't allocate once the storage is large enough
+			*/
+			float* interpolationData(size_t size);
+
 			int32_t xMin;
 			int32_t yMin;
 			int32_t xMax;
 			int32_t yMax;
+
+			static constexpr size_t CHUNK_SIZE = 256;
+#ifdef SOFTRP_MULTI_THREAD
+			//number of checks performed by a waiting consumer before yielding
+			static constexpr unsigned int SPIN_COUNT = 64;
+#endif
+			struct TriangleChunk {
+				size_t triangles[CHUNK_SIZE];//indices in m_triangles
+				std::unique_ptr<TriangleChunk> next{};
+			};
+
+			std::unique_ptr<TriangleChunk> firstChunk{};
+			//producer's state
+			TriangleChunk* writeChunk{ nullptr };
+			size_t writeCount{ 0 };
+			//consumer's state
+			TriangleChunk* readChunk{ nullptr };
+			size_t readCount{ 0 };
 #ifdef SOFTRP_MULTI_THREAD
-			bool done{ false };
-			std::mutex mutex{};
-			std::condition_variable existsNext{};
+			std::atomic<size_t> count{ 0 };//number of triangles published
+			std::atomic<bool> done{ false };
 #endif
-			std::queue<size_t> triangleQueue{};//a queue of indices in m_triangles
-		};		
+			std::vector<float> interpolationBuffer{};
+		};
+
+		/*
+		Quads waiting to be shaded with PixelShader::shadeBatch, when the pixel shader is batched. 
+		They are shaded once MAX_QUADS of them are collected, before the quads of another group are added and 
+		when the bin is done: because their depth values are written when they are added, deferring their colors 
+		does not change the result.
+		*/
+		struct QuadBatch {
+			PSBatchContext context;
+			//the group of the quads, whose instance and ShaderContext they are shaded with
+			const TriangleGroup* group;
+			float* data;
+			int32_t quadX[PSBatchContext::MAX_QUADS];
+			int32_t quadY[PSBatchContext::MAX_QUADS];
+			Math::Vector4 colors[4 * PSBatchContext::MAX_QUADS];
+		};
 	};
 
 	/*
@@ -117,11 +293,11 @@ namespace SoftRP {
 	*/
 	class BinRasterizerFactory : public RasterizerFactory {
 	public:
-		BinRasterizerFactory() = default;
+		BinRasterizerFactory(bool tileEdgeTest = true) : m_tileEdgeTest{ tileEdgeTest } {}
 		~BinRasterizerFactory() = default;
 
 		virtual Rasterizer* create()const override final {
-			return new BinRasterizer{};
+			return new BinRasterizer{ m_tileEdgeTest };
 		}
 
 	protected:
@@ -129,6 +305,9 @@ namespace SoftRP {
 		BinRasterizerFactory& operator=(const BinRasterizerFactory&) = delete;
 		BinRasterizerFactory(BinRasterizerFactory&&) = delete;
 		BinRasterizerFactory& operator=(BinRasterizerFactory&&) = delete;
+
+	private:
+		bool m_tileEdgeTest;
 	};
 }
 #endif
\ No newline at end of file
@@ -25,6 +25,7 @@ namespace SoftRP {
 	template<typename T>
 	inline Buffer<T>& Buffer<T>::operator=(const Buffer& buff) {
 		copy(buff);
+		return *this;
 	}
 
 	template<typename T>
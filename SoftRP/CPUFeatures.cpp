@@ -0,0 +1,182 @@
+#include "CPUFeatures.h"
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cpuid.h>
+#endif
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <cstdio>
+#endif
+
+using namespace SoftRP;
+
+/*helper functions forward declarations*/
+static void cpuid(uint32_t leaf, uint32_t subLeaf, uint32_t regs[4]);
+static uint64_t xgetbv0();
+static SIMDLevel detectSIMDLevel();
+static std::vector<unsigned int> detectProcessorsByCore();
+
+SIMDLevel SoftRP::hostSIMDLevel() {
+	//the detection is performed once, the result can't change during the execution
+	static const SIMDLevel level = detectSIMDLevel();
+	return level;
+}
+
+SIMDLevel SoftRP::supportedSIMDLevel() {
+#ifdef SOFTRP_USE_SIMD
+	return hostSIMDLevel();
+#else
+	return SIMDLevel::SCALAR;
+#endif
+}
+
+const std::vector<unsigned int>& SoftRP::hostProcessorsByCore() {
+	static const std::vector<unsigned int> processors = detectProcessorsByCore();
+	return processors;
+}
+
+bool SoftRP::pinThread(std::thread& thread, unsigned int processor) {
+#if defined(_MSC_VER)
+	if (processor >= sizeof(DWORD_PTR) * 8)
+		return false;
+	return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{ 1 } << processor) != 0;
+#elif defined(__linux__)
+	if (processor >= CPU_SETSIZE)
+		return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(processor, &set);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+/*
+The processor reports its instruction sets through cpuid, but AVX and AVX-512 registers can be used only if the
+operating system saves them across context switches, which is reported by XCR0.
+*/
+static SIMDLevel detectSIMDLevel() {
+	uint32_t regs[4];
+	cpuid(0, 0, regs);
+	const uint32_t maxLeaf = regs[0];
+	if (maxLeaf < 1)
+		return SIMDLevel::SCALAR;
+
+	cpuid(1, 0, regs);
+	const uint32_t ecx1 = regs[2];
+	const bool sse41 = (ecx1 & (1u << 19)) != 0;
+	const bool osxsave = (ecx1 & (1u << 27)) != 0;
+	const bool avx = (ecx1 & (1u << 28)) != 0;
+	const bool fma = (ecx1 & (1u << 12)) != 0;
+	if (!sse41)
+		return SIMDLevel::SCALAR;
+	if (!osxsave || !avx || !fma || maxLeaf < 7)
+		return SIMDLevel::SSE4;
+
+	const uint64_t xcr0 = xgetbv0();
+	//XMM and YMM state
+	if ((xcr0 & 0x6) != 0x6)
+		return SIMDLevel::SSE4;
+
+	cpuid(7, 0, regs);
+	const uint32_t ebx7 = regs[1];
+	const bool avx2 = (ebx7 & (1u << 5)) != 0;
+	const bool avx512f = (ebx7 & (1u << 16)) != 0;
+	if (!avx2)
+		return SIMDLevel::SSE4;
+	//opmask and ZMM state
+	if (avx512f && (xcr0 & 0xE0) == 0xE0)
+		return SIMDLevel::AVX512;
+	return SIMDLevel::AVX2;
+}
+
+static void cpuid(uint32_t leaf, uint32_t subLeaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+	int intRegs[4];
+	__cpuidex(intRegs, static_cast<int>(leaf), static_cast<int>(subLeaf));
+	for (int i = 0; i < 4; i++)
+		regs[i] = static_cast<uint32_t>(intRegs[i]);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, subLeaf, a, b, c, d);
+	regs[0] = a;
+	regs[1] = b;
+	regs[2] = c;
+	regs[3] = d;
+#endif
+}
+
+//must be called only if cpuid reports OSXSAVE
+static uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+/*
+Each logical processor is ranked by its position among the ones of its physical core, then the processors are sorted
+by rank, so that the first ones of all the cores come first.
+*/
+static std::vector<unsigned int> detectProcessorsByCore() {
+	const unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::pair<unsigned int, unsigned int>> ranked{};
+#if defined(_MSC_VER)
+	DWORD size = 0;
+	GetLogicalProcessorInformation(nullptr, &size);
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (!infos.empty() && GetLogicalProcessorInformation(infos.data(), &size)) {
+		for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& info : infos) {
+			if (info.Relationship != RelationProcessorCore)
+				continue;
+			unsigned int rank = 0;
+			for (unsigned int processor = 0; processor < sizeof(ULONG_PTR) * 8; processor++) {
+				if ((info.ProcessorMask & (ULONG_PTR{ 1 } << processor)) != 0)
+					ranked.emplace_back(rank++, processor);
+			}
+		}
+	}
+#elif defined(__linux__)
+	for (unsigned int processor = 0; processor < count; processor++) {
+		//the first processor listed among the core's siblings has rank 0
+		char path[128];
+		std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", processor);
+		FILE* file = std::fopen(path, "r");
+		if (!file) {
+			ranked.clear();
+			break;
+		}
+		unsigned int first = processor;
+		if (std::fscanf(file, "%u", &first) != 1)
+			first = processor;
+		std::fclose(file);
+		ranked.emplace_back(first == processor ? 0u : 1u, processor);
+	}
+#endif
+	std::vector<unsigned int> processors{};
+	if (ranked.empty()) {
+		for (unsigned int processor = 0; processor < count; processor++)
+			processors.push_back(processor);
+		return processors;
+	}
+	std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<unsigned int, unsigned int>& p1, 
+													  const std::pair<unsigned int, unsigned int>& p2) {
+		return p1.first < p2.first;
+	});
+	for (const auto& p : ranked)
+		processors.push_back(p.second);
+	return processors;
+}
@@ -0,0 +1,38 @@
+#ifndef SOFTRP_CPU_FEATURES_H_
+#define SOFTRP_CPU_FEATURES_H_
+#include "SoftRPDefs.h"
+#include <vector>
+#include <thread>
+namespace SoftRP {
+
+	/*
+	Instruction sets the SIMD code paths are written for, in increasing order: a level implies all the previous ones.
+	SSE4 stands for SSE4.1, AVX2 also implies AVX and FMA, AVX512 stands for AVX-512F.
+	*/
+	enum class SIMDLevel {
+		SCALAR,
+		SSE4,
+		AVX2,
+		AVX512
+	};
+
+	//the highest SIMDLevel supported by both the host's processor and operating system
+	SIMDLevel hostSIMDLevel();
+
+	/*
+	The highest SIMDLevel which is supported by the host and for which code paths have been compiled, that is SCALAR
+	if SOFTRP_USE_SIMD is not defined, hostSIMDLevel() otherwise.
+	*/
+	SIMDLevel supportedSIMDLevel();
+
+	/*
+	The host's logical processors, ordered so that the first logical processor of each physical core comes before
+	the other ones: assigning threads in this order spreads them over the physical cores before they share any.
+	If the topology can't be queried, the logical processors are listed in their order.
+	*/
+	const std::vector<unsigned int>& hostProcessorsByCore();
+
+	//pin the thread to the logical processor, return false if it can't be done on the host
+	bool pinThread(std::thread& thread, unsigned int processor);
+}
+#endif
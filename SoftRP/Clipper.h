@@ -22,6 +22,15 @@ namespace SoftRP {
 	-w <= x <= w	->	w-x >= 0, x + w >= 0
 	-w <= y <= w	->	w-y >= 0, y + w >= 0
 	-w <= z <= w	->	w-z >= 0, z + w >= 0	
+
+	A guard band can be set to enlarge the clipping volume along the x and y axes, when the Rasterizer is able to 
+	discard the pixels outside the ViewPort by itself (see Rasterizer::guardBand). With guard band factors gx and gy, 
+	primitives are clipped against:
+	-gx*w <= x <= gx*w
+	-gy*w <= y <= gy*w
+	-w <= z <= w
+	so that most of the primitives crossing the edges of the ViewPort don't need to be clipped at all. Primitives 
+	which are entirely outside the canonical view volume can still be discarded.
 	*/
 
 	class Clipper{
@@ -33,24 +42,52 @@ namespace SoftRP {
 		/*
 		Clip a list of triangles defined by vertices indexed by inIndices.
 		The result, indexed with outIndices, is returned in vertices itself.
+		The vertices generated by the clipping may reference data owned by the Clipper, which is valid until 
+		the next call to clipTriangles: clients which keep them longer must copy them.
 		In a multi-threaded environment, Clippers are allowed to use the ThreadPool passed in as 
 		argument to execute tasks related to the operation. A ThreadPool::Fence is returned to allow 
 		clients to be notified of the completion of all the tasks submitted, until then the arguments 
 		passed in can't be modified.
 		*/
 #ifdef SOFTRP_MULTI_THREAD
-		virtual ThreadPool::Fence clipTriangles(std::vector<Vertex>& vertices, uint64_t* inIndices, 
-												size_t triangleCount, std::vector<uint64_t>& outIndices,
+		virtual ThreadPool::Fence clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, 
+												size_t triangleCount, std::vector<uint32_t>& outIndices,
 												ThreadPool& threadPool) = 0;
 #else
-		virtual void clipTriangles(std::vector<Vertex>& vertices, uint64_t* inIndices,
-								   size_t triangleCount, std::vector<uint64_t>& outIndices) = 0;
+		virtual void clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices,
+								   size_t triangleCount, std::vector<uint32_t>& outIndices) = 0;
+#endif
+
+		/*
+		As clipTriangles, tagging the triangles: inTags holds a tag per triangle indexed by inIndices, which is 
+		appended to outTags once for each triangle the clipping produces from it. Before the call, outTags must 
+		hold a tag per triangle indexed by outIndices.
+		*/
+#ifdef SOFTRP_MULTI_THREAD
+		virtual ThreadPool::Fence clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, const uint32_t* inTags,
+												size_t triangleCount, std::vector<uint32_t>& outIndices, 
+												std::vector<uint32_t>& outTags, ThreadPool& threadPool) = 0;
+#else
+		virtual void clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, const uint32_t* inTags,
+								   size_t triangleCount, std::vector<uint32_t>& outIndices, 
+								   std::vector<uint32_t>& outTags) = 0;
 #endif
+
+		/*
+		Set the guard band factors along the x and y axes, which must be at least 1. The default, {1, 1}, clips 
+		primitives against the canonical view volume.
+		*/
+		void setGuardBand(const Math::Vector2& guardBand);
+		const Math::Vector2& guardBand() const;
+
 	protected:
 		Clipper(const Clipper&) = delete;
 		Clipper(Clipper&&) = delete;
 		Clipper& operator=(const Clipper&) = delete;
 		Clipper& operator=(Clipper&&) = delete;
+
+	private:
+		Math::Vector2 m_guardBand{ 1.0f, 1.0f };
 	};
 
 	/*
@@ -71,4 +108,7 @@ namespace SoftRP {
 	};
 
 }
+
+#include "ClipperImpl.inl"
+
 #endif
@@ -0,0 +1,9 @@
+#ifndef SOFTRP_CLIPPER_IMPL_INL_
+#define SOFTRP_CLIPPER_IMPL_INL_
+#include "Clipper.h"
+namespace SoftRP {
+
+	inline void Clipper::setGuardBand(const Math::Vector2& guardBand) { m_guardBand = guardBand; }
+	inline const Math::Vector2& Clipper::guardBand() const { return m_guardBand; }
+}
+#endif
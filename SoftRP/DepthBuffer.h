@@ -1,10 +1,86 @@
 #ifndef SOFTRP_DEPTH_BUFFER_H_
 #define SOFTRP_DEPTH_BUFFER_H_
 #include "Texture2D.h"
+#include <vector>
 namespace SoftRP {
+
 	/*
-	Specialization of Texture2D which provides storage for depth values.
+	Texture2D which provides storage for depth values. It derives privately from Texture2D<float> and re-exports its 
+	accessors, so that the maximum depths below can't be bypassed by calling set, clear or resize through a Texture2D.
+	Besides the depth values, a DepthBuffer keeps a hierarchical representation of them: the maximum depth of each
+	block of BLOCK_SIZE x BLOCK_SIZE values and of each tile of TILE_SIZE x TILE_SIZE values. Because a depth value
+	passes the depth test only if it is less than the one stored, a primitive whose minimum depth is not less than the
+	maximum depth of a block (or tile) is known to be occluded there.
+	The maximum depths are conservative: they are never less than the actual ones. set and clear keep them so, while
+	writes through the other accessors (operator[], get and getData) must be followed by a call to updateMaxDepth().
+	Lowering them as depth values are written is left to the clients (see updateBlockMaxDepth and updateTileMaxDepth).
 	*/
-	using DepthBuffer = Texture2D<float>;
+	class DepthBuffer : private Texture2D<float> {
+	public:
+
+		static constexpr unsigned int BLOCK_SIZE = 8;
+		static constexpr unsigned int TILE_SIZE = 64;
+
+		//ctor
+		DepthBuffer(const unsigned int width = 1, const unsigned int height = 1);
+
+		//dtor
+		~DepthBuffer() = default;
+
+		//copy
+		DepthBuffer(const DepthBuffer&) = default;
+		DepthBuffer& operator=(const DepthBuffer&) = default;
+		//move
+		DepthBuffer(DepthBuffer&&) = default;
+		DepthBuffer& operator=(DepthBuffer&&) = default;
+
+		/* dimensions */
+		using Texture2D<float>::width;
+		using Texture2D<float>::height;
+		void resize(const unsigned int width, const unsigned int height);
+		unsigned int blocksPerWidth() const;
+		unsigned int blocksPerHeight() const;
+		unsigned int tilesPerWidth() const;
+		unsigned int tilesPerHeight() const;
+
+		/* getters */
+		using Texture2D<float>::operator[];
+		using Texture2D<float>::getData;
+		using Texture2D<float>::get;
+
+		/* setters */
+		void set(const unsigned int i, const unsigned int j, const float& value);
+
+		/* clearing */
+		void clear(float clearValue);
+#ifdef SOFTRP_MULTI_THREAD
+		void clear(float clearValue, ThreadPool& threadPool);
+#endif
+
+		/* hierarchical depth */
+		//maximum depth of the block (tile) in the blockI-th row and blockJ-th column of blocks (tiles)
+		float blockMaxDepth(const unsigned int blockI, const unsigned int blockJ) const;
+		float tileMaxDepth(const unsigned int tileI, const unsigned int tileJ) const;
+		//recompute the maximum depth of a block from its depth values
+		void updateBlockMaxDepth(const unsigned int blockI, const unsigned int blockJ);
+		//recompute the maximum depth of a tile from the maximum depths of its blocks
+		void updateTileMaxDepth(const unsigned int tileI, const unsigned int tileJ);
+		//recompute all the maximum depths
+		void updateMaxDepth();
+
+	private:
+		void resizeMaxDepth();
+		void clearMaxDepth(float clearValue);
+
+		static_assert(TILE_SIZE % BLOCK_SIZE == 0, "Invalid tile size, it must be a multiple of the block size.");
+
+		unsigned int m_blocksPerWidth{ 0 };
+		unsigned int m_blocksPerHeight{ 0 };
+		unsigned int m_tilesPerWidth{ 0 };
+		unsigned int m_tilesPerHeight{ 0 };
+		std::vector<float> m_blockMaxDepth{};
+		std::vector<float> m_tileMaxDepth{};
+	};
 }
-#endif
\ No newline at end of file
+#include "DepthBufferImpl.inl"
+#endif
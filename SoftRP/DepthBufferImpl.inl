@@ -0,0 +1,109 @@
+#ifndef SOFTRP_DEPTH_BUFFER_IMPL_INL_
+#define SOFTRP_DEPTH_BUFFER_IMPL_INL_
+#include "DepthBuffer.h"
+#include <algorithm>
+namespace SoftRP {
+
+	inline DepthBuffer::DepthBuffer(const unsigned int width, const unsigned int height)
+		: Texture2D<float>{ width, height } {
+		resizeMaxDepth();
+		updateMaxDepth();
+	}
+
+	inline void DepthBuffer::resize(const unsigned int width, const unsigned int height) {
+		Texture2D<float>::resize(width, height);
+		resizeMaxDepth();
+		updateMaxDepth();
+	}
+
+	inline unsigned int DepthBuffer::blocksPerWidth() const { return m_blocksPerWidth; }
+	inline unsigned int DepthBuffer::blocksPerHeight() const { return m_blocksPerHeight; }
+	inline unsigned int DepthBuffer::tilesPerWidth() const { return m_tilesPerWidth; }
+	inline unsigned int DepthBuffer::tilesPerHeight() const { return m_tilesPerHeight; }
+
+	inline void DepthBuffer::set(const unsigned int i, const unsigned int j, const float& value) {
+		Texture2D<float>::set(i, j, value);
+		//raising the maximum depths keeps them conservative, lowering them requires to look at the other values
+		float& blockMax = m_blockMaxDepth[(i / BLOCK_SIZE)*m_blocksPerWidth + j / BLOCK_SIZE];
+		float& tileMax = m_tileMaxDepth[(i / TILE_SIZE)*m_tilesPerWidth + j / TILE_SIZE];
+		blockMax = std::max(blockMax, value);
+		tileMax = std::max(tileMax, value);
+	}
+
+	inline void DepthBuffer::clear(float clearValue) {
+		Texture2D<float>::clear(clearValue);
+		clearMaxDepth(clearValue);
+	}
+
+#ifdef SOFTRP_MULTI_THREAD
+	inline void DepthBuffer::clear(float clearValue, ThreadPool& threadPool) {
+		Texture2D<float>::clear(clearValue, threadPool);
+		threadPool.addTask([this, clearValue]() {
+			clearMaxDepth(clearValue);
+		});
+	}
+#endif
+
+	inline float DepthBuffer::blockMaxDepth(const unsigned int blockI, const unsigned int blockJ) const {
+		return m_blockMaxDepth[blockI*m_blocksPerWidth + blockJ];
+	}
+
+	inline float DepthBuffer::tileMaxDepth(const unsigned int tileI, const unsigned int tileJ) const {
+		return m_tileMaxDepth[tileI*m_tilesPerWidth + tileJ];
+	}
+
+	inline void DepthBuffer::updateBlockMaxDepth(const unsigned int blockI, const unsigned int blockJ) {
+		const unsigned int iMin = blockI*BLOCK_SIZE;
+		const unsigned int jMin = blockJ*BLOCK_SIZE;
+		const unsigned int iMax = std::min(iMin + BLOCK_SIZE, height());
+		const unsigned int jMax = std::min(jMin + BLOCK_SIZE, width());
+		const float* data = getData();
+		float maxDepth = data[iMin*width() + jMin];
+		for (unsigned int i = iMin; i < iMax; i++) {
+			const float* row = data + i*width();
+			for (unsigned int j = jMin; j < jMax; j++)
+				maxDepth = std::max(maxDepth, row[j]);
+		}
+		m_blockMaxDepth[blockI*m_blocksPerWidth + blockJ] = maxDepth;
+	}
+
+	inline void DepthBuffer::updateTileMaxDepth(const unsigned int tileI, const unsigned int tileJ) {
+		constexpr unsigned int blocksPerTile = TILE_SIZE / BLOCK_SIZE;
+		const unsigned int blockIMin = tileI*blocksPerTile;
+		const unsigned int blockJMin = tileJ*blocksPerTile;
+		const unsigned int blockIMax = std::min(blockIMin + blocksPerTile, m_blocksPerHeight);
+		const unsigned int blockJMax = std::min(blockJMin + blocksPerTile, m_blocksPerWidth);
+		float maxDepth = blockMaxDepth(blockIMin, blockJMin);
+		for (unsigned int blockI = blockIMin; blockI < blockIMax; blockI++) {
+			for (unsigned int blockJ = blockJMin; blockJ < blockJMax; blockJ++)
+				maxDepth = std::max(maxDepth, blockMaxDepth(blockI, blockJ));
+		}
+		m_tileMaxDepth[tileI*m_tilesPerWidth + tileJ] = maxDepth;
+	}
+
+	inline void DepthBuffer::updateMaxDepth() {
+		for (unsigned int blockI = 0; blockI < m_blocksPerHeight; blockI++) {
+			for (unsigned int blockJ = 0; blockJ < m_blocksPerWidth; blockJ++)
+				updateBlockMaxDepth(blockI, blockJ);
+		}
+		for (unsigned int tileI = 0; tileI < m_tilesPerHeight; tileI++) {
+			for (unsigned int tileJ = 0; tileJ < m_tilesPerWidth; tileJ++)
+				updateTileMaxDepth(tileI, tileJ);
+		}
+	}
+
+	inline void DepthBuffer::resizeMaxDepth() {
+		m_blocksPerWidth = (width() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		m_blocksPerHeight = (height() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		m_tilesPerWidth = (width() + TILE_SIZE - 1) / TILE_SIZE;
+		m_tilesPerHeight = (height() + TILE_SIZE - 1) / TILE_SIZE;
+		m_blockMaxDepth.resize(m_blocksPerWidth*m_blocksPerHeight);
+		m_tileMaxDepth.resize(m_tilesPerWidth*m_tilesPerHeight);
+	}
+
+	inline void DepthBuffer::clearMaxDepth(float clearValue) {
+		std::fill(m_blockMaxDepth.begin(), m_blockMaxDepth.end(), clearValue);
+		std::fill(m_tileMaxDepth.begin(), m_tileMaxDepth.end(), clearValue);
+	}
+}
+#endif
@@ -10,7 +10,7 @@ namespace SoftRP {
 
 #ifdef SOFTRP_FMATH_SIMD
 	struct FMatrix {
-		__m256 doubleRows[2];
+		__m128 rows[4];
 	};
 #else
 	using FMatrix = Math::Matrix4;
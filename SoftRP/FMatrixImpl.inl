@@ -9,10 +9,10 @@ namespace SoftRP {
 				   float r2c0, float r2c1, float r2c2, float r2c3,
 				   float r3c0, float r3c1, float r3c2, float r3c3) {
 		FMatrix m;
-		m.doubleRows[0] = _mm256_set_ps(r1c3, r1c2, r1c1, r1c0,
-										r0c3, r0c2, r0c1, r0c0);
-		m.doubleRows[1] = _mm256_set_ps(r3c3, r3c2, r3c1, r3c0,
-										r2c3, r2c2, r2c1, r2c0);
+		m.rows[0] = _mm_set_ps(r0c3, r0c2, r0c1, r0c0);
+		m.rows[1] = _mm_set_ps(r1c3, r1c2, r1c1, r1c0);
+		m.rows[2] = _mm_set_ps(r2c3, r2c2, r2c1, r2c0);
+		m.rows[3] = _mm_set_ps(r3c3, r3c2, r3c1, r3c0);
 		return m;
 	}
 
@@ -21,78 +21,59 @@ namespace SoftRP {
 			throw std::runtime_error{ "Invalid initializer_list size" };
 		FMatrix m;
 
-		auto firstSecondRowsIt = init.begin();
-		auto thirdFourthRowsIt = firstSecondRowsIt + 8;
-		for (unsigned int i = 0; i < 8; i++) {
-			m.doubleRows[0].m256_f32[i] = *firstSecondRowsIt;
-			m.doubleRows[1].m256_f32[i] = *thirdFourthRowsIt;
-			firstSecondRowsIt += 1;
-			thirdFourthRowsIt += 1;
-		}
+		auto it = init.begin();
+		for (unsigned int i = 0; i < 16; i++, it++)
+			setLaneF32(m.rows[i / 4], i % 4, *it);
 
 		return m;
 	}
 
 	inline FMatrix createFM(const Math::Matrix4& m) {
-		FMatrix res;		
-		res.doubleRows[0] = _mm256_loadu_ps(m.data());
-		res.doubleRows[1] = _mm256_loadu_ps(m.data() + 8);
+		FMatrix res;
+		for (unsigned int i = 0; i < 4; i++)
+			res.rows[i] = _mm_loadu_ps(m.data() + i * 4);
 		return res;
 	}
 
 	inline float get(FMatrix m, unsigned int i) {
-		return i < 8 ? m.doubleRows[0].m256_f32[i] : m.doubleRows[1].m256_f32[i - 8];
+		return laneF32(m.rows[i / 4], i % 4);
 	}
 
 	inline float get(FMatrix m, unsigned int i, unsigned int j) {
-		const bool rowEven = i % 2 == 0;
-		unsigned int column = rowEven ? j : j + 4;
-		if (i < 2)
-			return m.doubleRows[0].m256_f32[column];
-		else
-			return m.doubleRows[1].m256_f32[column];		
+		return laneF32(m.rows[i], j);
 	}
 
 	inline FMatrix set(FMatrix m, unsigned int i, float value) {
 		FMatrix m1 = m;
-		if (i < 8)
-			m1.doubleRows[0].m256_f32[i] = value;
-		else
-			m1.doubleRows[0].m256_f32[i - 8] = value;
+		setLaneF32(m1.rows[i / 4], i % 4, value);
 		return m1;			
 	}
 
 	inline FMatrix set(FMatrix m, unsigned int i, unsigned int j, float value) {
 		FMatrix m1 = m;
-		const bool rowEven = i % 2 == 0;
-		unsigned int column = rowEven ? j : j + 4;
-		if(i < 2)
-			m1.doubleRows[0].m256_f32[column] = value;
-		else
-			m1.doubleRows[1].m256_f32[column] = value;
+		setLaneF32(m1.rows[i], j, value);
 		return m1;
 	}
 
 	inline FMatrix addFM(FMatrix m1, FMatrix m2) {
 		FMatrix m;
-		for (unsigned int i = 0; i < 2; i++)
-			m.doubleRows[i] = _mm256_add_ps(m1.doubleRows[i], m2.doubleRows[i]);
+		for (unsigned int i = 0; i < 4; i++)
+			m.rows[i] = _mm_add_ps(m1.rows[i], m2.rows[i]);
 		return m;
 	}
 
 	inline FMatrix subFM(FMatrix m1, FMatrix m2) {
 		FMatrix m;
-		for (unsigned int i = 0; i < 2; i++)
-			m.doubleRows[i] = _mm256_sub_ps(m1.doubleRows[i], m2.doubleRows[i]);
+		for (unsigned int i = 0; i < 4; i++)
+			m.rows[i] = _mm_sub_ps(m1.rows[i], m2.rows[i]);
 		return m;
 	}
 
 	inline FMatrix mulFM(FMatrix m1, FMatrix m2){
-		__m128 firstColumn2 = _mm256_extractf128_ps(m2.doubleRows[0], 0x00);
-		__m128 secondColumn2 = _mm256_extractf128_ps(m2.doubleRows[0], 0x01);
-
-		__m128 thirdColumn2 = _mm256_extractf128_ps(m2.doubleRows[1], 0x00);
-		__m128 fourthColumn2 = _mm256_extractf128_ps(m2.doubleRows[1], 0x01);
+		__m128 firstColumn2 = m2.rows[0];
+		__m128 secondColumn2 = m2.rows[1];
+		__m128 thirdColumn2 = m2.rows[2];
+		__m128 fourthColumn2 = m2.rows[3];
 
 		_MM_TRANSPOSE4_PS(firstColumn2, secondColumn2, thirdColumn2, fourthColumn2);
 
@@ -104,29 +85,24 @@ namespace SoftRP {
 		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
 
 		FMatrix res;
-		res.doubleRows[0] = _mm256_set_m128(c1, c0);
-		res.doubleRows[1] = _mm256_set_m128(c3, c2);
+		res.rows[0] = c0;
+		res.rows[1] = c1;
+		res.rows[2] = c2;
+		res.rows[3] = c3;
 		return res;
 	}
 
 	inline FVector mulFM(FMatrix m, FVector v) {
-		const __m256 doubleV = _mm256_set_m128(v, v);
-		const __m256 firstSecondRowDot = _mm256_dp_ps(m.doubleRows[0], doubleV, 0xF1);
-		const __m256 thirdFourthRowDot = _mm256_dp_ps(m.doubleRows[1], doubleV, 0xF1);
-
-		const __m128 firstRowDot = _mm256_extractf128_ps(firstSecondRowDot, 0x00);
-		const __m128 secondRowDot = _mm256_extractf128_ps(firstSecondRowDot, 0x01);
+		__m128 firstProducts = _mm_mul_ps(m.rows[0], v);
+		__m128 secondProducts = _mm_mul_ps(m.rows[1], v);
+		__m128 thirdProducts = _mm_mul_ps(m.rows[2], v);
+		__m128 fourthProducts = _mm_mul_ps(m.rows[3], v);
 
-		const __m128 thirdRowDot = _mm256_extractf128_ps(thirdFourthRowDot, 0x00);
-		const __m128 fourthRowDot = _mm256_extractf128_ps(thirdFourthRowDot, 0x01);
+		//the i-th lane of each register now holds a product of the i-th row's dot product
+		_MM_TRANSPOSE4_PS(firstProducts, secondProducts, thirdProducts, fourthProducts);
 
-		__m128 firstSecondRowDot_128 = _mm_shuffle_ps(firstRowDot, secondRowDot, 0x00);
-		__m128 thirdFourthRowDot_128 = _mm_shuffle_ps(thirdRowDot, fourthRowDot, 0x00);
-
-		firstSecondRowDot_128 = _mm_permutevar_ps(firstSecondRowDot_128, _mm_set_epi32(0x02, 0x00, 0x02, 0x00));
-		thirdFourthRowDot_128 = _mm_permutevar_ps(thirdFourthRowDot_128, _mm_set_epi32(0x02, 0x00, 0x02, 0x00));
-		
-		return _mm_shuffle_ps(firstSecondRowDot_128, thirdFourthRowDot_128, 0xE4); // 11 10 01 00
+		//the products are added in the same order as dotFV does
+		return _mm_add_ps(_mm_add_ps(firstProducts, secondProducts), _mm_add_ps(thirdProducts, fourthProducts));
 	}
 #else
 	inline FMatrix createFM(float r0c0, float r0c1, float r0c2, float r0c3,
@@ -0,0 +1,73 @@
+#ifndef SOFTRP_FQUAD_H_
+#define SOFTRP_FQUAD_H_
+#include "SoftRPDefs.h"
+#include "Vector.h"
+#include "SIMDInclude.h"
+
+namespace SoftRP {
+
+	/*
+	Types used to write batched pixel shaders (see PixelShader::shadeBatch) in structure-of-arrays form.
+	An FQuad holds a float for each of the 4 pixels of a quad, in the order of PSExecutionContext::interpolated:
+	an operation on FQuads computes the same expression for all the pixels at once. FQuadVector3 and FQuadVector4
+	are vectors whose components are FQuads, i.e. a vector for each pixel of a quad.
+	*/
+
+#ifdef SOFTRP_FMATH_SIMD
+	using FQuad = __m128;
+#else
+	using FQuad = Math::Vector4;
+#endif
+
+	struct FQuadVector3 {
+		FQuad x;
+		FQuad y;
+		FQuad z;
+	};
+
+	struct FQuadVector4 {
+		FQuad x;
+		FQuad y;
+		FQuad z;
+		FQuad w;
+	};
+
+	//lanes must be 16-byte aligned
+	FQuad loadFQ(const float* lanes);
+	void storeFQ(float* lanes, FQuad q);
+	FQuad splatFQ(float value);
+	FQuad addFQ(FQuad q1, FQuad q2);
+	FQuad subFQ(FQuad q1, FQuad q2);
+	FQuad mulFQ(FQuad q1, FQuad q2);
+	FQuad divFQ(FQuad q1, FQuad q2);
+	//q1*q2 + q3
+	FQuad madFQ(FQuad q1, FQuad q2, FQuad q3);
+	FQuad minFQ(FQuad q1, FQuad q2);
+	FQuad maxFQ(FQuad q1, FQuad q2);
+	//clamp to [0, 1]
+	FQuad saturateFQ(FQuad q);
+	FQuad sqrtFQ(FQuad q);
+
+	/*
+	load a vector whose components are stride floats apart, ex. the lanes of consecutive
+	components in a PSBatchContext
+	*/
+	FQuadVector3 loadFQV3(const float* lanes, size_t stride);
+	FQuadVector4 loadFQV4(const float* lanes, size_t stride);
+	FQuadVector3 splatFQV3(const Math::Vector3& v);
+	FQuadVector4 splatFQV4(const Math::Vector4& v);
+	FQuadVector3 addFQV3(const FQuadVector3& v1, const FQuadVector3& v2);
+	FQuadVector3 subFQV3(const FQuadVector3& v1, const FQuadVector3& v2);
+	FQuadVector3 scaleFQV3(const FQuadVector3& v, FQuad scale);
+	FQuad dotFQV3(const FQuadVector3& v1, const FQuadVector3& v2);
+	FQuadVector3 normalizeFQV3(const FQuadVector3& v);
+	FQuadVector4 addFQV4(const FQuadVector4& v1, const FQuadVector4& v2);
+	FQuadVector4 mulFQV4(const FQuadVector4& v1, const FQuadVector4& v2);
+	FQuadVector4 scaleFQV4(const FQuadVector4& v, FQuad scale);
+	//store the vector of each pixel to out[0]...out[3] (back to array-of-structures form)
+	void storeFQV4(Math::Vector4* out, const FQuadVector4& v);
+}
+
+#include "FQuadImpl.inl"
+
+#endif
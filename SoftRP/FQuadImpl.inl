@@ -0,0 +1,176 @@
+#ifndef SOFTRP_FQUAD_IMPL_INL_
+#define SOFTRP_FQUAD_IMPL_INL_
+#include "FQuad.h"
+#include <cmath>
+
+namespace SoftRP {
+
+#ifdef SOFTRP_FMATH_SIMD
+	inline FQuad loadFQ(const float* lanes) {
+		return _mm_load_ps(lanes);
+	}
+
+	inline void storeFQ(float* lanes, FQuad q) {
+		_mm_store_ps(lanes, q);
+	}
+
+	inline FQuad splatFQ(float value) {
+		return _mm_set_ps1(value);
+	}
+
+	inline FQuad addFQ(FQuad q1, FQuad q2) {
+		return _mm_add_ps(q1, q2);
+	}
+
+	inline FQuad subFQ(FQuad q1, FQuad q2) {
+		return _mm_sub_ps(q1, q2);
+	}
+
+	inline FQuad mulFQ(FQuad q1, FQuad q2) {
+		return _mm_mul_ps(q1, q2);
+	}
+
+	inline FQuad divFQ(FQuad q1, FQuad q2) {
+		return _mm_div_ps(q1, q2);
+	}
+
+	inline FQuad madFQ(FQuad q1, FQuad q2, FQuad q3) {
+		return _mm_add_ps(_mm_mul_ps(q1, q2), q3);
+	}
+
+	inline FQuad minFQ(FQuad q1, FQuad q2) {
+		return _mm_min_ps(q1, q2);
+	}
+
+	inline FQuad maxFQ(FQuad q1, FQuad q2) {
+		return _mm_max_ps(q1, q2);
+	}
+
+	inline FQuad saturateFQ(FQuad q) {
+		return _mm_min_ps(_mm_max_ps(q, _mm_setzero_ps()), _mm_set_ps1(1.0f));
+	}
+
+	inline FQuad sqrtFQ(FQuad q) {
+		return _mm_sqrt_ps(q);
+	}
+
+	inline void storeFQV4(Math::Vector4* out, const FQuadVector4& v) {
+		__m128 row0 = v.x;
+		__m128 row1 = v.y;
+		__m128 row2 = v.z;
+		__m128 row3 = v.w;
+		//after the transposition, the i-th row holds the components of the i-th pixel
+		_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+		_mm_storeu_ps(out[0].data(), row0);
+		_mm_storeu_ps(out[1].data(), row1);
+		_mm_storeu_ps(out[2].data(), row2);
+		_mm_storeu_ps(out[3].data(), row3);
+	}
+#else
+	inline FQuad loadFQ(const float* lanes) {
+		return Math::Vector4{ lanes[0], lanes[1], lanes[2], lanes[3] };
+	}
+
+	inline void storeFQ(float* lanes, FQuad q) {
+		for (unsigned int i = 0; i < 4; i++)
+			lanes[i] = q[i];
+	}
+
+	inline FQuad splatFQ(float value) {
+		return Math::Vector4{ value, value, value, value };
+	}
+
+	inline FQuad addFQ(FQuad q1, FQuad q2) {
+		return q1 + q2;
+	}
+
+	inline FQuad subFQ(FQuad q1, FQuad q2) {
+		return q1 - q2;
+	}
+
+	inline FQuad mulFQ(FQuad q1, FQuad q2) {
+		return q1 * q2;
+	}
+
+	inline FQuad divFQ(FQuad q1, FQuad q2) {
+		return q1 / q2;
+	}
+
+	inline FQuad madFQ(FQuad q1, FQuad q2, FQuad q3) {
+		return q1 * q2 + q3;
+	}
+
+	inline FQuad minFQ(FQuad q1, FQuad q2) {
+		return Math::min(q1, q2);
+	}
+
+	inline FQuad maxFQ(FQuad q1, FQuad q2) {
+		return Math::max(q1, q2);
+	}
+
+	inline FQuad saturateFQ(FQuad q) {
+		return Math::min(Math::max(q, splatFQ(0.0f)), splatFQ(1.0f));
+	}
+
+	inline FQuad sqrtFQ(FQuad q) {
+		for (unsigned int i = 0; i < 4; i++)
+			q[i] = std::sqrt(q[i]);
+		return q;
+	}
+
+	inline void storeFQV4(Math::Vector4* out, const FQuadVector4& v) {
+		for (unsigned int i = 0; i < 4; i++)
+			out[i] = Math::Vector4{ v.x[i], v.y[i], v.z[i], v.w[i] };
+	}
+#endif
+
+	inline FQuadVector3 loadFQV3(const float* lanes, size_t stride) {
+		return FQuadVector3{ loadFQ(lanes), loadFQ(lanes + stride), loadFQ(lanes + 2 * stride) };
+	}
+
+	inline FQuadVector4 loadFQV4(const float* lanes, size_t stride) {
+		return FQuadVector4{ loadFQ(lanes), loadFQ(lanes + stride), loadFQ(lanes + 2 * stride), loadFQ(lanes + 3 * stride) };
+	}
+
+	inline FQuadVector3 splatFQV3(const Math::Vector3& v) {
+		return FQuadVector3{ splatFQ(v[0]), splatFQ(v[1]), splatFQ(v[2]) };
+	}
+
+	inline FQuadVector4 splatFQV4(const Math::Vector4& v) {
+		return FQuadVector4{ splatFQ(v[0]), splatFQ(v[1]), splatFQ(v[2]), splatFQ(v[3]) };
+	}
+
+	inline FQuadVector3 addFQV3(const FQuadVector3& v1, const FQuadVector3& v2) {
+		return FQuadVector3{ addFQ(v1.x, v2.x), addFQ(v1.y, v2.y), addFQ(v1.z, v2.z) };
+	}
+
+	inline FQuadVector3 subFQV3(const FQuadVector3& v1, const FQuadVector3& v2) {
+		return FQuadVector3{ subFQ(v1.x, v2.x), subFQ(v1.y, v2.y), subFQ(v1.z, v2.z) };
+	}
+
+	inline FQuadVector3 scaleFQV3(const FQuadVector3& v, FQuad scale) {
+		return FQuadVector3{ mulFQ(v.x, scale), mulFQ(v.y, scale), mulFQ(v.z, scale) };
+	}
+
+	inline FQuad dotFQV3(const FQuadVector3& v1, const FQuadVector3& v2) {
+		return madFQ(v1.z, v2.z, madFQ(v1.y, v2.y, mulFQ(v1.x, v2.x)));
+	}
+
+	inline FQuadVector3 normalizeFQV3(const FQuadVector3& v) {
+		return scaleFQV3(v, divFQ(splatFQ(1.0f), sqrtFQ(dotFQV3(v, v))));
+	}
+
+	inline FQuadVector4 addFQV4(const FQuadVector4& v1, const FQuadVector4& v2) {
+		return FQuadVector4{ addFQ(v1.x, v2.x), addFQ(v1.y, v2.y), addFQ(v1.z, v2.z), addFQ(v1.w, v2.w) };
+	}
+
+	inline FQuadVector4 mulFQV4(const FQuadVector4& v1, const FQuadVector4& v2) {
+		return FQuadVector4{ mulFQ(v1.x, v2.x), mulFQ(v1.y, v2.y), mulFQ(v1.z, v2.z), mulFQ(v1.w, v2.w) };
+	}
+
+	inline FQuadVector4 scaleFQV4(const FQuadVector4& v, FQuad scale) {
+		return FQuadVector4{ mulFQ(v.x, scale), mulFQ(v.y, scale), mulFQ(v.z, scale), mulFQ(v.w, scale) };
+	}
+}
+
+#endif
@@ -7,80 +7,54 @@ namespace SoftRP {
 
 #ifdef SOFTRP_FMATH_SIMD
 	inline float getXFV(FVector v) {	
-		return v.m128_f32[0];
+		return laneF32(v, 0);
 		/*return static_cast<float>(_mm_extract_ps(v, 0));*/
 	}
 
 	inline float getYFV(FVector v) {
 		/*return static_cast<float>(_mm_extract_ps(v, 1));*/
-		return v.m128_f32[1];
+		return laneF32(v, 1);
 	}
 
 	inline float getZFV(FVector v) {
 		/*return static_cast<float>(_mm_extract_ps(v, 2));*/
-		return v.m128_f32[2];
+		return laneF32(v, 2);
 	}
 
 	inline float getWFV(FVector v) {
 		/*return static_cast<float>(_mm_extract_ps(v, 3));*/
-		return v.m128_f32[3];
+		return laneF32(v, 3);
 	}
 
 	inline float get(FVector v, unsigned int i) {
-		return v.m128_f32[i];		
+		return laneF32(v, i);		
 	}	
 
 	inline FVector setXFV(FVector in, float x) {
-		__m128 xVec = _mm_set_ps1(x);
-		/*
-		0xC0 == 11 00 0000:
-		11 : the fourth component of xVec is taken
-		00 : "in"'s components are copied except for the first one, 
-			 which is replaced by the one taken as explained above
-		0000 : all components are inserted in the result
-		*/
-		return _mm_insert_ps(in, xVec, 0xC0);
+		return _mm_move_ss(in, _mm_set_ss(x));
 	}
 
 	inline FVector setYFV(FVector in, float y) {
 		__m128 yVec = _mm_set_ps1(y);
-		/*
-		0xD0 == 11 01 0000:
-		11 : the fourth component of yVec is taken
-		01 : "in"'s components are copied except for the second one,
-		which is replaced by the one taken as explained above
-		0000 : all components are inserted in the result
-		*/
-		return _mm_insert_ps(in, yVec, 0xD0);
+		//(in.x, y, in.y, y), of which the first two components are taken, followed by in.z and in.w
+		return _mm_shuffle_ps(_mm_unpacklo_ps(in, yVec), in, 0xE4); // 11 10 01 00
 	}
 
 	inline FVector setZFV(FVector in, float z) {
 		__m128 zVec = _mm_set_ps1(z);
-		/*
-		0xE0 == 11 10 0000:
-		11 : the fourth component of zVec is taken
-		10 : "in"'s components are copied except for the third one,
-		which is replaced by the one taken as explained above
-		0000 : all components are inserted in the result
-		*/
-		return _mm_insert_ps(in, zVec, 0xE0);
+		//in.x and in.y, followed by the first and last components of (z, in.z, z, in.w)
+		return _mm_shuffle_ps(in, _mm_unpackhi_ps(zVec, in), 0xC4); // 11 00 01 00
 	}
 
 	inline FVector setWFV(FVector in, float w) {
 		__m128 wVec = _mm_set_ps1(w);
-		/*
-		0xF0 == 11 11 0000:
-		11 : the fourth component of wVec is taken
-		11 : "in"'s components are copied except for the fourth one,
-		which is replaced by the one taken as explained above
-		0000 : all components are inserted in the result
-		*/
-		return _mm_insert_ps(in, wVec, 0xF0);
+		//in.x and in.y, followed by the first two components of (in.z, w, in.w, w)
+		return _mm_shuffle_ps(in, _mm_unpackhi_ps(in, wVec), 0x44); // 01 00 01 00
 	}
 		
 	inline FVector set(FVector v, unsigned int i, float value) {
 		FVector res = v;
-		res.m128_f32[i] = value;
+		setLaneF32(res, i, value);
 		return res;
 	}
 
@@ -94,14 +68,14 @@ namespace SoftRP {
 		unsigned int i = 0;
 		__m128 val;
 		for (float v : init)
-			val.m128_f32[i++] = v;
+			setLaneF32(val, i++, v);
 		return val;
 	}
 	
 	inline FVector createFV(float(&data)[4]) {
 		__m128 val;
 		for (unsigned int i = 0; i < 4; i++)
-			val.m128_f32[i] = data[i];
+			setLaneF32(val, i, data[i]);
 		return val;
 	}
 	
@@ -113,7 +87,7 @@ namespace SoftRP {
 		__m128 val;
 		unsigned int i = 0;
 		while (beg != end) {
-			val.m128_f32[i] = *beg;
+			setLaneF32(val, i, *beg);
 			i++;
 			beg++;
 		}
@@ -158,11 +132,17 @@ namespace SoftRP {
 	}
 
 	inline FVector dotReplicateFV(FVector v1, FVector v2) {
-		return _mm_dp_ps(v1, v2, 0xFF);
+		/*
+		add the products of the first and second components and of the third and fourth ones, then the two sums:
+		this is the order of SSE4.1's _mm_dp_ps, which is not available on every host
+		*/
+		const __m128 products = _mm_mul_ps(v1, v2);
+		const __m128 pairSums = _mm_add_ps(products, _mm_shuffle_ps(products, products, 0xB1)); // 10 11 00 01
+		return _mm_add_ps(pairSums, _mm_shuffle_ps(pairSums, pairSums, 0x4E)); // 01 00 11 10
 	}
 		
 	inline float dotFV(FVector v1, FVector v2) {
-		return _mm_dp_ps(v1, v2, 0xF1).m128_f32[0];
+		return _mm_cvtss_f32(dotReplicateFV(v1, v2));
 	}
 	
 	inline FVector minFV(FVector v1, FVector v2) {
@@ -170,7 +150,7 @@ namespace SoftRP {
 		//TODO : improve
 		__m128 res;
 		for (unsigned int i = 0; i < 4; i++)
-			res.m128_f32[i] = comp.m128_i32[i] ? v1.m128_f32[i] : v2.m128_f32[i];
+			setLaneF32(res, i, laneI32(comp, i) ? laneF32(v1, i) : laneF32(v2, i));
 		return res;		
 	}
 
@@ -179,7 +159,7 @@ namespace SoftRP {
 		//TODO : improve
 		__m128 res;
 		for (unsigned int i = 0; i < 4; i++)
-			res.m128_f32[i] = comp.m128_i32[i] ? v1.m128_f32[i] : v2.m128_f32[i];
+			setLaneF32(res, i, laneI32(comp, i) ? laneF32(v1, i) : laneF32(v2, i));
 		return res;
 	}
 	
@@ -198,7 +178,7 @@ namespace SoftRP {
 
 	inline float lengthFV(FVector v) {
 		const float squaredLength = dotFV(v, v);
-		return std::sqrtf(squaredLength);
+		return std::sqrt(squaredLength);
 	}
 
 	inline FVector normalizeFV(FVector v) {
@@ -211,11 +191,11 @@ namespace SoftRP {
 	//assuming v1.w == v2.w == 1.0f
 	inline FVector cross3FV(FVector v1, FVector v2) {
 		//temp = (w, z, y, x) = (1, v2y, v2x, v2z)
-		__m128 temp = _mm_set_ps(1.0f, v2.m128_f32[1], v2.m128_f32[0], v2.m128_f32[2]);
+		__m128 temp = _mm_set_ps(1.0f, laneF32(v2, 1), laneF32(v2, 0), laneF32(v2, 2));
 		//temp = (x, y, z, w) = (v1x*v2z, v1y*v2x, v1z*v2y, 1)
 		temp = _mm_mul_ps(v1, temp);
 		//temp1 = (w, z, y, x) = (2, v2x, v2z, v2y)
-		__m128 temp1 = _mm_set_ps(2.0f, v2.m128_f32[0], v2.m128_f32[2], v2.m128_f32[1]);
+		__m128 temp1 = _mm_set_ps(2.0f, laneF32(v2, 0), laneF32(v2, 2), laneF32(v2, 1));
 		//temp1 = (x, y, z, w) = (v1x*v2y, v1y*v2z, v1z*v2x, 2)
 		temp1 = _mm_mul_ps(v1, temp1);
 
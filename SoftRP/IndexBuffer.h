@@ -7,5 +7,10 @@ namespace SoftRP {
 	Specialization of Buffer which provides storage for index data.
 	*/
 	using IndexBuffer = Buffer<uint64_t>;	
+	/*
+	Specializations of Buffer which provide storage for smaller indices, reducing the memory read by the draw calls.
+	*/
+	using IndexBuffer32 = Buffer<uint32_t>;
+	using IndexBuffer16 = Buffer<uint16_t>;
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef SOFTRP_INLINE_TASK_H_
+#define SOFTRP_INLINE_TASK_H_
+#include <cstddef>
+#include <type_traits>
+namespace SoftRP {
+
+	/*
+	Concrete data type which represents a callable object without arguments and return value, as
+	std::function<void(void)>. The callable is stored in a buffer of INLINE_CAPACITY bytes of the InlineTask
+	itself, so that no memory is allocated per task submitted to a ThreadPool, as long as the callable fits
+	in it: the tasks should capture pointers to the data they need, rather than the data. Callables which don't
+	fit, or which could throw when moved, are allocated on the heap instead.
+	An InlineTask can't be copied, so that callables which can only be moved can be stored as well.
+	*/
+	class InlineTask {
+	public:
+		//the callable and the pointer to its operations fill a cache line
+		static constexpr size_t INLINE_CAPACITY = 64 - sizeof(void*);
+
+		InlineTask() = default;
+		InlineTask(std::nullptr_t);
+		template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineTask>::value>::type>
+		InlineTask(F&& function);
+		~InlineTask();
+
+		//copy
+		InlineTask(const InlineTask&) = delete;
+		InlineTask& operator=(const InlineTask&) = delete;
+
+		//move
+		InlineTask(InlineTask&& other) noexcept;
+		InlineTask& operator=(InlineTask&& other) noexcept;
+
+		//destroy the callable stored, if any
+		InlineTask& operator=(std::nullptr_t);
+
+		//invoke the callable stored, which must not be empty
+		void operator()();
+
+		//is a callable stored?
+		explicit operator bool()const;
+
+		//is a callable of type F stored inline, without allocating memory?
+		template<typename F>
+		static constexpr bool isStoredInline();
+
+	private:
+
+		struct Operations {
+			void(*invoke)(void* storage);
+			//move construct the callable of src in dst, then destroy the one of src
+			void(*relocate)(void* dst, void* src);
+			void(*destroy)(void* storage);
+		};
+		//the operations on a callable stored in m_storage, or on a pointer to it
+		template<typename F>
+		struct InlineOperations;
+		template<typename F>
+		struct HeapOperations;
+
+		template<typename F, typename G>
+		void construct(G&& function, std::true_type storedInline);
+		template<typename F, typename G>
+		void construct(G&& function, std::false_type storedInline);
+		void reset();
+
+		alignas(std::max_align_t) unsigned char m_storage[INLINE_CAPACITY];
+		const Operations* m_operations{ nullptr };
+	};
+}
+#include "InlineTaskImpl.inl"
+#endif
@@ -0,0 +1,115 @@
+#ifndef SOFTRP_INLINE_TASK_IMPL_INL_
+#define SOFTRP_INLINE_TASK_IMPL_INL_
+#include "InlineTask.h"
+#include <new>
+#include <utility>
+namespace SoftRP {
+
+	template<typename F>
+	struct InlineTask::InlineOperations {
+		static void invoke(void* storage) {
+			(*static_cast<F*>(storage))();
+		}
+		static void relocate(void* dst, void* src) {
+			F* function = static_cast<F*>(src);
+			new (dst) F{ std::move(*function) };
+			function->~F();
+		}
+		static void destroy(void* storage) {
+			static_cast<F*>(storage)->~F();
+		}
+		static const Operations operations;
+	};
+
+	template<typename F>
+	const InlineTask::Operations InlineTask::InlineOperations<F>::operations{ &invoke, &relocate, &destroy };
+
+	template<typename F>
+	struct InlineTask::HeapOperations {
+		static void invoke(void* storage) {
+			(**static_cast<F**>(storage))();
+		}
+		static void relocate(void* dst, void* src) {
+			*static_cast<F**>(dst) = *static_cast<F**>(src);
+		}
+		static void destroy(void* storage) {
+			delete *static_cast<F**>(storage);
+		}
+		static const Operations operations;
+	};
+
+	template<typename F>
+	const InlineTask::Operations InlineTask::HeapOperations<F>::operations{ &invoke, &relocate, &destroy };
+
+	inline InlineTask::InlineTask(std::nullptr_t) {
+	}
+
+	template<typename F, typename>
+	inline InlineTask::InlineTask(F&& function) {
+		using Callable = typename std::decay<F>::type;
+		construct<Callable>(std::forward<F>(function), std::integral_constant<bool, isStoredInline<Callable>()>{});
+	}
+
+	inline InlineTask::~InlineTask() {
+		reset();
+	}
+
+	inline InlineTask::InlineTask(InlineTask&& other) noexcept : m_operations{ other.m_operations } {
+		if (m_operations) {
+			m_operations->relocate(m_storage, other.m_storage);
+			other.m_operations = nullptr;
+		}
+	}
+
+	inline InlineTask& InlineTask::operator=(InlineTask&& other) noexcept {
+		if (this != &other) {
+			reset();
+			m_operations = other.m_operations;
+			if (m_operations) {
+				m_operations->relocate(m_storage, other.m_storage);
+				other.m_operations = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	inline InlineTask& InlineTask::operator=(std::nullptr_t) {
+		reset();
+		return *this;
+	}
+
+	inline void InlineTask::operator()() {
+		m_operations->invoke(m_storage);
+	}
+
+	inline InlineTask::operator bool()const {
+		return m_operations != nullptr;
+	}
+
+	template<typename F>
+	inline constexpr bool InlineTask::isStoredInline() {
+		//relocate is noexcept for the callables stored inline, as the moves of InlineTask
+		return sizeof(F) <= INLINE_CAPACITY && alignof(F) <= alignof(std::max_align_t) &&
+			std::is_nothrow_move_constructible<F>::value;
+	}
+
+	template<typename F, typename G>
+	inline void InlineTask::construct(G&& function, std::true_type) {
+		new (m_storage) F{ std::forward<G>(function) };
+		m_operations = &InlineOperations<F>::operations;
+	}
+
+	template<typename F, typename G>
+	inline void InlineTask::construct(G&& function, std::false_type) {
+		*reinterpret_cast<F**>(m_storage) = new F{ std::forward<G>(function) };
+		m_operations = &HeapOperations<F>::operations;
+	}
+
+	inline void InlineTask::reset() {
+		if (m_operations) {
+			m_operations->destroy(m_storage);
+			m_operations = nullptr;
+		}
+	}
+}
+#endif
@@ -10,8 +10,8 @@ namespace SoftRP {
 		const float u = textCoords[0] * width -0.5f;
 		const float v = textCoords[1] * height -0.5f;
 				
-		const float floorU = std::floorf(u);
-		const float floorV = std::floorf(v);
+		const float floorU = std::floor(u);
+		const float floorV = std::floor(v);
 
 		const float fracU = u - floorU;
 		const float fracV = v - floorV;
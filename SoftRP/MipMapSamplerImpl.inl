@@ -12,7 +12,7 @@ namespace SoftRP {
 
 	template<typename InMipMapSampler>
 	inline Math::Vector4 MipMapSampler<InMipMapSampler>::sample(const Texture2D<Math::Vector4>& texture, const Math::Vector2& textCoords, float LOD) const {
-		const unsigned int mipMapLevel = std::min(static_cast<unsigned int>(std::ceilf(LOD + 0.5f)) - 1, texture.maxMipLevel());
+		const unsigned int mipMapLevel = std::min(static_cast<unsigned int>(std::ceil(LOD + 0.5f)) - 1, texture.maxMipLevel());
 		return InMipMapSampler::sample(texture, textCoords, mipMapLevel);
 	}
 
@@ -35,7 +35,7 @@ namespace SoftRP {
 		Math::Vector4 v0 = InMipMapSampler::sample(texture, textCoords, mipMapLevel1);
 		Math::Vector4 v1 = InMipMapSampler::sample(texture, textCoords, mipMapLevel2);
 
-		return v0.lerp(LOD - std::floorf(LOD), v1);
+		return v0.lerp(LOD - std::floor(LOD), v1);
 	}
 }
 #endif
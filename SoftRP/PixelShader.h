@@ -16,6 +16,30 @@ namespace SoftRP {
 		Vertex interpolated[4];
 	};
 
+	/*
+	Concrete data type which represents the context of a batched pixel shader's invocation (see 
+	PixelShader::shadeBatch): quadCount 2x2 pixel blocks, each with its mask as in PSExecutionContext.
+	The interpolated vertices are given in structure-of-arrays form: the c-th float of the vertex data is 
+	an array of LANES floats, 4 per quad, in which the pixel k of the quad q is at 4*q + k. The pixels 
+	of a quad are ordered as in PSExecutionContext and each quad's floats are 16-byte aligned.
+	*/
+	struct PSBatchContext {
+		static constexpr size_t MAX_QUADS = 16;
+		static constexpr size_t LANES = 4 * MAX_QUADS;
+
+		//the c-th float of the vertex data of all the pixels
+		const float* component(size_t c) const;
+		//the c-th float of the vertexFieldIndex-th field of all the pixels
+		const float* fieldComponent(size_t vertexFieldIndex, size_t c) const;
+
+		size_t quadCount;
+		int masks[MAX_QUADS];
+		const float* data;
+		VertexLayout* vertexLayout;
+		//storage for the vertex data of 4 vertices of vertexLayout, which shadeBatch can use as it needs
+		float* scratch;
+	};
+
 	/*
 	Abstract data type which represents a pixel shader.
 	*/
@@ -28,6 +52,17 @@ namespace SoftRP {
 								 const PSExecutionContext& psec, 
 								 size_t instance, Math::Vector4* out) const = 0;
 
+		/*
+		shade all the quads of psbc, writing the color of the pixel k of the quad q to out[4*q + k].
+		It is used by the Rasterizers instead of operator() if batched() returns true, which avoids a call 
+		per quad and lets the implementation work on many pixels at once (see FQuad.h).
+		The default implementation invokes operator() on each quad.
+		*/
+		virtual void shadeBatch(const ShaderContext& sc,
+								const PSBatchContext& psbc,
+								size_t instance, Math::Vector4* out) const;
+		virtual bool batched() const;
+
 		static void computeDDXDDY(const PSExecutionContext& psec, size_t fieldIndex, Math::Vector4* out);
 		static unsigned int getDDXIndex(unsigned int pixelIndex);
 		static unsigned int getDDYIndex(unsigned int pixelIndex);
@@ -4,6 +4,40 @@
 #include "SIMDInclude.h"
 namespace SoftRP {
 
+	inline const float* PSBatchContext::component(size_t c) const {
+		return data + c*LANES;
+	}
+
+	inline const float* PSBatchContext::fieldComponent(size_t vertexFieldIndex, size_t c) const {
+		//the offset of the field in the vertex data is the index of its first float
+		const size_t offset = static_cast<size_t>(vertexLayout->getVertexFieldData(data, vertexFieldIndex) - data);
+		return component(offset + c);
+	}
+
+	inline void PixelShader::shadeBatch(const ShaderContext& sc, const PSBatchContext& psbc, 
+										size_t instance, Math::Vector4* out) const {
+		const size_t vertexStride = psbc.vertexLayout->vertexStride();
+		float* vertexData = psbc.scratch;
+		PSExecutionContext execContext{};
+		for (unsigned int k = 0; k < 4; k++)
+			execContext.interpolated[k].setVertexData(vertexData + k*vertexStride, psbc.vertexLayout);
+
+		//gather each quad's vertices and shade them as usual
+		for (size_t q = 0; q < psbc.quadCount; q++) {
+			for (size_t c = 0; c < vertexStride; c++) {
+				const float* lanes = psbc.component(c) + 4 * q;
+				for (unsigned int k = 0; k < 4; k++)
+					vertexData[k*vertexStride + c] = lanes[k];
+			}
+			execContext.mask = psbc.masks[q];
+			(*this)(sc, execContext, instance, out + 4 * q);
+		}
+	}
+
+	inline bool PixelShader::batched() const {
+		return false;
+	}
+
 	inline void PixelShader::computeDDXDDY(const PSExecutionContext& psec, size_t fieldIndex, Math::Vector4* out) {
 #ifdef SOFTRP_USE_SIMD
 
@@ -11,19 +45,14 @@ namespace SoftRP {
 		const __m128 field1 = _mm_load_ps(psec.interpolated[1].getField(fieldIndex));
 		const __m128 field2 = _mm_load_ps(psec.interpolated[2].getField(fieldIndex));
 		const __m128 field3 = _mm_load_ps(psec.interpolated[3].getField(fieldIndex));
-		const __m256 field02 = _mm256_set_m128(field0, field2);
-		const __m256 field13 = _mm256_set_m128(field1, field3);
 
 		// df/dx with backward differencing
-		const __m256 dfdx = _mm256_sub_ps(field02, field13);
-		_mm256_storeu2_m128(out[0].data(), out[1].data(), dfdx);
-
-		const __m256 field01 = _mm256_set_m128(field0, field1);
-		const __m256 field23 = _mm256_set_m128(field2, field3);
+		_mm_storeu_ps(out[0].data(), _mm_sub_ps(field0, field1));
+		_mm_storeu_ps(out[1].data(), _mm_sub_ps(field2, field3));
 
 		// df/dy with backward differencing
-		const __m256 dfdy = _mm256_sub_ps(field01, field23);
-		_mm256_storeu2_m128(out[2].data(), out[3].data(), dfdy);
+		_mm_storeu_ps(out[2].data(), _mm_sub_ps(field0, field2));
+		_mm_storeu_ps(out[3].data(), _mm_sub_ps(field1, field3));
 
 #else
 		const Math::Vector4& field0 = *Math::vectorFromPtr<4>(psec.interpolated[0].getField(fieldIndex));
@@ -12,14 +12,8 @@ namespace SoftRP {
 		PositionVertexShader() = default;
 		virtual ~PositionVertexShader() = default;
 				
-#ifdef SOFTRP_MULTI_THREAD		 
-		virtual	ThreadPool::Fence operator()(const ShaderContext& sc,
-										const Vertex* input, Vertex* output, size_t vertexCount, size_t instance, 
-										 ThreadPool& threadPool) const override;
-#else
-		virtual void operator()(const ShaderContext& sc,
-							const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const override;
-#endif
+		virtual void shadeBatch(const ShaderContext& sc,
+								const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const override;
 	protected:
 		PositionVertexShader(const PositionVertexShader&) = delete;
 		PositionVertexShader(PositionVertexShader&&) = delete;
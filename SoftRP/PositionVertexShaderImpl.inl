@@ -5,23 +5,13 @@
 #include "FMatrix.h"
 #include "FVector.h"
 namespace SoftRP {
-#ifdef SOFTRP_MULTI_THREAD		 
-	inline ThreadPool::Fence PositionVertexShader::operator()(const ShaderContext& sc,
-															  const Vertex* input, Vertex* output, size_t vertexCount, size_t instance,
-															  ThreadPool& threadPool) const
-#else
-	inline void PositionVertexShader::operator()(const ShaderContext& sc,
-												 const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const
-#endif
+	inline void PositionVertexShader::shadeBatch(const ShaderContext& sc,
+												const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const
 	{
-		const Math::Matrix4* projViewWorld = sc.constantBuffers()[0]->getField(0, instance).asMatrix4();
+		const Math::Matrix4* projViewWorld = sc.constantBufferField(0, 0, instance).asMatrix4();
 		const FMatrix fprojViewWorld = createFM(*projViewWorld);
 		for (size_t i = 0; i < vertexCount; i++, input++, output++)
 			output->position() = createVector4FV(mulFM(fprojViewWorld, createFV(input->position())));
-
-#ifdef SOFTRP_MULTI_THREAD
-		return threadPool.currFence();
-#endif
 	}
 
 }
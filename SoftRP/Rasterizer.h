@@ -5,6 +5,7 @@
 #include "ViewPort.h"
 #include "PixelShader.h"
 #include "DepthBuffer.h"
+#include "VisibilityBuffer.h"
 #include "Vertex.h"
 #include "ShaderContext.h"
 #include <vector>
@@ -16,12 +17,16 @@ namespace SoftRP {
 	/*
 	Abstract data type which represents a primitive rasterizer.	
 	The primitives are expected to be inside the canonical view volume and expressed in Clip space (see Clipper), i.e. the 
-	clipping operation has already been performed. 
+	clipping operation has already been performed. Rasterizers which support a guard band accept primitives inside 
+	the clipping volume enlarged by it, and discard the pixels outside the ViewPort.
 	First of all, primitives are transformed to Screen space with the perspective divide and the transformation defined 
 	by the ViewPort provided, then the primitives are rasterized on the RenderTarget provided.
 	Lastly, the PixelShader is invoked on a 2x2 pixel area-basis to support derivative calculations. An invokation is made 
 	if at least one pixel of the block is produced by the rasterization and it is found to pass the depth-test. 
 	The invokation is always supplied with the vertices' attributes	interpolated at the pixels' centers.
+	If a VisibilityBuffer is set, the PixelShader is not invoked: the pixels which pass the depth-test are written 
+	to the VisibilityBuffer instead, with the draw id set along with it and the index of the triangle in the list 
+	being rasterized.
 	*/
 
 	class Rasterizer{
@@ -38,12 +43,32 @@ namespace SoftRP {
 		passed in can't be modified.
 		*/
 #ifdef SOFTRP_MULTI_THREAD
-		virtual ThreadPool::Fence rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint64_t>& indices,
+		virtual ThreadPool::Fence rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
 													 size_t instance, ThreadPool& threadPool) = 0;
 #else
-		virtual void rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint64_t>& indices,
+		virtual void rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
 										size_t instance) = 0;
 #endif
+
+		//the instance and the ShaderContext which a group of triangles is shaded with
+		struct TriangleGroup {
+			size_t instance;
+			const ShaderContext* shaderContext;
+		};
+
+		/*
+		As rasterizeTriangles, for triangles of several instances or draws sharing the other state: the i-th 
+		triangle is shaded with the instance and the ShaderContext of groups[groupIds[i]], rather than with the 
+		ShaderContext set.
+		*/
+#ifdef SOFTRP_MULTI_THREAD
+		virtual ThreadPool::Fence rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+													 const std::vector<uint32_t>& groupIds, const std::vector<TriangleGroup>& groups,
+													 ThreadPool& threadPool) = 0;
+#else
+		virtual void rasterizeTriangles(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+										const std::vector<uint32_t>& groupIds, const std::vector<TriangleGroup>& groups) = 0;
+#endif
 		
 		/* setters */
 		virtual void setRenderTarget(RenderTarget* renderTarget);
@@ -51,6 +76,8 @@ namespace SoftRP {
 		virtual void setDepthBuffer(DepthBuffer* depthBuffer);
 		virtual void setPixelShader(const PixelShader* pixelShader);
 		virtual void setShaderContext(const ShaderContext* shaderContext);
+		//a null visibilityBuffer restores the invokation of the PixelShader
+		virtual void setVisibilityBuffer(VisibilityBuffer* visibilityBuffer, uint32_t drawId = 0);
 
 		/* getters */
 		RenderTarget* renderTarget() const;
@@ -58,6 +85,15 @@ namespace SoftRP {
 		DepthBuffer* depthBuffer()const;
 		const PixelShader* pixelShader()const;
 		const ShaderContext* shaderContext()const;
+		VisibilityBuffer* visibilityBuffer()const;
+		uint32_t drawId()const;
+
+		/*
+		Get the guard band factors (see Clipper::setGuardBand) supported with the ViewPort and RenderTarget set, i.e. how 
+		much primitives are allowed to exceed the canonical view volume along the x and y axes. 
+		The default implementation returns {1, 1}: no guard band is supported.
+		*/
+		virtual Math::Vector2 guardBand() const;
 
 	protected:
 		Rasterizer(const Rasterizer&) = delete;
@@ -68,6 +104,7 @@ namespace SoftRP {
 		//perform depth test and update DepthBuffer with the new value
 		virtual bool depthTest(unsigned int i, unsigned int j, float compare);
 		virtual void writePixel(unsigned int i, unsigned int j, Math::Vector4 data);
+		virtual void writeVisibility(unsigned int i, unsigned int j, uint32_t primitiveId);
 		
 	private:
 		RenderTarget* m_renderTarget{nullptr};
@@ -75,6 +112,8 @@ namespace SoftRP {
 		DepthBuffer* m_depthBuffer{ nullptr };
 		const PixelShader* m_pixelShader{ nullptr };
 		const ShaderContext* m_shaderContext{ nullptr };
+		VisibilityBuffer* m_visibilityBuffer{ nullptr };
+		uint32_t m_drawId{ 0 };
 	};
 
 	/*
@@ -9,11 +9,19 @@ namespace SoftRP {
 	inline void Rasterizer::setPixelShader(const PixelShader* pixelShader) { m_pixelShader = pixelShader; }
 	inline void Rasterizer::setShaderContext(const ShaderContext* shaderContext) { m_shaderContext = shaderContext; }
 
+	inline void Rasterizer::setVisibilityBuffer(VisibilityBuffer* visibilityBuffer, uint32_t drawId) {
+		m_visibilityBuffer = visibilityBuffer;
+		m_drawId = drawId;
+	}
+
 	inline RenderTarget* Rasterizer::renderTarget() const { return m_renderTarget; }
 	inline const ViewPort* Rasterizer::viewPort() const { return m_viewPort; }
 	inline DepthBuffer* Rasterizer::depthBuffer() const { return m_depthBuffer; }
 	inline const PixelShader* Rasterizer::pixelShader() const { return m_pixelShader; }
 	inline const ShaderContext* Rasterizer::shaderContext() const { return m_shaderContext; }
+	inline VisibilityBuffer* Rasterizer::visibilityBuffer() const { return m_visibilityBuffer; }
+	inline uint32_t Rasterizer::drawId() const { return m_drawId; }
+	inline Math::Vector2 Rasterizer::guardBand() const { return Math::Vector2{ 1.0f, 1.0f }; }
 
 	inline bool Rasterizer::depthTest(unsigned int i, unsigned int j, float compare) {
 		float currDepth = m_depthBuffer->get(i, j);
@@ -27,5 +35,9 @@ namespace SoftRP {
 	inline void Rasterizer::writePixel(unsigned int i, unsigned int j, Math::Vector4 data) {
 		m_renderTarget->set(i, j, data);
 	}
+
+	inline void Rasterizer::writeVisibility(unsigned int i, unsigned int j, uint32_t primitiveId) {
+		m_visibilityBuffer->set(i, j, VisibilitySample{ m_drawId, primitiveId });
+	}
 }
 #endif
@@ -5,6 +5,7 @@
 #include "VertexBuffer.h"
 #include "IndexBuffer.h"
 #include "DepthBuffer.h"
+#include "VisibilityBuffer.h"
 #include "Vertex.h"
 #include "ConstantBuffer.h"
 #include "TextureUnit.h"
@@ -18,6 +19,9 @@ namespace SoftRP {
 		
 	/*
 	Concrete data type which implements access to and use of the rendering pipeline.
+	If a VisibilityBuffer is set, draw calls don't shade the pixels: they only write, along with the depth values, 
+	which primitive is visible at each pixel. The visible pixels are shaded once by resolveVisibility, so the shading 
+	cost doesn't depend on the overdraw.
 	*/
 	class Renderer {
 	public:
@@ -25,19 +29,33 @@ namespace SoftRP {
 		/*
 		ctor. construct a Renderer which uses the Clipper and Rasterizer's implementations provided 
 		by the factory objects passed in. These objects must outlive the Renderer instance.
-		In the multithreaded version, each of the *ThreadsCount parameters is used to construct a ThreadPool 
-		that will be used for the task suggested by the parameter's name.
+		In the multithreaded version, the vertex shading, the clipping and the rasterization are executed by the 
+		TaskConsumers of threadPool, which must outlive the Renderer, or of sharedThreadPool() if it is null. 
+		The rasterization takes precedence over the clipping, which takes precedence over the vertex shading, 
+		so that the draws in flight are completed before the next ones are started. 
+		A draw call is a chain of tasks, executed by the same TaskConsumers, each one submitting the work of a stage 
+		and the task which continues the draw once it has been completed, so that no thread waits for a stage.
+		A draw call is started once the rasterization of all but the last maxDrawsInFlight - 1 draw calls made 
+		before has been completed, counting each batch of instances (see multiDrawIndexed) as a draw call, which 
+		bounds the memory in use.
 		*/
 #ifdef SOFTRP_MULTI_THREAD
 		Renderer(const ClipperFactory& clipperFactory, const RasterizerFactory& rasterizerFactory,
-				 size_t drawingThreadsCount = 4, size_t clippingThreadsCount = 16, 
-				 size_t rasterizingThreadsCount = 16, size_t vertexShaderThreadsCount = 1);
+				 ThreadPool* threadPool = nullptr, size_t maxDrawsInFlight = 4);
 #else
 		Renderer(const ClipperFactory& clipperFactory, const RasterizerFactory& rasterizerFactory);
 #endif
 		
-		//dtor
-		~Renderer() = default;
+		//dtor. wait for the draw calls in flight
+		~Renderer();
+
+#ifdef SOFTRP_MULTI_THREAD
+		/*
+		the ThreadPool shared by the Renderers constructed without one, created on first use with a 
+		TaskConsumer per logical processor of the host
+		*/
+		static ThreadPool& sharedThreadPool();
+#endif
 
 		//copy
 		Renderer(const Renderer&) = delete;
@@ -49,11 +67,19 @@ namespace SoftRP {
 
 		/* setters */
 		void setVertexBuffer(VertexBuffer* vertexBuffer);
+		//the IndexBuffer used by the draw calls is the last one set, of any format
 		void setIndexBuffer(IndexBuffer* indexBuffer);
+		void setIndexBuffer(IndexBuffer32* indexBuffer);
+		void setIndexBuffer(IndexBuffer16* indexBuffer);
 		void setRenderTarget(RenderTarget* renderTarget);
 		void setDepthBuffer(DepthBuffer* depthBuffer);
 		void setViewPort(ViewPort* viewPort);
 		void setPipelineState(PipelineState* pipelineState);
+		/*
+		the VisibilityBuffer must be as large as the RenderTarget. 
+		a null visibilityBuffer restores the shading of the pixels during draw calls
+		*/
+		void setVisibilityBuffer(VisibilityBuffer* visibilityBuffer);
 
 		constexpr static size_t MAX_CONSTANT_BUFFERS{4};
 		constexpr static size_t MAX_TEXTURE_UNITS{8};
@@ -63,11 +89,15 @@ namespace SoftRP {
 
 		/* getters */
 		VertexBuffer* getVertexBuffer()const;
+		//null if the IndexBuffer set is of another format
 		IndexBuffer* getIndexBuffer()const;
+		IndexBuffer32* getIndexBuffer32()const;
+		IndexBuffer16* getIndexBuffer16()const;
 		RenderTarget* getRenderTarget()const;
 		DepthBuffer* getDepthBuffer()const;
 		ViewPort* getViewPort()const;
 		PipelineState* getPipelineState()const;
+		VisibilityBuffer* getVisibilityBuffer()const;
 		ConstantBuffer* getConstantBuffer(size_t slot)const;
 		TextureUnit* getTextureUnit(size_t slot)const;
 		
@@ -77,7 +107,10 @@ namespace SoftRP {
 		*/
 		//clear the current RenderTarget with the specified value
 		void clearRenderTarget(Math::Vector4 clearValue);
-		//clear the current DepthBuffer with the specified value
+		/*
+		clear the current DepthBuffer with the specified value.
+		the current VisibilityBuffer, if any, is cleared too, because it refers to the depth values
+		*/
 		void clearDepthBuffer(float clearValue);
 		//clear the current RenderTarget with the default clear value
 		void clearRenderTarget();
@@ -94,18 +127,49 @@ namespace SoftRP {
 		using Fence = uint8_t;
 #endif
 		/*
-		draw count indices from the current IndexBuffer for instanceCount instances.
-		the indices are used to index in the current VertexBuffer.
+		draw count indices from the current IndexBuffer, starting at firstIndex, for instanceCount instances.
+		the indices, offset by baseVertex, are used to index in the current VertexBuffer. Only the vertices
+		referenced by the indices drawn are shaded, so that ranges of a VertexBuffer shared by many objects
+		can be drawn on their own.
 		The operation is not immediate, the caller has to use the Fence value returned to
 		be notified of the completion. In the meantime, other draw calls can be made to the Renderer
 		whose state can also be changed. However, clients are constrained to not change the state of the 
 		components (e.g. data of VertexBuffer, IndexBuffer, ConstantBuffer, etc..) that was set up to the time of the call.
 		*/
-		Fence drawIndexed(size_t count, size_t instanceCount = 1);
+		Fence drawIndexed(size_t count, size_t instanceCount = 1, size_t firstIndex = 0, size_t baseVertex = 0);
+
+		//the arguments of a draw call made by multiDrawIndexed, as the ones of drawIndexed
+		struct IndexedDraw {
+			size_t firstIndex{ 0 };
+			size_t count{ 0 };
+			size_t baseVertex{ 0 };
+			size_t instanceCount{ 1 };
+			//the offsets of the instances of the ConstantBuffers' fields, per slot (see ShaderContext::constantBufferField)
+			size_t constantBufferOffsets[MAX_CONSTANT_BUFFERS]{};
+		};
+
+		/*
+		make drawCount draw calls with the current state, which differ only in the indices drawn, in the number of 
+		instances and in the instances of the ConstantBuffers' fields accessed by the shaders. The draw calls are 
+		executed in order as a single one, sharing its setup and the Fence returned: the instances of consecutive 
+		draw calls are shaded, clipped and rasterized together, in batches of many triangles, so that scenes of many 
+		small objects are not bound by the cost of each draw call. The draws array can be reused once the call returns.
+		*/
+		Fence multiDrawIndexed(const IndexedDraw* draws, size_t drawCount);
 		//block the calling thread until the draw call associated with the Fence passed in have been completed
 		void wait(Fence f);
 		//wait for the last Fence
 		void wait();
+
+		/*
+		shade the pixels of the current VisibilityBuffer written by the draw calls made since the last resolve, 
+		writing the current RenderTarget. The PixelShader of the draw is invoked on a 2x2 pixel area-basis as 
+		during the rasterization, with the attributes of the visible primitive interpolated at the pixels' centers.
+		The pixels are then cleared in the VisibilityBuffer. 
+		The operation is not immediate, as drawIndexed. The components used by the draw calls resolved can't be
+		changed until its completion.
+		*/
+		Fence resolveVisibility();
 		
 	private:
 		
@@ -114,29 +178,163 @@ namespace SoftRP {
 		struct RendererState {
 			PipelineState* pipelineState;
 			VertexBuffer* vertexBuffer;
-			IndexBuffer* indexBuffer;
+			//only one of the IndexBuffers is set
+			IndexBuffer* indexBuffer{ nullptr };
+			IndexBuffer32* indexBuffer32{ nullptr };
+			IndexBuffer16* indexBuffer16{ nullptr };
 			ViewPort* viewPort;
 			DepthBuffer* depthBuffer;
 			RenderTarget* renderTarget;
 			ConstantBuffer* constantBuffers[MAX_CONSTANT_BUFFERS];
 			TextureUnit* textureUnits[MAX_TEXTURE_UNITS];			
+			VisibilityBuffer* visibilityBuffer{ nullptr };
 		};
 
-		void drawIndexedTask(RendererState rendererState,
-							 size_t indexCount, size_t triangleCount, ThreadPool::Fence rasterizerFence);
+		/*
+		a draw (instance) rasterized to a VisibilityBuffer. The output vertices and the indices of the clipped 
+		triangles are kept, along with the state needed to shade them, until the draw is resolved.
+		*/
+		struct VisibilityDraw {
+			VisibilityDraw() = default;
+			~VisibilityDraw();
+			VisibilityDraw(const VisibilityDraw&) = delete;
+			VisibilityDraw& operator=(const VisibilityDraw&) = delete;
+			VisibilityDraw(VisibilityDraw&&) = delete;
+			VisibilityDraw& operator=(VisibilityDraw&&) = delete;
+
+			RendererState rendererState;
+			ShaderContext shaderContext{};
+			size_t instance{ 0 };
+			size_t constantBufferOffsets[MAX_CONSTANT_BUFFERS]{};
+			float* vertexData{ nullptr };//allocated with the output VertexLayout
+			std::vector<Vertex> vertices{};
+			std::vector<uint32_t> indices{};
+		};
+		using VisibilityDrawList = std::vector<std::unique_ptr<VisibilityDraw>>;
 
-		void drawIndexedInstancedTask(RendererState rendererState,
-							 size_t indexCount, size_t triangleCount, 
-							 size_t instanceCount, ThreadPool::Fence rasterizerFence);
+		//prepare a VisibilityDraw for an instance, binding its vertices to newly allocated data
+		void setupVisibilityDraw(VisibilityDraw& draw, const RendererState& rendererState, size_t vertexCount, size_t instance,
+								 const size_t* constantBufferOffsets);
+		//make the vertices created by the clipping own their data, so that they are kept until the draw is resolved
+		static void keepClippedVertices(VisibilityDraw& draw, size_t vertexCount);
+		/*
+		append to vertices the vertices of the VertexBuffer referenced by count indices from firstIndex, offset by
+		baseVertex, in the order of the VertexBuffer, and write to indices the ones drawn, remapped to the vertices 
+		appended. remap is used as scratch storage. Return the number of vertices appended.
+		*/
+		static size_t gatherVertices(const RendererState& rendererState, size_t firstIndex, size_t count, size_t baseVertex,
+									 std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<uint32_t>& remap);
+		//as gatherVertices, for the indices drawn of the current IndexBuffer's format
+		template<typename Index>
+		static size_t gatherVertices(const RendererState& rendererState, const Index* drawIndices, size_t count, size_t baseVertex,
+									 std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<uint32_t>& remap);
+		//shade the pixels of the rows in [firstRow, lastRow), firstRow must be even
+		static void resolveVisibilityRows(const VisibilityDrawList& draws, VisibilityBuffer& visibilityBuffer,
+										  RenderTarget& renderTarget, unsigned int firstRow, unsigned int lastRow);
+
+#ifdef SOFTRP_MULTI_THREAD
+		/*
+		the instances of the draws of a multiDrawIndexed call are processed in order, in batches of up to 
+		INSTANCE_BATCH_TRIANGLES triangles: the instances of a batch are shaded and clipped in parallel to a single 
+		stream of vertices and triangles, which is rasterized at once. A batch holds at least an instance, the 
+		instances rasterized to a VisibilityBuffer are processed one at the time.
+		*/
+		static constexpr size_t INSTANCE_BATCH_TRIANGLES = 16384;
+
+		/*
+		the number of the next instanceCount instances of a draw of triangleCount triangles which are added to a 
+		batch holding batchTriangles triangles, 0 if the batch is full
+		*/
+		static size_t batchInstances(size_t triangleCount, size_t instanceCount, size_t batchTriangles, bool visibility);
+
+		/*
+		an instance of a batch, whose output vertices follow the ones of the instances before it. The instances of a 
+		draw share its input vertices and ShaderContext
+		*/
+		struct BatchInstance {
+			size_t instance;
+			size_t shaderContext;
+			size_t firstInput;
+			size_t firstVertex;
+			size_t vertexCount;
+			size_t triangleCount;
+		};
+
+		/*
+		the buffers which a batch is shaded, clipped and rasterized with. The triangles of a batch of more than one 
+		instance are tagged with the TriangleGroup of their instance, which they are rasterized with
+		*/
+		struct BatchBuffers {
+			std::vector<BatchInstance> instances{};
+			std::vector<ShaderContext> shaderContexts{};
+			std::vector<Rasterizer::TriangleGroup> groups{};
+			//the indices of the instances, remapped to vShaderOutputs, and the group of each triangle
+			std::vector<uint32_t> indices{};
+			std::vector<uint32_t> groupIds{};
+			//grown to the largest batch of the draw call, in vertices
+			float* workBuffer{ nullptr };
+			size_t workBufferCapacity{ 0 };
+			std::vector<Vertex> vShaderOutputs{};
+			std::vector<uint32_t> outIndices{};
+			std::vector<uint32_t> outGroupIds{};
+			std::unique_ptr<Clipper> clipper{};
+		};
+
+		/*
+		a draw call in flight, handed from a task of its chain to the next one. The batches are processed in order: 
+		a batch is shaded and clipped to the ping buffers while the previous one, swapped to the pong ones, is 
+		rasterized. The instances rasterized to a VisibilityBuffer use their VisibilityDraws instead.
+		The records are pooled, so that the tasks capture a pointer rather than the whole state and are stored 
+		inline by the ThreadPool, and so that their buffers are reused by the next draw calls.
+		*/
+		struct DrawRecord {
+			RendererState rendererState;
+			std::vector<IndexedDraw> draws{};
+			std::vector<VisibilityDraw*> visibilityDraws{};
+			uint32_t firstDrawId{ 0 };
+			//the next instance to be batched, of draws[draw], and the VisibilityDraw of the next instance rasterized
+			size_t draw{ 0 };
+			size_t instance{ 0 };
+			size_t visibilityDraw{ 0 };
+			//the fence of the last rasterization, which the next one waits for
+			ThreadPool::Fence rasterizerFence{ 0 };
+			//the input vertices of the draws of the batch in flight, and the indices of the last one, remapped to them
+			std::vector<Vertex> vShaderInputs{};
+			std::vector<uint32_t> drawIndices{};
+			std::vector<uint32_t> remap{};
+			BatchBuffers ping{};
+			BatchBuffers pong{};
+			std::unique_ptr<Rasterizer> rasterizer{};
+		};
+
+		//the tasks of a draw call, each one submits the next
+		void beginDraw(DrawRecord& draw);
+		void shadeInstances(DrawRecord& draw);
+		void clipInstances(DrawRecord& draw);
+		void rasterizeInstances(DrawRecord& draw);
+		void endDraw(DrawRecord& draw);
+		//collect the next batch of instances in the ping buffers
+		void collectBatch(DrawRecord& draw);
+		//shade the vertices in [first, last) of the batch in the ping buffers
+		static void shadeVertexRange(DrawRecord& draw, size_t first, size_t last);
+
+		void resolveVisibilityTask(const std::shared_ptr<VisibilityDrawList>& draws, VisibilityBuffer* visibilityBuffer,
+								   RenderTarget* renderTarget);
+		//give back to the pools the vectors of the draws resolved
+		void releaseVisibilityDraws(VisibilityDrawList& draws);
+#endif
 
 		bool m_clearDepth;
 		bool m_clearRenderTarget;
 		float m_clearDepthBufferValue;
 		Math::Vector4 m_clearRenderTargetValue;					
 		RendererState m_rendererState;
+		VisibilityDrawList m_visibilityDraws{};//the draws not resolved yet, indexed by their ids
 #ifdef SOFTRP_MULTI_THREAD
 		ThreadPool::Fence m_rasterizerFence{};
 		ThreadPool::Fence m_drawFence{};
+		const size_t m_maxDrawsInFlight;
+		//the stages and the draws share the TaskConsumers of the same ThreadPool
 		ThreadPool m_clipperThreadPool;
 		ThreadPool m_rasterizerThreadPool;
 		ThreadPool m_drawThreadPool;
@@ -158,8 +356,8 @@ namespace SoftRP {
 				   ConstructCreationPolicy<std::vector<Vertex>>, 
 			       ResizeVectorActivationPolicy, 
 			       ClearVectorDeactivationPolicy> vertexVectorPool{};
-		ObjectPool<std::vector<uint64_t>,
-			       ConstructCreationPolicy<std::vector<uint64_t>>, 
+		ObjectPool<std::vector<uint32_t>,
+			       ConstructCreationPolicy<std::vector<uint32_t>>, 
 			       ResizeVectorActivationPolicy, 
 			       ClearVectorDeactivationPolicy> indexVectorPool{};
 
@@ -173,12 +371,21 @@ namespace SoftRP {
 		ObjectPool<std::unique_ptr<Clipper>, CreateManagedPolicy<Clipper, ClipperFactory>> clipperPool;
 		ObjectPool<std::unique_ptr<Rasterizer>, CreateManagedPolicy<Rasterizer, RasterizerFactory>> rasterizerPool;
 
+		template<typename T>
+		struct CreateUniquePolicy {
+			std::unique_ptr<T> create() const;
+		};
+
+		ObjectPool<std::unique_ptr<DrawRecord>, CreateUniquePolicy<DrawRecord>> drawRecordPool{};
+
 #else
 		std::unique_ptr<Clipper> m_clipper{};
 		std::unique_ptr<Rasterizer> m_rasterizer{};
 		std::vector<Vertex> m_vShaderInputs{};
 		std::vector<Vertex> m_vShaderOutputs{};
-		std::vector<uint64_t> m_outIndices{};
+		std::vector<uint32_t> m_indices{};
+		std::vector<uint32_t> m_vertexRemap{};
+		std::vector<uint32_t> m_outIndices{};
 #endif
 	};
 }
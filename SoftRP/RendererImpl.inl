@@ -1,6 +1,11 @@
 #ifndef SOFTRP_RENDERER_IMPL_INL_
 #define SOFTRP_RENDERER_IMPL_INL_
 #include "Renderer.h"
+#include "FMatrix.h"
+#include "FVector.h"
+#include "AlignedPoolArrayAllocator.h"
+#include <algorithm>
+#include <cmath>
 namespace SoftRP {
 	
 #ifdef SOFTRP_MULTI_THREAD
@@ -17,6 +22,11 @@ namespace SoftRP {
 		v.clear();
 	}
 
+	template<typename T>
+	inline std::unique_ptr<T> Renderer::CreateUniquePolicy<T>::create() const {
+		return std::unique_ptr<T>{new T{}};
+	}
+
 	template<typename T, typename Factory>
 	inline Renderer::CreateManagedPolicy<T, Factory>::CreateManagedPolicy(const Factory* _factory) : factory{ _factory } {}
 
@@ -26,13 +36,26 @@ namespace SoftRP {
 	}
 
 	inline Renderer::Renderer(const ClipperFactory& clipperFactory, const RasterizerFactory& rasterizerFactory, 
-							  size_t drawingThreadsCount, size_t clippingThreadsCount,
-							  size_t rasterizingThreadsCount, size_t vertexShaderThreadsCount)
+							  ThreadPool* threadPool, size_t maxDrawsInFlight)
 
-		: clipperPool{ CreateManagedPolicy<Clipper, ClipperFactory>{&clipperFactory} },
+		: m_maxDrawsInFlight{ std::max(maxDrawsInFlight, size_t{ 1 }) },
+		clipperPool{ CreateManagedPolicy<Clipper, ClipperFactory>{&clipperFactory} },
 		rasterizerPool{ CreateManagedPolicy<Rasterizer, RasterizerFactory>{&rasterizerFactory} },
-		m_clipperThreadPool{ clippingThreadsCount }, m_rasterizerThreadPool{ rasterizingThreadsCount },
-		m_drawThreadPool{ drawingThreadsCount }, m_vertexShaderThreadPool{ vertexShaderThreadsCount }{
+		m_clipperThreadPool{ threadPool ? *threadPool : sharedThreadPool(), TaskPriority::NORMAL }, 
+		m_rasterizerThreadPool{ threadPool ? *threadPool : sharedThreadPool(), TaskPriority::HIGH },
+		//the draws' tasks only submit the stages' ones, which they don't delay
+		m_drawThreadPool{ threadPool ? *threadPool : sharedThreadPool(), TaskPriority::HIGH }, 
+		m_vertexShaderThreadPool{ threadPool ? *threadPool : sharedThreadPool(), TaskPriority::LOW }{
+	}
+
+	inline Renderer::~Renderer() {
+		//the draws' tasks use the pools, which are destroyed before the ThreadPools
+		m_drawThreadPool.waitForPendingTasks();
+	}
+
+	inline ThreadPool& Renderer::sharedThreadPool() {
+		static ThreadPool threadPool{ 0 };
+		return threadPool;
 	}
 
 #else
@@ -41,6 +64,9 @@ namespace SoftRP {
 		m_rasterizer.reset(rasterizerFactory.create());
 	}
 
+	inline Renderer::~Renderer() {
+	}
+
 #endif
 		
 	inline void Renderer::handleClear() {
@@ -50,9 +76,13 @@ namespace SoftRP {
 		if (m_clearDepth) {
 #ifdef SOFTRP_MULTI_THREAD
 			m_rendererState.depthBuffer->clear(m_clearDepthBufferValue, m_rasterizerThreadPool);
+			if (m_rendererState.visibilityBuffer)
+				m_rendererState.visibilityBuffer->clear(m_rasterizerThreadPool);
 			waitForPendingTasks = true;
 #else
 			m_rendererState.depthBuffer->clear(m_clearDepthBufferValue);
+			if (m_rendererState.visibilityBuffer)
+				m_rendererState.visibilityBuffer->clear();
 #endif
 			m_clearDepth = false;
 		}
@@ -85,215 +115,380 @@ namespace SoftRP {
 
 #ifdef SOFTRP_MULTI_THREAD	
 
-	inline Renderer::Fence Renderer::drawIndexed(size_t count, size_t instanceCount) {
-		const size_t triangleCount = count / 3;
-		if (triangleCount == 0)
+	inline Renderer::Fence Renderer::multiDrawIndexed(const IndexedDraw* draws, size_t drawCount) {
+		//copy current RenderState and the draws to a pooled record, which is handed to the draw call's tasks
+		DrawRecord* draw = drawRecordPool.takeOne().release();
+		draw->draws.clear();
+		for (size_t i = 0; i < drawCount; i++) {
+			if (draws[i].count / 3 != 0 && draws[i].instanceCount != 0)
+				draw->draws.push_back(draws[i]);
+		}
+		if (draw->draws.empty()) {
+			drawRecordPool.putOne(std::unique_ptr<DrawRecord>{ draw });
 			return m_drawFence;
+		}
 
 		handleClear();
 
-		count = triangleCount * 3;
-
-		//copy current RenderState
-		RendererState rs = m_rendererState;
-
-		if (instanceCount > 1) {
-			ThreadPool::Fence rasterizerFence = m_rasterizerFence;
-			m_rasterizerFence += instanceCount;
-			m_drawFence = m_drawThreadPool.addTaskAndFence([this, rs, count, triangleCount, instanceCount, rasterizerFence]() {
-				drawIndexedInstancedTask(std::move(rs), count, triangleCount, instanceCount, rasterizerFence);
-			});
-		} else {
-			ThreadPool::Fence rasterizerFence = m_rasterizerFence++;
-			m_drawFence = m_drawThreadPool.addTaskAndFence([this, rs, count, triangleCount, rasterizerFence]() {
-				drawIndexedTask(std::move(rs), count, triangleCount, rasterizerFence);
-			});
+		draw->rendererState = m_rendererState;
+		const bool visibility = draw->rendererState.visibilityBuffer != nullptr;
+
+		//each batch is rasterized after the previous draws, adding a fence
+		size_t batchCount = 0;
+		size_t batchTriangles = 0;
+		for (const IndexedDraw& indexedDraw : draw->draws) {
+			const size_t triangleCount = indexedDraw.count / 3;
+			for (size_t instance = 0; instance < indexedDraw.instanceCount;) {
+				const size_t instanceCount = batchInstances(triangleCount, indexedDraw.instanceCount - instance, 
+															batchTriangles, visibility);
+				if (instanceCount == 0) {
+					batchTriangles = 0;
+					continue;
+				}
+				if (batchTriangles == 0)
+					batchCount++;
+				batchTriangles += instanceCount * triangleCount;
+				instance += instanceCount;
+			}
+		}
+		const ThreadPool::Fence rasterizerFence = m_rasterizerFence;
+		draw->rasterizerFence = rasterizerFence;
+		m_rasterizerFence += batchCount;
+
+		if (visibility) {
+			//the ids are assigned here, so that they follow the order of the draw calls
+			draw->firstDrawId = static_cast<uint32_t>(m_visibilityDraws.size());
+			draw->visibilityDraws.clear();
+			for (const IndexedDraw& indexedDraw : draw->draws) {
+				for (size_t instance = 0; instance < indexedDraw.instanceCount; instance++) {
+					m_visibilityDraws.emplace_back(new VisibilityDraw{});
+					draw->visibilityDraws.push_back(m_visibilityDraws.back().get());
+				}
+			}
 		}
 
+		/*
+		the draw is started once its first batch is within the last m_maxDrawsInFlight to be rasterized. 
+		The fence is reached once the whole chain of tasks of the draw has been executed.
+		*/
+		const ThreadPool::Fence startFence = rasterizerFence + 1 > m_maxDrawsInFlight ? 
+											 rasterizerFence + 1 - m_maxDrawsInFlight : 0;
+		m_drawThreadPool.addTaskAfterFence(m_rasterizerThreadPool, startFence, [this, draw]() {
+			beginDraw(*draw);
+		});
+		m_drawFence = m_drawThreadPool.addFence();
 		return m_drawFence;
 	}
 
-	inline void Renderer::drawIndexedTask(RendererState renderState, size_t count, size_t triangleCount,
-										  ThreadPool::Fence rasterizerFence) {
+	inline size_t Renderer::batchInstances(size_t triangleCount, size_t instanceCount, size_t batchTriangles, bool visibility) {
+		if (batchTriangles == 0)
+			return visibility ? 1 : std::max<size_t>(1, std::min(instanceCount, INSTANCE_BATCH_TRIANGLES / triangleCount));
+		if (visibility || batchTriangles >= INSTANCE_BATCH_TRIANGLES)
+			return 0;
+		return std::min(instanceCount, (INSTANCE_BATCH_TRIANGLES - batchTriangles) / triangleCount);
+	}
 
-		VertexLayout& inputVertexLayout = renderState.pipelineState->inputVertexLayout();
-		VertexLayout& outputVertexLayout = renderState.pipelineState->outputVertexLayout();
+	inline void Renderer::beginDraw(DrawRecord& draw) {
+		const RendererState& renderState = draw.rendererState;
+		draw.draw = 0;
+		draw.instance = 0;
+		draw.visibilityDraw = 0;
 
-		const auto vertexCount = renderState.vertexBuffer->size() / inputVertexLayout.vertexStride();
+		draw.rasterizer = rasterizerPool.takeOne();
+		draw.rasterizer->setRenderTarget(renderState.renderTarget);
+		draw.rasterizer->setViewPort(renderState.viewPort);
+		draw.rasterizer->setDepthBuffer(renderState.depthBuffer);
+		draw.rasterizer->setPixelShader(&renderState.pipelineState->pixelShader());
 
-		auto deleteVertexArray = [&outputVertexLayout](float* ptr) {
-			outputVertexLayout.deallocateVertexArray(ptr);
-		};
-		std::unique_ptr<float, decltype(deleteVertexArray)> workBufferPtr{
-			outputVertexLayout.allocateVertexArray(vertexCount), deleteVertexArray };
-		float* workBuffer = workBufferPtr.get();
-
-		vertexVectorPool.acquire();
-		std::vector<Vertex> vShaderInputs{ vertexVectorPool.takeOneAcquired(vertexCount) };
-		std::vector<Vertex> vShaderOutputs{ vertexVectorPool.takeOneAcquired(vertexCount) };
-		vertexVectorPool.release();
+		shadeInstances(draw);
+	}
 
-		float* vertexData = renderState.vertexBuffer->get();
-		uint64_t* indexData = renderState.indexBuffer->get();
+	inline void Renderer::collectBatch(DrawRecord& draw) {
+		const RendererState& renderState = draw.rendererState;
+		const bool visibility = renderState.visibilityBuffer != nullptr;
+		BatchBuffers& batch = draw.ping;
+		batch.instances.clear();
+		batch.shaderContexts.clear();
+		batch.indices.clear();
+		draw.vShaderInputs.clear();
+
+		size_t batchTriangles = 0;
+		size_t vertexCount = 0;
+		while (draw.draw < draw.draws.size()) {
+			const IndexedDraw& indexedDraw = draw.draws[draw.draw];
+			const size_t triangleCount = indexedDraw.count / 3;
+			const size_t instanceCount = batchInstances(triangleCount, indexedDraw.instanceCount - draw.instance, 
+														batchTriangles, visibility);
+			if (instanceCount == 0)
+				break;
+
+			//only the vertices referenced by the draw are shaded, the indices are remapped to them
+			const size_t firstInput = draw.vShaderInputs.size();
+			const size_t drawVertexCount = gatherVertices(renderState, indexedDraw.firstIndex, triangleCount * 3, 
+														  indexedDraw.baseVertex, draw.vShaderInputs, draw.drawIndices, draw.remap);
+			batch.shaderContexts.emplace_back();
+			ShaderContext& shaderContext = batch.shaderContexts.back();
+			shaderContext.setConstantBuffers(renderState.constantBuffers);
+			shaderContext.setTextureUnits(renderState.textureUnits);
+			shaderContext.setConstantBufferOffsets(indexedDraw.constantBufferOffsets);
+
+			//each instance has its own copy of the draw's vertices, the indices are offset accordingly
+			for (size_t k = 0; k < instanceCount; k++) {
+				batch.instances.push_back(BatchInstance{ draw.instance + k, batch.shaderContexts.size() - 1, firstInput,
+														 vertexCount, drawVertexCount, triangleCount });
+				if (batch.indices.empty() && instanceCount == 1) {
+					batch.indices.swap(draw.drawIndices);
+				} else {
+					const size_t firstIndex = batch.indices.size();
+					batch.indices.resize(firstIndex + triangleCount * 3);
+					const uint32_t vertexOffset = static_cast<uint32_t>(vertexCount);
+					for (size_t i = 0; i < triangleCount * 3; i++)
+						batch.indices[firstIndex + i] = draw.drawIndices[i] + vertexOffset;
+				}
+				vertexCount += drawVertexCount;
+			}
+
+			batchTriangles += instanceCount * triangleCount;
+			draw.instance += instanceCount;
+			if (draw.instance == indexedDraw.instanceCount) {
+				draw.draw++;
+				draw.instance = 0;
+			}
+		}
 
-		for (size_t i = 0; i < vertexCount; i++) {
-			vShaderInputs[i].setVertexData(inputVertexLayout.getVertexData(vertexData, i), &inputVertexLayout);
-			vShaderOutputs[i].setVertexData(outputVertexLayout.getVertexData(workBuffer, i), &outputVertexLayout);
+		//the groups refer to the ShaderContexts, which are not added anymore
+		if (batch.instances.size() > 1) {
+			batch.groups.clear();
+			batch.groupIds.clear();
+			for (size_t g = 0; g < batch.instances.size(); g++) {
+				const BatchInstance& instance = batch.instances[g];
+				batch.groups.push_back(Rasterizer::TriangleGroup{ instance.instance, &batch.shaderContexts[instance.shaderContext] });
+				batch.groupIds.insert(batch.groupIds.end(), instance.triangleCount, static_cast<uint32_t>(g));
+			}
 		}
 
-		ShaderContext sc{};
-		sc.setConstantBuffers(renderState.constantBuffers);
-		sc.setTextureUnits(renderState.textureUnits);
+		/*
+		the clipper leaves to the rasterizer the triangles inside its guard band. The vertices created by the clipping 
+		refer to the clipper's data, which must be kept until they are rasterized: as the vertices and the indices, a 
+		clipper is used for each buffer. The VisibilityDraws keep their own vertices instead.
+		*/
+		if (!batch.clipper) {
+			batch.clipper = clipperPool.takeOne();
+			batch.clipper->setGuardBand(draw.rasterizer->guardBand());
+		}
+		if (visibility)
+			return;
 
-		const VertexShader& vertexShader = renderState.pipelineState->vertexShader();
-		ThreadPool::Fence vertexShaderFence = vertexShader(sc, vShaderInputs.data(), vShaderOutputs.data(), 
-														   vertexCount, 0, m_vertexShaderThreadPool);
+		VertexLayout& outputVertexLayout = renderState.pipelineState->outputVertexLayout();
+		if (batch.workBufferCapacity < vertexCount) {
+			if (batch.workBuffer)
+				outputVertexLayout.deallocateVertexArray(batch.workBuffer);
+			batch.workBuffer = outputVertexLayout.allocateVertexArray(vertexCount);
+			batch.workBufferCapacity = vertexCount;
+		}
+		batch.vShaderOutputs.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+			batch.vShaderOutputs[i].setVertexData(outputVertexLayout.getVertexData(batch.workBuffer, i), &outputVertexLayout);
+		batch.outIndices.clear();
+		batch.outGroupIds.clear();
+	}
 
-		std::vector<uint64_t> outIndices{ indexVectorPool.takeOne() };
-		m_vertexShaderThreadPool.waitForFence(vertexShaderFence);
-		
-		auto clipper = clipperPool.takeOne();
-		ThreadPool::Fence fence = clipper->clipTriangles(vShaderOutputs, indexData, triangleCount, outIndices, m_clipperThreadPool);
-		
-		const PixelShader& pixelShader = renderState.pipelineState->pixelShader();
+	inline void Renderer::shadeInstances(DrawRecord& draw) {
+		collectBatch(draw);
+
+		const VertexShader& vertexShader = draw.rendererState.pipelineState->vertexShader();
+		const BatchBuffers& batch = draw.ping;
+		DrawRecord* drawPtr = &draw;
+		ThreadPool::Fence fence;
+		if (draw.rendererState.visibilityBuffer) {
+			//each instance is a draw on its own, whose vertices and indices are kept until it is resolved
+			const BatchInstance& instance = batch.instances[0];
+			VisibilityDraw& visibilityDraw = *draw.visibilityDraws[draw.visibilityDraw];
+			setupVisibilityDraw(visibilityDraw, draw.rendererState, instance.vertexCount, instance.instance, 
+								batch.shaderContexts[0].constantBufferOffsets());
+			fence = vertexShader(visibilityDraw.shaderContext, draw.vShaderInputs.data(), visibilityDraw.vertices.data(),
+								 instance.vertexCount, instance.instance, m_vertexShaderThreadPool);
+		} else {
+			//the vertices of the batch are shaded in parallel, VERTEX_BATCH_SIZE per task, the first ones by this thread
+			const size_t vertexCount = batch.vShaderOutputs.size();
+			const size_t batchSize = VertexShader::VERTEX_BATCH_SIZE;
+			if (vertexCount <= batchSize) {
+				shadeVertexRange(draw, 0, vertexCount);
+				clipInstances(draw);
+				return;
+			}
+			for (size_t first = batchSize; first < vertexCount; first += batchSize) {
+				const size_t last = std::min(first + batchSize, vertexCount);
+				m_vertexShaderThreadPool.addTask([drawPtr, first, last]() {
+					shadeVertexRange(*drawPtr, first, last);
+				});
+			}
+			fence = m_vertexShaderThreadPool.addFence();
+			shadeVertexRange(draw, 0, batchSize);
+		}
+		m_drawThreadPool.addTaskAfterFence(m_vertexShaderThreadPool, fence, [this, drawPtr]() {
+			clipInstances(*drawPtr);
+		});
+	}
 
-		auto rasterizer = rasterizerPool.takeOne();
-		rasterizer->setRenderTarget(renderState.renderTarget);
-		rasterizer->setViewPort(renderState.viewPort);
-		rasterizer->setDepthBuffer(renderState.depthBuffer);
-		rasterizer->setPixelShader(&pixelShader);
-		rasterizer->setShaderContext(&sc);
+	inline void Renderer::shadeVertexRange(DrawRecord& draw, size_t first, size_t last) {
+		const VertexShader& vertexShader = draw.rendererState.pipelineState->vertexShader();
+		BatchBuffers& batch = draw.ping;
+		//the instance holding the first vertex, then the next ones
+		auto instance = std::upper_bound(batch.instances.begin(), batch.instances.end(), first,
+										 [](size_t vertex, const BatchInstance& batchInstance) {
+			return vertex < batchInstance.firstVertex;
+		}) - 1;
+		for (; first < last; ++instance) {
+			const size_t instanceLast = std::min(last, instance->firstVertex + instance->vertexCount);
+			const Vertex* input = draw.vShaderInputs.data() + instance->firstInput + (first - instance->firstVertex);
+			vertexShader.shadeBatch(batch.shaderContexts[instance->shaderContext], input, batch.vShaderOutputs.data() + first, 
+									instanceLast - first, instance->instance);
+			first = instanceLast;
+		}
+	}
 
-		m_rasterizerThreadPool.waitForFence(rasterizerFence);
-		m_clipperThreadPool.waitForFence(fence);
+	inline void Renderer::clipInstances(DrawRecord& draw) {
+		BatchBuffers& batch = draw.ping;
+		const size_t triangleCount = batch.indices.size() / 3;
+		ThreadPool::Fence fence;
+		if (draw.rendererState.visibilityBuffer) {
+			VisibilityDraw& visibilityDraw = *draw.visibilityDraws[draw.visibilityDraw];
+			fence = batch.clipper->clipTriangles(visibilityDraw.vertices, batch.indices.data(), triangleCount,
+												 visibilityDraw.indices, m_clipperThreadPool);
+		} else if (batch.instances.size() == 1) {
+			fence = batch.clipper->clipTriangles(batch.vShaderOutputs, batch.indices.data(), triangleCount,
+												 batch.outIndices, m_clipperThreadPool);
+		} else {
+			//the triangles produced by the clipping keep the group of the triangle they come from
+			fence = batch.clipper->clipTriangles(batch.vShaderOutputs, batch.indices.data(), batch.groupIds.data(),
+												 triangleCount, batch.outIndices, batch.outGroupIds, m_clipperThreadPool);
+		}
+		//the batch is rasterized once it has been clipped and the previous one has been rasterized
+		DrawRecord* drawPtr = &draw;
+		m_drawThreadPool.addTaskAfterFence(m_clipperThreadPool, fence, [this, drawPtr]() {
+			m_drawThreadPool.addTaskAfterFence(m_rasterizerThreadPool, drawPtr->rasterizerFence, [this, drawPtr]() {
+				rasterizeInstances(*drawPtr);
+			});
+		});
+	}
 
-		fence = rasterizer->rasterizeTriangles(vShaderOutputs, outIndices, 0, m_rasterizerThreadPool);
-		clipperPool.putOne(std::move(clipper));
-		vertexVectorPool.putOne(std::move(vShaderInputs));
-		m_rasterizerThreadPool.waitForFence(fence);
+	inline void Renderer::rasterizeInstances(DrawRecord& draw) {
+		if (draw.rendererState.visibilityBuffer) {
+			VisibilityDraw& visibilityDraw = *draw.visibilityDraws[draw.visibilityDraw];
+			keepClippedVertices(visibilityDraw, draw.ping.instances[0].vertexCount);
+			draw.rasterizer->setShaderContext(&visibilityDraw.shaderContext);
+			draw.rasterizer->setVisibilityBuffer(draw.rendererState.visibilityBuffer, 
+												 draw.firstDrawId + static_cast<uint32_t>(draw.visibilityDraw));
+			draw.rasterizerFence = draw.rasterizer->rasterizeTriangles(visibilityDraw.vertices, visibilityDraw.indices, 
+																	   visibilityDraw.instance, m_rasterizerThreadPool);
+			draw.visibilityDraw++;
+		} else {
+			std::swap(draw.ping, draw.pong);
+			const BatchBuffers& batch = draw.pong;
+			if (batch.instances.size() == 1) {
+				draw.rasterizer->setShaderContext(&batch.shaderContexts[0]);
+				draw.rasterizerFence = draw.rasterizer->rasterizeTriangles(batch.vShaderOutputs, batch.outIndices, 
+																		   batch.instances[0].instance, m_rasterizerThreadPool);
+			} else {
+				draw.rasterizerFence = draw.rasterizer->rasterizeTriangles(batch.vShaderOutputs, batch.outIndices, 
+																		   batch.outGroupIds, batch.groups, m_rasterizerThreadPool);
+			}
+		}
 
-		vertexVectorPool.putOne(std::move(vShaderOutputs));
-		indexVectorPool.putOne(std::move(outIndices));
-		rasterizerPool.putOne(std::move(rasterizer));
+		if (draw.draw < draw.draws.size()) {
+			//the next batch is shaded and clipped while this one is rasterized
+			shadeInstances(draw);
+		} else {
+			DrawRecord* drawPtr = &draw;
+			m_drawThreadPool.addTaskAfterFence(m_rasterizerThreadPool, draw.rasterizerFence, [this, drawPtr]() {
+				endDraw(*drawPtr);
+			});
+		}
 	}
 
-	inline void Renderer::drawIndexedInstancedTask(RendererState renderState, size_t count, size_t triangleCount,
-										  size_t instanceCount, ThreadPool::Fence rasterizerFence) {
-
-		VertexLayout& inputVertexLayout = renderState.pipelineState->inputVertexLayout();
-		VertexLayout& outputVertexLayout = renderState.pipelineState->outputVertexLayout();
+	inline void Renderer::endDraw(DrawRecord& draw) {
+		VertexLayout& outputVertexLayout = draw.rendererState.pipelineState->outputVertexLayout();
+		if (draw.rendererState.visibilityBuffer)
+			draw.rasterizer->setVisibilityBuffer(nullptr);
+
+		//the buffers are kept by the record, but the work buffers, allocated with the draw's output VertexLayout
+		for (BatchBuffers* batch : { &draw.ping, &draw.pong }) {
+			batch->vShaderOutputs.clear();
+			if (batch->workBuffer) {
+				outputVertexLayout.deallocateVertexArray(batch->workBuffer);
+				batch->workBuffer = nullptr;
+				batch->workBufferCapacity = 0;
+			}
+			if (batch->clipper)
+				clipperPool.putOne(std::move(batch->clipper));
+		}
+		draw.vShaderInputs.clear();
+		rasterizerPool.putOne(std::move(draw.rasterizer));
 
-		const auto vertexCount = renderState.vertexBuffer->size() / inputVertexLayout.vertexStride();
+		drawRecordPool.putOne(std::unique_ptr<DrawRecord>{ &draw });
+	}
 
-		auto deleteVertexArray = [&outputVertexLayout](float* ptr) {
-			outputVertexLayout.deallocateVertexArray(ptr);
-		};		
-		std::unique_ptr<float, decltype(deleteVertexArray)> workBufferPingPtr{
-			outputVertexLayout.allocateVertexArray(vertexCount), deleteVertexArray };
-		std::unique_ptr<float, decltype(deleteVertexArray)> workBufferPongPtr{
-			outputVertexLayout.allocateVertexArray(vertexCount), deleteVertexArray };
-
-		float* workBufferPing = workBufferPingPtr.get();
-		float* workBufferPong = workBufferPongPtr.get();
-		
-		vertexVectorPool.acquire();
-		std::vector<Vertex> vShaderInputs{ vertexVectorPool.takeOneAcquired(vertexCount) };
-		std::vector<Vertex> vShaderOutputsPing{ vertexVectorPool.takeOneAcquired(vertexCount) };
-		std::vector<Vertex> vShaderOutputsPong{ vertexVectorPool.takeOneAcquired(vertexCount) };		
-		vertexVectorPool.release();
+	inline Renderer::Fence Renderer::resolveVisibility() {
+		handleClear();
+		if (m_visibilityDraws.empty())
+			return m_drawFence;
 
-		float* vertexData = renderState.vertexBuffer->get();
-		uint64_t* indexData = renderState.indexBuffer->get();
+		//the draws are handed to the task, new draw calls start a new list
+		std::shared_ptr<VisibilityDrawList> draws = std::make_shared<VisibilityDrawList>(std::move(m_visibilityDraws));
+		m_visibilityDraws.clear();
+
+		VisibilityBuffer* visibilityBuffer = m_rendererState.visibilityBuffer;
+		RenderTarget* renderTarget = m_rendererState.renderTarget;
+		//the draws are resolved once they have been rasterized, along with any other draw call made before
+		ThreadPool::Fence rasterizerFence = m_rasterizerFence++;
+		m_drawThreadPool.addTaskAfterFence(m_rasterizerThreadPool, rasterizerFence, [this, draws, visibilityBuffer, renderTarget]() {
+			resolveVisibilityTask(draws, visibilityBuffer, renderTarget);
+		});
+		m_drawFence = m_drawThreadPool.addFence();
+		return m_drawFence;
+	}
 
-		for (size_t i = 0; i < vertexCount; i++) {
-			vShaderInputs[i].setVertexData(inputVertexLayout.getVertexData(vertexData, i), &inputVertexLayout);
-			vShaderOutputsPong[i].setVertexData(outputVertexLayout.getVertexData(workBufferPong, i), &outputVertexLayout);
-			vShaderOutputsPing[i].setVertexData(outputVertexLayout.getVertexData(workBufferPing, i), &outputVertexLayout);
+	inline void Renderer::resolveVisibilityTask(const std::shared_ptr<VisibilityDrawList>& draws, 
+												VisibilityBuffer* visibilityBuffer, RenderTarget* renderTarget) {
+
+		//the rows are split in tasks as the tiles of the BinRasterizer
+		constexpr unsigned int rowsPerTask = 64;
+		const unsigned int height = std::min(visibilityBuffer->height(), renderTarget->height());
+		const VisibilityDrawList* drawsPtr = draws.get();
+		for (unsigned int firstRow = 0; firstRow < height; firstRow += rowsPerTask) {
+			const unsigned int lastRow = std::min(firstRow + rowsPerTask, height);
+			m_rasterizerThreadPool.addTask([drawsPtr, visibilityBuffer, renderTarget, firstRow, lastRow]() {
+				resolveVisibilityRows(*drawsPtr, *visibilityBuffer, *renderTarget, firstRow, lastRow);
+			});
 		}
+		const ThreadPool::Fence fence = m_rasterizerThreadPool.addFence();
+		m_drawThreadPool.addTaskAfterFence(m_rasterizerThreadPool, fence, [this, draws]() {
+			releaseVisibilityDraws(*draws);
+		});
+	}
 
-		ShaderContext sc{};
-		sc.setConstantBuffers(renderState.constantBuffers);
-		sc.setTextureUnits(renderState.textureUnits);
-		
+	inline void Renderer::releaseVisibilityDraws(VisibilityDrawList& draws) {
+		vertexVectorPool.acquire();
+		for (auto& draw : draws)
+			vertexVectorPool.putOneAcquired(std::move(draw->vertices));
+		vertexVectorPool.release();
 		indexVectorPool.acquire();
-		std::vector<uint64_t> outIndicesPing{ indexVectorPool.takeOneAcquired() };
-		std::vector<uint64_t> outIndicesPong{ indexVectorPool.takeOneAcquired() };		
+		for (auto& draw : draws)
+			indexVectorPool.putOneAcquired(std::move(draw->indices));
 		indexVectorPool.release();
-
-		auto clipper = clipperPool.takeOne();	
-		
-		const VertexShader& vertexShader = renderState.pipelineState->vertexShader();
-		const PixelShader& pixelShader = renderState.pipelineState->pixelShader();
-
-		auto rasterizer = rasterizerPool.takeOne();
-		rasterizer->setRenderTarget(renderState.renderTarget);
-		rasterizer->setViewPort(renderState.viewPort);
-		rasterizer->setDepthBuffer(renderState.depthBuffer);
-		rasterizer->setPixelShader(&pixelShader);
-		rasterizer->setShaderContext(&sc);
-				
-		for (size_t instance = 0; instance < instanceCount; instance++) {			
-			ThreadPool::Fence f = vertexShader(sc, vShaderInputs.data(), vShaderOutputsPing.data(), vertexCount, 
-											   instance, m_vertexShaderThreadPool);			
-			m_vertexShaderThreadPool.waitForFence(f);
-			
-			f = clipper->clipTriangles(vShaderOutputsPing, indexData, triangleCount, outIndicesPing, m_clipperThreadPool);
-			
-			m_clipperThreadPool.waitForFence(f);
-			m_rasterizerThreadPool.waitForFence(rasterizerFence);
-
-			vShaderOutputsPong.swap(vShaderOutputsPing);
-			outIndicesPong.swap(outIndicesPing);
-			
-			rasterizerFence = rasterizer->rasterizeTriangles(vShaderOutputsPong, outIndicesPong, instance, m_rasterizerThreadPool);			
-			outIndicesPing.clear();
-			vShaderOutputsPing.resize(vertexCount);
-		}
-				
-		clipperPool.putOne(std::move(clipper));
-		vertexVectorPool.putOne(std::move(vShaderInputs));
-		vertexVectorPool.putOne(std::move(vShaderOutputsPing));
-		indexVectorPool.putOne(std::move(outIndicesPing));
-
-		m_rasterizerThreadPool.waitForFence(rasterizerFence);
-
-		vertexVectorPool.putOne(std::move(vShaderOutputsPong));
-		indexVectorPool.putOne(std::move(outIndicesPong));
-		rasterizerPool.putOne(std::move(rasterizer));
+		draws.clear();
 	}
 
 #else
 
-	inline Renderer::Fence Renderer::drawIndexed(size_t count, size_t instanceCount) {
-		const size_t triangleCount = count / 3;
-		if (triangleCount == 0)
-			return 0;
-
+	inline Renderer::Fence Renderer::multiDrawIndexed(const IndexedDraw* draws, size_t drawCount) {
 		handleClear();
 
-		count = triangleCount * 3;
-
-		VertexLayout& inputVertexLayout = m_rendererState.pipelineState->inputVertexLayout();
 		VertexLayout& outputVertexLayout = m_rendererState.pipelineState->outputVertexLayout();
-
-		const auto vertexCount = m_rendererState.vertexBuffer->size() / inputVertexLayout.vertexStride();
-
 		auto deleteVertexArray = [&outputVertexLayout](float* ptr) {
 			outputVertexLayout.deallocateVertexArray(ptr);
 		};
-		std::unique_ptr<float, decltype(deleteVertexArray)> workBufferPtr{
-			outputVertexLayout.allocateVertexArray(vertexCount), deleteVertexArray };
-		float* workBuffer = workBufferPtr.get();
-
-		float* vertexData = m_rendererState.vertexBuffer->get();
-		uint64_t* indexData = m_rendererState.indexBuffer->get();
-
-		m_vShaderOutputs.resize(vertexCount);
-		m_vShaderInputs.resize(vertexCount);
-		for (size_t i = 0; i < vertexCount; i++) {
-			m_vShaderInputs[i].setVertexData(inputVertexLayout.getVertexData(vertexData, i), &inputVertexLayout);
-			m_vShaderOutputs[i].setVertexData(outputVertexLayout.getVertexData(workBuffer, i), &outputVertexLayout);
-		}
 
 		ShaderContext sc{};
 		sc.setConstantBuffers(m_rendererState.constantBuffers);
@@ -305,24 +500,300 @@ namespace SoftRP {
 		m_rasterizer->setViewPort(m_rendererState.viewPort);
 		m_rasterizer->setDepthBuffer(m_rendererState.depthBuffer);
 		m_rasterizer->setPixelShader(&pixelShader);
-		m_rasterizer->setShaderContext(&sc);
+		//the clipper leaves to the rasterizer the triangles inside its guard band
+		m_clipper->setGuardBand(m_rasterizer->guardBand());
+
+		for (size_t d = 0; d < drawCount; d++) {
+			const IndexedDraw& indexedDraw = draws[d];
+			const size_t triangleCount = indexedDraw.count / 3;
+			const size_t instanceCount = indexedDraw.instanceCount;
+			if (triangleCount == 0 || instanceCount == 0)
+				continue;
+
+			//only the vertices referenced by the draw are shaded, the indices are remapped to them
+			m_vShaderInputs.clear();
+			const size_t vertexCount = gatherVertices(m_rendererState, indexedDraw.firstIndex, triangleCount * 3, 
+													  indexedDraw.baseVertex, m_vShaderInputs, m_indices, m_vertexRemap);
+
+			std::unique_ptr<float, decltype(deleteVertexArray)> workBufferPtr{
+				outputVertexLayout.allocateVertexArray(vertexCount), deleteVertexArray };
+			float* workBuffer = workBufferPtr.get();
 
+			uint32_t* indexData = m_indices.data();
 
-		for (size_t instance = 0; instance < instanceCount; instance++) {
 			m_vShaderOutputs.resize(vertexCount);
-			vertexShader(sc, m_vShaderInputs.data(), m_vShaderOutputs.data(), vertexCount, instance);
-			m_clipper->clipTriangles(m_vShaderOutputs, indexData, triangleCount, m_outIndices);
-			m_rasterizer->rasterizeTriangles(m_vShaderOutputs, m_outIndices, instance);
-			m_outIndices.clear();
+			for (size_t i = 0; i < vertexCount; i++)
+				m_vShaderOutputs[i].setVertexData(outputVertexLayout.getVertexData(workBuffer, i), &outputVertexLayout);
+
+			sc.setConstantBufferOffsets(indexedDraw.constantBufferOffsets);
+			m_rasterizer->setShaderContext(&sc);
+
+			if (m_rendererState.visibilityBuffer) {
+				//each instance is a draw on its own, whose vertices and indices are kept until it is resolved
+				for (size_t instance = 0; instance < instanceCount; instance++) {
+					const uint32_t drawId = static_cast<uint32_t>(m_visibilityDraws.size());
+					m_visibilityDraws.emplace_back(new VisibilityDraw{});
+					VisibilityDraw& draw = *m_visibilityDraws.back();
+					setupVisibilityDraw(draw, m_rendererState, vertexCount, instance, indexedDraw.constantBufferOffsets);
+					vertexShader(draw.shaderContext, m_vShaderInputs.data(), draw.vertices.data(), vertexCount, instance);
+					m_clipper->clipTriangles(draw.vertices, indexData, triangleCount, draw.indices);
+					keepClippedVertices(draw, vertexCount);
+					m_rasterizer->setShaderContext(&draw.shaderContext);
+					m_rasterizer->setVisibilityBuffer(m_rendererState.visibilityBuffer, drawId);
+					m_rasterizer->rasterizeTriangles(draw.vertices, draw.indices, instance);
+				}
+				m_rasterizer->setVisibilityBuffer(nullptr);
+			} else {
+				for (size_t instance = 0; instance < instanceCount; instance++) {
+					m_vShaderOutputs.resize(vertexCount);
+					vertexShader(sc, m_vShaderInputs.data(), m_vShaderOutputs.data(), vertexCount, instance);
+					m_clipper->clipTriangles(m_vShaderOutputs, indexData, triangleCount, m_outIndices);
+					m_rasterizer->rasterizeTriangles(m_vShaderOutputs, m_outIndices, instance);
+					m_outIndices.clear();
+				}
+			}
+
+			m_vShaderOutputs.clear();
 		}
 
 		m_vShaderInputs.clear();
-		m_vShaderOutputs.clear();
+		m_indices.clear();
 
 		return 0;
 	}
+
+	inline Renderer::Fence Renderer::resolveVisibility() {
+		handleClear();
+		if (m_visibilityDraws.empty())
+			return 0;
+		VisibilityBuffer& visibilityBuffer = *m_rendererState.visibilityBuffer;
+		RenderTarget& renderTarget = *m_rendererState.renderTarget;
+		resolveVisibilityRows(m_visibilityDraws, visibilityBuffer, renderTarget, 0, 
+							  std::min(visibilityBuffer.height(), renderTarget.height()));
+		m_visibilityDraws.clear();
+		return 0;
+	}
 #endif
 
+	inline Renderer::Fence Renderer::drawIndexed(size_t count, size_t instanceCount, size_t firstIndex, size_t baseVertex) {
+		IndexedDraw draw{};
+		draw.firstIndex = firstIndex;
+		draw.count = count;
+		draw.baseVertex = baseVertex;
+		draw.instanceCount = instanceCount;
+		return multiDrawIndexed(&draw, 1);
+	}
+
+	inline Renderer::VisibilityDraw::~VisibilityDraw() {
+		//the vertices created by the clipping own their data, the others refer to vertexData
+		vertices.clear();
+		if (vertexData)
+			rendererState.pipelineState->outputVertexLayout().deallocateVertexArray(vertexData);
+	}
+
+	inline void Renderer::setupVisibilityDraw(VisibilityDraw& draw, const RendererState& rendererState, 
+											  size_t vertexCount, size_t instance, const size_t* constantBufferOffsets) {
+		draw.rendererState = rendererState;
+		draw.instance = instance;
+		std::copy_n(constantBufferOffsets, MAX_CONSTANT_BUFFERS, draw.constantBufferOffsets);
+		draw.shaderContext.setConstantBuffers(draw.rendererState.constantBuffers);
+		draw.shaderContext.setTextureUnits(draw.rendererState.textureUnits);
+		draw.shaderContext.setConstantBufferOffsets(draw.constantBufferOffsets);
+
+		VertexLayout& outputVertexLayout = rendererState.pipelineState->outputVertexLayout();
+		draw.vertexData = outputVertexLayout.allocateVertexArray(vertexCount);
+#ifdef SOFTRP_MULTI_THREAD
+		draw.vertices = vertexVectorPool.takeOne(vertexCount);
+		draw.indices = indexVectorPool.takeOne();
+#else
+		draw.vertices.resize(vertexCount);
+#endif
+		for (size_t i = 0; i < vertexCount; i++)
+			draw.vertices[i].setVertexData(outputVertexLayout.getVertexData(draw.vertexData, i), &outputVertexLayout);
+	}
+
+	inline void Renderer::keepClippedVertices(VisibilityDraw& draw, size_t vertexCount) {
+		//the Clipper's data is valid until it clips again, copying a Vertex copies its data
+		for (size_t i = vertexCount; i < draw.vertices.size(); i++)
+			draw.vertices[i] = Vertex{ draw.vertices[i] };
+	}
+
+	/*
+	The vertices referenced are marked in a table spanning the range of the indices drawn, then assigned increasing 
+	indices in a single pass over it, which keeps them in the order of the VertexBuffer. The whole VertexBuffer is not 
+	visited, so that the cost of drawing a range of it is proportional to the range only.
+	*/
+	inline size_t Renderer::gatherVertices(const RendererState& rendererState, size_t firstIndex, size_t count, size_t baseVertex,
+										   std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<uint32_t>& remap) {
+		if (rendererState.indexBuffer16)
+			return gatherVertices(rendererState, rendererState.indexBuffer16->get() + firstIndex, count, baseVertex, 
+								  vertices, indices, remap);
+		if (rendererState.indexBuffer32)
+			return gatherVertices(rendererState, rendererState.indexBuffer32->get() + firstIndex, count, baseVertex, 
+								  vertices, indices, remap);
+		return gatherVertices(rendererState, rendererState.indexBuffer->get() + firstIndex, count, baseVertex, 
+							  vertices, indices, remap);
+	}
+
+	template<typename Index>
+	inline size_t Renderer::gatherVertices(const RendererState& rendererState, const Index* drawIndices, size_t count, size_t baseVertex,
+										   std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<uint32_t>& remap) {
+		Index minIndex = drawIndices[0];
+		Index maxIndex = drawIndices[0];
+		for (size_t i = 1; i < count; i++) {
+			minIndex = std::min(minIndex, drawIndices[i]);
+			maxIndex = std::max(maxIndex, drawIndices[i]);
+		}
+		const size_t range = static_cast<size_t>(maxIndex - minIndex) + 1;
+
+		remap.assign(range, 0);
+		for (size_t i = 0; i < count; i++)
+			remap[drawIndices[i] - minIndex] = 1;
+
+		VertexLayout& inputVertexLayout = rendererState.pipelineState->inputVertexLayout();
+		float* vertexData = rendererState.vertexBuffer->get();
+		const size_t firstVertex = static_cast<size_t>(minIndex) + baseVertex;
+		const size_t firstOutput = vertices.size();
+		vertices.resize(firstOutput + range);
+		Vertex* output = vertices.data() + firstOutput;
+		size_t vertexCount = 0;
+		for (size_t i = 0; i < range; i++) {
+			if (!remap[i])
+				continue;
+			remap[i] = static_cast<uint32_t>(vertexCount);
+			output[vertexCount++].setVertexData(inputVertexLayout.getVertexData(vertexData, firstVertex + i), &inputVertexLayout);
+		}
+		vertices.resize(firstOutput + vertexCount);
+
+		indices.resize(count);
+		for (size_t i = 0; i < count; i++)
+			indices[i] = remap[drawIndices[i] - minIndex];
+
+		return vertexCount;
+	}
+
+	/*
+	The pixels are visited a 2x2 block at the time. For each primitive visible in the block, the PixelShader of its 
+	draw is invoked with the mask of the pixels where it is visible, after its vertices have been interpolated at all 
+	the pixels of the block, as the Rasterizer does.
+	The barycentric coordinates of a pixel are reconstructed from the Screen space positions of the vertices, evaluating 
+	the edge functions at the pixel's center, then the vertices are interpolated in a perspective correct way.
+	*/
+	inline void Renderer::resolveVisibilityRows(const VisibilityDrawList& draws, VisibilityBuffer& visibilityBuffer,
+												RenderTarget& renderTarget, unsigned int firstRow, unsigned int lastRow) {
+
+		const unsigned int width = std::min(visibilityBuffer.width(), renderTarget.width());
+		const VisibilitySample emptySample = VisibilityBuffer::emptySample();
+
+		//storage of the interpolated vertices, large enough for any of the draws' layouts
+		size_t vertexStride = 0;
+		for (const auto& draw : draws)
+			vertexStride = std::max(vertexStride, draw->rendererState.pipelineState->outputVertexLayout().vertexStride());
+		auto deleteInterpolationData = [](float* ptr) {
+			AlignedAllocator::deallocate(ptr);
+		};
+		std::unique_ptr<float, decltype(deleteInterpolationData)> interpolationDataPtr{
+			static_cast<float*>(AlignedAllocator::allocate(4 * vertexStride * sizeof(float), 16)), deleteInterpolationData };
+		float* interpolationData = interpolationDataPtr.get();
+
+		PSExecutionContext execContext{};
+
+		//the primitive whose vertices are bound to the execution context, kept across blocks
+		VisibilitySample current = emptySample;
+		const VisibilityDraw* draw = nullptr;
+		const Vertex* vertices[3]{};
+		float screenX[3]{};
+		float screenY[3]{};
+		float invW[3]{};
+		float invTwiceArea = 0.0f;
+
+		for (unsigned int y = firstRow; y < lastRow; y += 2) {
+			for (unsigned int x = 0; x < width; x += 2) {
+
+				//in a block, the pixels are ordered as (x + 1, y + 1), (x, y + 1), (x + 1, y), (x, y)
+				const unsigned int xPositions[4]{ x + 1, x, x + 1, x };
+				const unsigned int yPositions[4]{ y + 1, y + 1, y, y };
+
+				VisibilitySample samples[4];
+				for (unsigned int k = 0; k < 4; k++) {
+					const bool inside = xPositions[k] < width && yPositions[k] < lastRow;
+					samples[k] = inside ? visibilityBuffer.get(yPositions[k], xPositions[k]) : emptySample;
+				}
+
+				int resolved = 0;
+				for (unsigned int k = 0; k < 4; k++) {
+					if (samples[k].empty() || (resolved & (1 << k)) != 0)
+						continue;
+
+					int mask = 0;
+					for (unsigned int l = k; l < 4; l++) {
+						if (samples[l] == samples[k])
+							mask |= (1 << l);
+					}
+					resolved |= mask;
+
+					if (samples[k] != current) {
+						current = samples[k];
+						draw = draws[current.drawId].get();
+
+						const FMatrix viewPortTransform = createFM(draw->rendererState.viewPort->getTransform());
+						const uint32_t* indices = &draw->indices[static_cast<size_t>(current.primitiveId) * 3];
+						for (unsigned int v = 0; v < 3; v++) {
+							vertices[v] = &draw->vertices[indices[v]];
+							const Math::Vector4& position = vertices[v]->position();
+							invW[v] = 1.0f / position[3];
+							const Math::Vector4 screenPosition = createVector4FV(
+								mulFV(mulFM(viewPortTransform, createFV(position)), createFV(invW[v], invW[v], invW[v], invW[v])));
+							//snapped to the same sub-pixel precision used by the rasterizers (4 fractional bits)
+							screenX[v] = std::floor(screenPosition[0] * 16.0f + 0.5f) / 16.0f;
+							screenY[v] = std::floor(screenPosition[1] * 16.0f + 0.5f) / 16.0f;
+						}
+						invTwiceArea = 1.0f / ((screenX[1] - screenX[0])*(screenY[2] - screenY[0]) - 
+											   (screenY[1] - screenY[0])*(screenX[2] - screenX[0]));
+
+						VertexLayout* vertexLayout = &draw->rendererState.pipelineState->outputVertexLayout();
+						for (unsigned int p = 0; p < 4; p++) {
+							execContext.interpolated[p].setVertexData(interpolationData + p*vertexStride, vertexLayout);
+							//the position is not interpolated, the one of the first vertex is given
+							execContext.interpolated[p].position() = vertices[0]->position();
+						}
+					}
+
+					//interpolate the vertices at all the pixels of the block
+					const size_t attributeCount = execContext.interpolated[0].vertexLayout().vertexStride() - 4;
+					for (unsigned int p = 0; p < 4; p++) {
+						const float pixelX = static_cast<float>(xPositions[p]) - screenX[0];
+						const float pixelY = static_cast<float>(yPositions[p]) - screenY[0];
+						const float b = (pixelX*(screenY[2] - screenY[0]) - pixelY*(screenX[2] - screenX[0])) * invTwiceArea;
+						const float c = ((screenX[1] - screenX[0])*pixelY - (screenY[1] - screenY[0])*pixelX) * invTwiceArea;
+						const float aOnW0 = (1.0f - b - c) * invW[0];
+						const float bOnW1 = b * invW[1];
+						const float cOnW2 = c * invW[2];
+						const float invSum = 1.0f / (aOnW0 + bOnW1 + cOnW2);
+
+						const float* f0 = vertices[0]->vertexData() + 4;
+						const float* f1 = vertices[1]->vertexData() + 4;
+						const float* f2 = vertices[2]->vertexData() + 4;
+						float* attributes = execContext.interpolated[p].vertexData() + 4;
+						for (size_t f = 0; f < attributeCount; f++)
+							attributes[f] = (aOnW0*f0[f] + bOnW1*f1[f] + cOnW2*f2[f]) * invSum;
+					}
+
+					execContext.mask = mask;
+					Math::Vector4 outColors[4];
+					draw->rendererState.pipelineState->pixelShader()(draw->shaderContext, execContext, draw->instance, outColors);
+
+					for (unsigned int p = 0; p < 4; p++) {
+						if ((mask & (1 << p)) == 0)
+							continue;
+						renderTarget.set(yPositions[p], xPositions[p], outColors[p]);
+						visibilityBuffer.set(yPositions[p], xPositions[p], emptySample);
+					}
+				}
+			}
+		}
+	}
+
 	inline void Renderer::setVertexBuffer(VertexBuffer* vertexBuffer) {
 		assert(vertexBuffer != nullptr);
 		m_rendererState.vertexBuffer = vertexBuffer;
@@ -331,6 +802,22 @@ namespace SoftRP {
 	inline void Renderer::setIndexBuffer(IndexBuffer* indexBuffer) {
 		assert(indexBuffer != nullptr);
 		m_rendererState.indexBuffer = indexBuffer;
+		m_rendererState.indexBuffer32 = nullptr;
+		m_rendererState.indexBuffer16 = nullptr;
+	}
+
+	inline void Renderer::setIndexBuffer(IndexBuffer32* indexBuffer) {
+		assert(indexBuffer != nullptr);
+		m_rendererState.indexBuffer = nullptr;
+		m_rendererState.indexBuffer32 = indexBuffer;
+		m_rendererState.indexBuffer16 = nullptr;
+	}
+
+	inline void Renderer::setIndexBuffer(IndexBuffer16* indexBuffer) {
+		assert(indexBuffer != nullptr);
+		m_rendererState.indexBuffer = nullptr;
+		m_rendererState.indexBuffer32 = nullptr;
+		m_rendererState.indexBuffer16 = indexBuffer;
 	}
 
 	inline void Renderer::setRenderTarget(RenderTarget* renderTarget) {
@@ -353,6 +840,10 @@ namespace SoftRP {
 		m_rendererState.pipelineState = pipelineState;
 	}
 
+	inline void Renderer::setVisibilityBuffer(VisibilityBuffer* visibilityBuffer) {
+		m_rendererState.visibilityBuffer = visibilityBuffer;
+	}
+
 	inline void Renderer::clearDepthBuffer() {
 		m_clearDepth = true;
 	}
@@ -391,10 +882,13 @@ namespace SoftRP {
 
 	inline VertexBuffer* Renderer::getVertexBuffer()const { return m_rendererState.vertexBuffer; }
 	inline IndexBuffer* Renderer::getIndexBuffer()const { return m_rendererState.indexBuffer; }
+	inline IndexBuffer32* Renderer::getIndexBuffer32()const { return m_rendererState.indexBuffer32; }
+	inline IndexBuffer16* Renderer::getIndexBuffer16()const { return m_rendererState.indexBuffer16; }
 	inline RenderTarget* Renderer::getRenderTarget()const { return m_rendererState.renderTarget; }
 	inline DepthBuffer* Renderer::getDepthBuffer()const { return m_rendererState.depthBuffer; }
 	inline ViewPort* Renderer::getViewPort()const { return m_rendererState.viewPort; }
 	inline PipelineState* Renderer::getPipelineState()const { return m_rendererState.pipelineState; }
+	inline VisibilityBuffer* Renderer::getVisibilityBuffer()const { return m_rendererState.visibilityBuffer; }
 	inline ConstantBuffer* Renderer::getConstantBuffer(size_t slot)const {
 		assert(slot < MAX_CONSTANT_BUFFERS && slot >= 0);
 		return m_rendererState.constantBuffers[slot];
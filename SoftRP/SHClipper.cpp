@@ -1,7 +1,11 @@
 #include "SHClipper.h"
 #include<utility>
+#include<algorithm>
 #include"Vertex.h"
 #include "SIMDInclude.h"
+#include "FVector.h"
+#include "CPUFeatures.h"
+#include "AlignedPoolArrayAllocator.h"
 #ifdef _DEBUG
 #include <stdexcept>
 #endif
@@ -11,22 +15,65 @@ using Math::Vector4;
 using std::vector;
 
 
-SHClipper::TriangleTaskOutput::TriangleTaskOutput(TriangleTaskOutput&& tto) {
-#ifdef SOFTRP_MULTI_THREAD
-	std::lock_guard<std::mutex> lock{ tto.mutex };
-	done = tto.done;
+/*
+outcodes of a vertex, a bit for each plane the vertex is outside of. the first six refer to the view volume's planes, 
+the other four to the planes of the guard band along the x and y axes (see Clipper)
+*/
+static constexpr unsigned int VIEW_VOLUME_OUTCODES = 0x3F;
+//the planes triangles are clipped against: near, far and the guard band's ones
+static constexpr unsigned int CLIPPING_OUTCODES = 0x3F0;
+static uint32_t outcode(const Vector4& position, const Math::Vector2& guardBand);
+
+
+SHClipper::SHClipper() {
+#ifdef SOFTRP_USE_SIMD
+	switch (supportedSIMDLevel()) {
+	case SIMDLevel::AVX512:
+	case SIMDLevel::AVX2:
+		m_outcodesKernel = &SHClipper::computeOutcodesAVX2;
+		break;
+	case SIMDLevel::SSE4:
+		m_outcodesKernel = &SHClipper::computeOutcodesSSE;
+		break;
+	default:
+		m_outcodesKernel = &SHClipper::computeOutcodesScalar;
+		break;
+	}
 #endif
-	indices = std::move(tto.indices);
 }
 
+#ifdef SOFTRP_MULTI_THREAD
+ThreadPool::Fence SHClipper::clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, 
+										   size_t triangleCount, std::vector<uint32_t>& outIndices, 
+										   ThreadPool& threadPool) {
+	return clip(vertices, inIndices, nullptr, triangleCount, outIndices, nullptr, threadPool);
+}
+
+ThreadPool::Fence SHClipper::clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, const uint32_t* inTags,
+										   size_t triangleCount, std::vector<uint32_t>& outIndices, 
+										   std::vector<uint32_t>& outTags, ThreadPool& threadPool) {
+	return clip(vertices, inIndices, inTags, triangleCount, outIndices, &outTags, threadPool);
+}
+#else
+void SHClipper::clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices,
+							  size_t triangleCount,	std::vector<uint32_t>& outIndices) {
+	clip(vertices, inIndices, nullptr, triangleCount, outIndices, nullptr);
+}
+
+void SHClipper::clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, const uint32_t* inTags,
+							  size_t triangleCount, std::vector<uint32_t>& outIndices, 
+							  std::vector<uint32_t>& outTags) {
+	clip(vertices, inIndices, inTags, triangleCount, outIndices, &outTags);
+}
+#endif
 
 #ifdef SOFTRP_MULTI_THREAD
-ThreadPool::Fence SHClipper::clipTriangles(std::vector<Vertex>& vertices, uint64_t* inIndices, 
-										   size_t triangleCount, std::vector<uint64_t>& outIndices, 
-										   ThreadPool& threadPool)
+ThreadPool::Fence SHClipper::clip(std::vector<Vertex>& vertices, const uint32_t* inIndices, const uint32_t* inTags,
+								  size_t triangleCount, std::vector<uint32_t>& outIndices, std::vector<uint32_t>* outTags,
+								  ThreadPool& threadPool)
 #else
-void SHClipper::clipTriangles(std::vector<Vertex>& vertices, uint64_t* inIndices,
-							  size_t triangleCount,	std::vector<uint64_t>& outIndices)
+void SHClipper::clip(std::vector<Vertex>& vertices, const uint32_t* inIndices, const uint32_t* inTags,
+					 size_t triangleCount, std::vector<uint32_t>& outIndices, std::vector<uint32_t>* outTags)
 #endif
 																										{
 #ifdef _DEBUG
@@ -35,52 +82,187 @@ void SHClipper::clipTriangles(std::vector<Vertex>& vertices, uint64_t* inIndices
 #endif
 
 	/*
-	A task for each triangle is executed. Each task consists of clipping a triangle against all the clipping planes.
-	Another task is then executed which prepares the tasks' outputs and write them in the correct order in outIndices.
-	A different approach could be considered, where all triangles are clipped against one clipping planes at the time,
-	but it can't be	parallelized easily as the former.
+	The triangles are split in chunks of CHUNK_SIZE triangles, which are clipped in parallel. Clipping a triangle consists 
+	of clipping it against all the clipping planes. A different approach could be considered, where all triangles are 
+	clipped against one clipping planes at the time, but it can't be parallelized easily as the former.
+	Each chunk writes the triangles it produces to its own buffer, in primitive order, and the vertices it generates 
+	to its own arena, so that the chunks share nothing but the input. Once all the chunks are done, the prefix sum of 
+	the buffers' and arenas' sizes gives the position of each of them in outIndices and vertices, which are resized 
+	once and filled in parallel. The tags of the triangles, if any, follow their indices.
+	Most of the triangles don't need to be clipped: the ones which are inside the guard band and between the near and 
+	far planes are accepted as they are, the ones which are entirely outside one of the view volume's planes are 
+	discarded. They are classified with the outcodes of their vertices, which are computed once per vertex, several 
+	vertices at the time.
 	*/
 
-	m_triangleTaskOutputs.resize(triangleCount);
-	/*
-	the following pointers are necessary because capturing a reference in a lambda
-	doesn't actually capture the object referenced to, but the reference variable itself
-	*/
-	std::vector<Vertex>* verticesPtr = &vertices;
-	std::vector<uint64_t>* indicesPtr = &outIndices;
+	const size_t vertexCount = vertices.size();
+	m_outcodes.resize(vertexCount);
+	(this->*m_outcodesKernel)(vertices, 0, vertexCount);
+
+	const size_t chunkCount = (triangleCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if (m_chunks.size() < chunkCount)
+		m_chunks.resize(chunkCount);
+
+#ifdef SOFTRP_MULTI_THREAD
+	threadPool.parallelFor(chunkCount, [this, &vertices, inIndices, inTags, triangleCount](size_t chunk) {
+		clipChunk(vertices, inIndices, inTags, triangleCount, chunk);
+	});
+#else
+	for (size_t chunk = 0; chunk < chunkCount; chunk++)
+		clipChunk(vertices, inIndices, inTags, triangleCount, chunk);
+#endif
 
-	for (size_t i = 0; i < triangleCount; i++) {
+	//exclusive prefix sums of the number of indices and vertices produced by the chunks, appended to the outputs
+	size_t offset = outIndices.size();
+	size_t vertexOffset = vertexCount;
+	for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+		Chunk& c = m_chunks[chunk];
+		c.offset = offset;
+		c.vertexOffset = vertexOffset;
+		offset += c.indices.size();
+		vertexOffset += c.vertexCount;
+	}
+	outIndices.resize(offset);
+	vertices.resize(vertexOffset);
+	if (outTags)
+		outTags->resize(offset / 3);
+
+	uint32_t* outIndicesData = outIndices.data();
+	uint32_t* outTagsData = outTags ? outTags->data() : nullptr;
+	for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+		if (m_chunks[chunk].indices.empty() && m_chunks[chunk].vertexCount == 0)
+			continue;
 #ifdef SOFTRP_MULTI_THREAD
-		m_triangleTaskOutputs[i].done = false;
-		threadPool.addTask([this, verticesPtr, inIndices, i]() {
-			clipTriangleTask(verticesPtr, inIndices, i);
+		threadPool.addTask([this, &vertices, outIndicesData, outTagsData, chunk]() {
+			compactChunk(vertices, outIndicesData, outTagsData, chunk);
 		});
 #else
-		clipTriangleTask(verticesPtr, inIndices, i);
+		compactChunk(vertices, outIndicesData, outTagsData, chunk);
 #endif
 	}
 
 #ifdef SOFTRP_MULTI_THREAD
-	return threadPool.addTaskAndFence(
-		[this, triangleCount, indicesPtr]() {
-		prepareOutputTask(triangleCount, indicesPtr);
-	});
-#else
-	prepareOutputTask(triangleCount, indicesPtr);
+	return threadPool.addFence();
 #endif
 }
 
+void SHClipper::computeOutcodesScalar(const std::vector<Vertex>& vertices, size_t first, size_t last) {
+	const Math::Vector2& band = guardBand();
+	for (size_t i = first; i < last; i++)
+		m_outcodes[i] = outcode(vertices[i].position(), band);
+}
+
+#ifdef SOFTRP_USE_SIMD
+/*
+the SIMD versions follow outcode(), computing the outcodes of a vertex per lane. a plane's comparison yields all ones in
+the lanes of the vertices outside of it, which are masked with the plane's bit and ORed to the outcodes.
+*/
+inline static __m128i planeOutcodes(__m128 planeTest, int32_t bit) {
+	return _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(planeTest, _mm_setzero_ps())), _mm_set1_epi32(bit));
+}
+
+SOFTRP_TARGET_SSE4
+void SHClipper::computeOutcodesSSE(const std::vector<Vertex>& vertices, size_t first, size_t last) {
+	const __m128 gx = _mm_set_ps1(guardBand()[0]);
+	const __m128 gy = _mm_set_ps1(guardBand()[1]);
+	size_t i = first;
+	for (; i + 4 <= last; i += 4) {
+		//after the transposition, each register holds a coordinate of the 4 vertices
+		__m128 x = _mm_load_ps(vertices[i].position().data());
+		__m128 y = _mm_load_ps(vertices[i + 1].position().data());
+		__m128 z = _mm_load_ps(vertices[i + 2].position().data());
+		__m128 w = _mm_load_ps(vertices[i + 3].position().data());
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		const __m128 gxw = _mm_mul_ps(gx, w);
+		const __m128 gyw = _mm_mul_ps(gy, w);
+		__m128i outcodes = _mm_or_si128(planeOutcodes(_mm_add_ps(x, w), 0x1), planeOutcodes(_mm_sub_ps(w, x), 0x2));
+		outcodes = _mm_or_si128(outcodes, _mm_or_si128(planeOutcodes(_mm_add_ps(y, w), 0x4), planeOutcodes(_mm_sub_ps(w, y), 0x8)));
+		outcodes = _mm_or_si128(outcodes, _mm_or_si128(planeOutcodes(_mm_add_ps(z, w), 0x10), planeOutcodes(_mm_sub_ps(w, z), 0x20)));
+		outcodes = _mm_or_si128(outcodes, _mm_or_si128(planeOutcodes(_mm_add_ps(x, gxw), 0x40), planeOutcodes(_mm_sub_ps(gxw, x), 0x80)));
+		outcodes = _mm_or_si128(outcodes, _mm_or_si128(planeOutcodes(_mm_add_ps(y, gyw), 0x100), planeOutcodes(_mm_sub_ps(gyw, y), 0x200)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&m_outcodes[i]), outcodes);
+	}
+	computeOutcodesScalar(vertices, i, last);
+}
+
+SOFTRP_TARGET_AVX2
+inline static __m256i planeOutcodes(__m256 planeTest, int32_t bit) {
+	return _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(planeTest, _mm256_setzero_ps(), _CMP_LT_OQ)), _mm256_set1_epi32(bit));
+}
+
+SOFTRP_TARGET_AVX2
+void SHClipper::computeOutcodesAVX2(const std::vector<Vertex>& vertices, size_t first, size_t last) {
+	const __m256 gx = _mm256_set1_ps(guardBand()[0]);
+	const __m256 gy = _mm256_set1_ps(guardBand()[1]);
+	size_t i = first;
+	for (; i + 8 <= last; i += 8) {
+		//transpose the positions of the first and last 4 vertices, then join the coordinates of the 8 vertices
+		__m128 x0 = _mm_load_ps(vertices[i].position().data());
+		__m128 y0 = _mm_load_ps(vertices[i + 1].position().data());
+		__m128 z0 = _mm_load_ps(vertices[i + 2].position().data());
+		__m128 w0 = _mm_load_ps(vertices[i + 3].position().data());
+		__m128 x1 = _mm_load_ps(vertices[i + 4].position().data());
+		__m128 y1 = _mm_load_ps(vertices[i + 5].position().data());
+		__m128 z1 = _mm_load_ps(vertices[i + 6].position().data());
+		__m128 w1 = _mm_load_ps(vertices[i + 7].position().data());
+		_MM_TRANSPOSE4_PS(x0, y0, z0, w0);
+		_MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+		const __m256 x = _mm256_set_m128(x1, x0);
+		const __m256 y = _mm256_set_m128(y1, y0);
+		const __m256 z = _mm256_set_m128(z1, z0);
+		const __m256 w = _mm256_set_m128(w1, w0);
+		const __m256 gxw = _mm256_mul_ps(gx, w);
+		const __m256 gyw = _mm256_mul_ps(gy, w);
+		__m256i outcodes = _mm256_or_si256(planeOutcodes(_mm256_add_ps(x, w), 0x1), planeOutcodes(_mm256_sub_ps(w, x), 0x2));
+		outcodes = _mm256_or_si256(outcodes, _mm256_or_si256(planeOutcodes(_mm256_add_ps(y, w), 0x4), planeOutcodes(_mm256_sub_ps(w, y), 0x8)));
+		outcodes = _mm256_or_si256(outcodes, _mm256_or_si256(planeOutcodes(_mm256_add_ps(z, w), 0x10), planeOutcodes(_mm256_sub_ps(w, z), 0x20)));
+		outcodes = _mm256_or_si256(outcodes, _mm256_or_si256(planeOutcodes(_mm256_add_ps(x, gxw), 0x40), planeOutcodes(_mm256_sub_ps(gxw, x), 0x80)));
+		outcodes = _mm256_or_si256(outcodes, _mm256_or_si256(planeOutcodes(_mm256_add_ps(y, gyw), 0x100), planeOutcodes(_mm256_sub_ps(gyw, y), 0x200)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&m_outcodes[i]), outcodes);
+	}
+	computeOutcodesScalar(vertices, i, last);
+}
+#endif
+
 //helper functions forward declarations
 static float intersectEdgePlane(const float p1DotPlane, float p2DotPlane);
 #ifdef SOFTRP_USE_SIMD
 static __m128 intersectEdgePlane(const __m128 p1DotPlane, const __m128 p2DotPlane);
-static void lerpVertex(Vertex& v0, const Vertex& v1, __m128 t);
+static void lerpVertex(float* out, const float* v0, const float* v1, __m128 t, size_t vertexStride);
+#else
+static void lerpVertex(float* out, const float* v0, const float* v1, float t, size_t vertexStride);
 #endif
-static void triangulate(std::vector<uint64_t>& indices, std::vector<uint64_t>* outIndices);
-
+static void triangulate(const uint32_t* polygon, size_t vertexCount, std::vector<uint32_t>& outIndices);
+
+
+void SHClipper::clipChunk(const std::vector<Vertex>& vertices, const uint32_t* inIndices, const uint32_t* inTags, 
+						  size_t triangleCount, size_t chunk) {
+	Chunk& c = m_chunks[chunk];
+	c.vertexStride = vertices[0].vertexLayout().vertexStride();
+	c.vertexCount = 0;
+	std::vector<uint32_t>& outIndices = c.indices;
+	const size_t first = chunk * CHUNK_SIZE;
+	const size_t last = std::min(first + CHUNK_SIZE, triangleCount);
+	for (size_t i = first, index = first * 3; i < last; i++, index += 3) {
+		const uint32_t* triangle = inIndices + index;
+		const uint32_t outcode0 = m_outcodes[triangle[0]];
+		const uint32_t outcode1 = m_outcodes[triangle[1]];
+		const uint32_t outcode2 = m_outcodes[triangle[2]];
+		if ((outcode0 & outcode1 & outcode2 & VIEW_VOLUME_OUTCODES) != 0)
+			//discard triangle
+			continue;
+		if (((outcode0 | outcode1 | outcode2) & CLIPPING_OUTCODES) == 0)
+			//accept triangle
+			outIndices.insert(outIndices.end(), triangle, triangle + 3);
+		else
+			clipTriangle(vertices, triangle, c);
+		//the triangles produced from the i-th one take its tag
+		if (inTags)
+			c.tags.resize(outIndices.size() / 3, inTags[i]);
+	}
+}
 
-void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inIndices,
-								 size_t triangleOutputIndex) {
+void SHClipper::clipTriangle(const std::vector<Vertex>& vertices, const uint32_t* triangle, Chunk& chunk) {
 
 	/*
 	clipping planes defined in Clip space, the 4D space in which the vertices are expressed before the 
@@ -92,16 +274,23 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 	dot((a, b, c, d),(x, y, z, w)) = ax + by + cz + dw + 0 = ax + by + cz + dw = 0
 	*/
 
+	/*
+	the x and y planes are the guard band's ones, gx and gy being its factors (see Clipper). 
+	gx = gy = 1 yields the view volume's planes.
+	*/
+	const float gx = guardBand()[0];
+	const float gy = guardBand()[1];
+
 #ifdef SOFTRP_USE_SIMD
 	const __m128 planes[] = {
-		//x+w >= 0
-		_mm_set_ps(1.0f, 0.0f, 0.0f, 1.0f),
-		//w-x >= 0
-		_mm_set_ps(1.0f, 0.0f, 0.0f, -1.0f),
-		//y+w >= 0
-		_mm_set_ps(1.0f, 0.0f, 1.0f, 0.0f),
-		//w-y >= 0
-		_mm_set_ps(1.0f, 0.0f, -1.0f, 0.0f),
+		//x+gx*w >= 0
+		_mm_set_ps(gx, 0.0f, 0.0f, 1.0f),
+		//gx*w-x >= 0
+		_mm_set_ps(gx, 0.0f, 0.0f, -1.0f),
+		//y+gy*w >= 0
+		_mm_set_ps(gy, 0.0f, 1.0f, 0.0f),
+		//gy*w-y >= 0
+		_mm_set_ps(gy, 0.0f, -1.0f, 0.0f),
 		//z+w >= 0
 		_mm_set_ps(1.0f, 1.0f, 0.0f, 0.0f),
 		//w-z >= 0
@@ -109,14 +298,14 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 	};
 #else
 	const Vector4 planes[] = {
-		//x+w >= 0
-		Vector4{ 1.0f, 0.0f, 0.0f, 1.0f },
-		//w-x >= 0
-		Vector4{ -1.0f, 0.0f, 0.0f, 1.0f },
-		//y+w >= 0
-		Vector4{ 0.0f, 1.0f, 0.0f, 1.0f },
-		//w-y >= 0
-		Vector4{ 0.0f, -1.0f, 0.0f, 1.0f },
+		//x+gx*w >= 0
+		Vector4{ 1.0f, 0.0f, 0.0f, gx },
+		//gx*w-x >= 0
+		Vector4{ -1.0f, 0.0f, 0.0f, gx },
+		//y+gy*w >= 0
+		Vector4{ 0.0f, 1.0f, 0.0f, gy },
+		//gy*w-y >= 0
+		Vector4{ 0.0f, -1.0f, 0.0f, gy },
 		//z+w >= 0
 		Vector4{ 0.0f, 0.0f, 1.0f, 1.0f },
 		//w-z >= 0
@@ -124,24 +313,23 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 	};
 #endif
 
-	TriangleTaskOutput& output = m_triangleTaskOutputs[triangleOutputIndex];
-	std::vector<Vertex>& vertices = *_vertices;
-	size_t vertexIndex = triangleOutputIndex * 3;
+	constexpr size_t planeCount = sizeof(planes) / sizeof(planes[0]);
+	//clipping a convex polygon with k vertices against a plane yields a convex polygon with k+1 vertices
+	constexpr size_t MAX_VERTICES = 3 + planeCount;
 
 	/*
 	iterate through the clipping planes. for each clip plane, inList is used as input and outList as output. the two are then
 	swapped before considering the next plane.
-	because the lists' contents are swapped	at the beginning of the main loop, the initial indices are placed in outList.
+	because the lists are swapped at the beginning of the main loop, the initial indices are placed in outList.
+	the lists are large enough for the largest polygon, so that clipping a triangle doesn't allocate them.
 	*/
-	vector<uint64_t> inList{};
-	vector<uint64_t>& outList = output.indices;
-	outList.push_back(inIndices[vertexIndex]);
-	outList.push_back(inIndices[vertexIndex + 1]);
-	outList.push_back(inIndices[vertexIndex + 2]);
-
-	constexpr size_t planeCount = sizeof(planes) / sizeof(planes[0]);
-	//clipping a convex polygon with k vertices against a plane yields a convex polygon with k+1 vertices
-	constexpr size_t MAX_VERTICES = 3 + planeCount;
+	uint32_t lists[2][MAX_VERTICES];
+	uint32_t* inList = lists[1];
+	uint32_t* outList = lists[0];
+	size_t outCount = 3;
+	outList[0] = triangle[0];
+	outList[1] = triangle[1];
+	outList[2] = triangle[2];
 
 #ifdef SOFTRP_USE_SIMD
 	__m128i insideTest[MAX_VERTICES];
@@ -153,7 +341,7 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 
 	for (size_t k = 0; k < planeCount; k++) {
 
-		size_t vertexCount = outList.size();
+		size_t vertexCount = outCount;
 		
 		if (vertexCount < 2)
 			break;
@@ -163,8 +351,9 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 			throw std::runtime_error{ "Programmer's ignorance produced an error!" };
 #endif
 
-		//move outList content to inList
-		inList = std::move(outList);
+		//swap the lists, so that outList's content becomes inList's one
+		std::swap(inList, outList);
+		outCount = 0;
 
 #ifdef SOFTRP_USE_SIMD
 		const __m128& plane = planes[k];
@@ -175,37 +364,29 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 		bool cull = true;
 #endif
 
-#ifdef SOFTRP_MULTI_THREAD
-		{
-			//access to vertices is shared
-			std::lock_guard<std::mutex> lock{ m_mutex };
-#endif
-			/*
-			test all vertices against the plane, i.e. find out for each vertex, in which side of the plane lies.
-			this is done using the dot product.
-			*/
-			for (size_t i = 0; i < vertexCount; i++) {
+		/*
+		test all vertices against the plane, i.e. find out for each vertex, in which side of the plane lies.
+		this is done using the dot product. the position is the first field of a vertex.
+		*/
+		for (size_t i = 0; i < vertexCount; i++) {
+			const float* position = chunk.vertexData(vertices, inList[i]);
 #ifdef SOFTRP_USE_SIMD
-				const Vector4& position = vertices[inList[i]].position();
-				__m128 posVec = _mm_load_ps(position.data());
-				const __m128 planeTest = _mm_dp_ps(plane, posVec, 0xFF);
-				planeTests[i] = planeTest;
-				insideTest[i] = _mm_castps_si128(_mm_cmpge_ps(planeTest, zero));
-				cull = _mm_or_si128(cull, insideTest[i]);
+			__m128 posVec = _mm_load_ps(position);
+			const __m128 planeTest = dotReplicateFV(plane, posVec);
+			planeTests[i] = planeTest;
+			insideTest[i] = _mm_castps_si128(_mm_cmpge_ps(planeTest, zero));
+			cull = _mm_or_si128(cull, insideTest[i]);
 #else
-				const float planeTest = plane.dot(vertices[inList[i]].position());
-				planeTests[i] = planeTest;
-				const bool test = planeTest >= 0;
-				insideTest[i] = test;
-				cull = cull && !test;
+			const float planeTest = plane.dot(*Math::vectorFromPtr<4>(position));
+			planeTests[i] = planeTest;
+			const bool test = planeTest >= 0;
+			insideTest[i] = test;
+			cull = cull && !test;
 #endif
-			}
-#ifdef SOFTRP_MULTI_THREAD
 		}
-#endif
 
 #ifdef SOFTRP_USE_SIMD
-		if (cull.m128i_i32[0] == 0)
+		if (laneI32(cull, 0) == 0)
 			break;
 #else
 		if (cull)
@@ -232,10 +413,10 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 		add the second vertex to the output list		
 		*/
 
-		uint64_t first = inList[0];
-		uint64_t second;
+		uint32_t first = inList[0];
+		uint32_t second;
 #ifdef SOFTRP_USE_SIMD
-		bool firstInside = insideTest[0].m128i_i32[0] != 0;
+		bool firstInside = laneI32(insideTest[0], 0) != 0;
 #else
 		bool firstInside = insideTest[0];
 #endif
@@ -248,7 +429,7 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 			second = inList[secondIndex];
 
 #ifdef SOFTRP_USE_SIMD
-			secondInside = insideTest[secondIndex].m128i_i32[0] != 0;
+			secondInside = laneI32(insideTest[secondIndex], 0) != 0;
 #else
 			secondInside = insideTest[secondIndex];
 #endif		
@@ -260,48 +441,25 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 #else
 				const float t = intersectEdgePlane(planeTests[i], planeTests[secondIndex]);
 #endif
-				uint64_t newVertexIndex;
-#ifdef SOFTRP_MULTI_THREAD
-				{
-					//access to vertices is shared
-					std::lock_guard<std::mutex> lock{ m_mutex };
-#endif
-					Vertex newVertex{ vertices[first] };
-#ifdef SOFTRP_USE_SIMD
-					lerpVertex(newVertex, vertices[second], t);
-#else
-					newVertex.lerp(t, vertices[second]);
-#endif
-					//move newVertex
-					newVertexIndex = vertices.size();
-					vertices.push_back(std::move(newVertex));
-#ifdef SOFTRP_MULTI_THREAD
-				}
-#endif
-				outList.push_back(newVertexIndex);
+				//adding a vertex may grow the arena, so the data of the edge's vertices is retrieved afterwards
+				const uint32_t newVertexIndex = chunk.addVertex();
+				lerpVertex(chunk.generatedVertex(newVertexIndex & ~GENERATED_VERTEX), chunk.vertexData(vertices, first),
+						   chunk.vertexData(vertices, second), t, chunk.vertexStride);
+				outList[outCount++] = newVertexIndex;
 				if (!firstInside)
 					//cover first case
-					outList.push_back(second);
+					outList[outCount++] = second;
 			}
 			//fourth case
 			else if (firstInside && secondInside)
-				outList.push_back(second);
+				outList[outCount++] = second;
 			//else third case
 		}
 	}
 
-	if (outList.size() < 3)
-		//discard triangle
-		outList.clear();
-
-#ifdef SOFTRP_MULTI_THREAD
-	//notify the end of the task
-	{		
-		std::lock_guard<std::mutex> lock{ output.mutex };
-		output.done = true;
-	}
-	output.triangleClippedReady.notify_one();
-#endif
+	//clipping a triangle may result in a convex polygon that needs to be triangulated. otherwise, discard triangle
+	if (outCount >= 3)
+		triangulate(outList, outCount, chunk.indices);
 	
 	/*
 	TODO: Consider triangulating.
@@ -326,35 +484,70 @@ void SHClipper::clipTriangleTask(std::vector<Vertex>* _vertices, uint64_t* inInd
 }
 
 
-void SHClipper::prepareOutputTask(size_t triangleCount, std::vector<uint64_t>* outIndices) {
-	
-	for (size_t i = 0; i < triangleCount; i++) {
-		TriangleTaskOutput& output = m_triangleTaskOutputs[i];
-#ifdef SOFTRP_MULTI_THREAD
-		{
-			//wait for the triangle to be clipped
-			std::unique_lock<std::mutex> lock{ output.mutex };
-			while (!output.done)
-				output.triangleClippedReady.wait(lock);
-			output.done = false;
-		}
-#endif
-		std::vector<uint64_t>& triangleIndices = output.indices;
-		size_t indexCount = triangleIndices.size();
-		if (indexCount == 0)
-			continue;
-		//clipping a triangle may result in a convex polygon that needs to be triangulated
-		triangulate(triangleIndices, outIndices);
-		triangleIndices.clear();
+void SHClipper::compactChunk(std::vector<Vertex>& vertices, uint32_t* outIndices, uint32_t* outTags, size_t chunk) {
+	Chunk& c = m_chunks[chunk];
+	VertexLayout* vertexLayout = &vertices[0].vertexLayout();
+	for (size_t i = 0; i < c.vertexCount; i++)
+		vertices[c.vertexOffset + i].setVertexData(c.generatedVertex(i), vertexLayout);
+	//the generated vertices' indices are relative to the chunk's arena
+	std::transform(c.indices.begin(), c.indices.end(), outIndices + c.offset, [&c](uint32_t index) {
+		return (index & GENERATED_VERTEX) != 0 ? c.vertexOffset + (index & ~GENERATED_VERTEX) : index;
+	});
+	c.indices.clear();
+	if (outTags)
+		std::copy(c.tags.begin(), c.tags.end(), outTags + c.offset / 3);
+	c.tags.clear();
+}
+
+void SHClipper::ArenaDeleter::operator()(float* data) const {
+	AlignedAllocator::deallocate(data);
+}
+
+float* SHClipper::Chunk::generatedVertex(size_t index) {
+	return arena.get() + index * vertexStride;
+}
+
+const float* SHClipper::Chunk::vertexData(const std::vector<Vertex>& vertices, uint32_t index) const {
+	if ((index & GENERATED_VERTEX) != 0)
+		return arena.get() + (index & ~GENERATED_VERTEX) * vertexStride;
+	return vertices[index].vertexData();
+}
+
+uint32_t SHClipper::Chunk::addVertex() {
+	const size_t size = (vertexCount + 1) * vertexStride;
+	if (size > arenaCapacity) {
+		//the arena only grows, so that it doesn't allocate once it is large enough
+		const size_t capacity = std::max(size, 2 * arenaCapacity);
+		float* data = static_cast<float*>(AlignedAllocator::allocate(capacity * sizeof(float), 16));
+		if (arena)
+			std::copy(arena.get(), arena.get() + vertexCount * vertexStride, data);
+		arena.reset(data);
+		arenaCapacity = capacity;
 	}
+	return GENERATED_VERTEX | vertexCount++;
 }
 
 
+inline static uint32_t outcode(const Vector4& position, const Math::Vector2& guardBand) {
+	//the tests are the negations of the inside tests performed by SHClipper::clipTriangle
+	const float x = position[0];
+	const float y = position[1];
+	const float z = position[2];
+	const float w = position[3];
+	const float gxw = guardBand[0] * w;
+	const float gyw = guardBand[1] * w;
+	return (x + w < 0.0f ? 0x1 : 0) | (w - x < 0.0f ? 0x2 : 0) |
+		(y + w < 0.0f ? 0x4 : 0) | (w - y < 0.0f ? 0x8 : 0) |
+		(z + w < 0.0f ? 0x10 : 0) | (w - z < 0.0f ? 0x20 : 0) |
+		(x + gxw < 0.0f ? 0x40 : 0) | (gxw - x < 0.0f ? 0x80 : 0) |
+		(y + gyw < 0.0f ? 0x100 : 0) | (gyw - y < 0.0f ? 0x200 : 0);
+}
+
 inline static float intersectEdgePlane(const float p1DotPlane, float p2DotPlane) {
 
 	/*
 	Precondition : sign(p1DotPlane) != sign(p2DotPlane)
-	Following what have been said about clipping planes in the definition of SHClipper::clipTriangleTask, 
+	Following what have been said about clipping planes in the definition of SHClipper::clipTriangle, 
 	find intersection between an edge "(1-t)p1 + tp2, t in [0,1]" and a plane P = (a, b, c, d) in 4D, where 
 	p1 = (x1, y1, z1, w1) and p2 = (x2, y2, z2, w2) are the two end point of the edge.
 	The instersection is the point p' = (1-t)p1 + tp2 = p1 + t(p2 - p1) that satisfy the following:
@@ -377,41 +570,36 @@ inline static __m128 intersectEdgePlane(const __m128 p1DotPlane, const __m128 p2
 	return _mm_div_ps(minusP1DotPlane, _mm_add_ps(minusP1DotPlane, p2DotPlane));
 }
 
-inline static void lerpVertex(Vertex& v0, const Vertex& v1, __m128 t) {
+inline static void lerpVertex(float* out, const float* v0, const float* v1, __m128 t, size_t vertexStride) {
 	//assuming each field is 4-float wide and 16-byte aligned
-	const size_t fieldCount = v0.vertexLayout().fieldCount();
 	const __m128 oneMinusTVec = _mm_sub_ps(_mm_set_ps1(1.0f), t);
-	float* field = v0.vertexData();
-	const float* vField = v1.vertexData();
-	for (size_t f = 0; f < fieldCount; f++, field += 4, vField += 4) {
-		__m128 fieldVec = _mm_load_ps(field);
-		__m128 vFieldVec = _mm_load_ps(vField);
+	for (size_t i = 0; i < vertexStride; i += 4) {
+		__m128 fieldVec = _mm_load_ps(v0 + i);
+		__m128 vFieldVec = _mm_load_ps(v1 + i);
 		fieldVec = _mm_mul_ps(fieldVec, oneMinusTVec);
 		vFieldVec = _mm_mul_ps(vFieldVec, t);
 		fieldVec = _mm_add_ps(fieldVec, vFieldVec);
-		_mm_store_ps(field, fieldVec);
+		_mm_store_ps(out + i, fieldVec);
+	}
+}
+#else
+inline static void lerpVertex(float* out, const float* v0, const float* v1, float t, size_t vertexStride) {
+	//same as Vertex::lerp
+	const float oneMinusT = 1.0f - t;
+	for (size_t i = 0; i < vertexStride; i++) {
+		out[i] = v0[i] * oneMinusT;
+		out[i] += v1[i] * t;
 	}
 }
 #endif
 
-inline static void triangulate(std::vector<uint64_t>& indices, std::vector<uint64_t>* outIndices) {
+inline static void triangulate(const uint32_t* polygon, size_t vertexCount, std::vector<uint32_t>& outIndices) {
 	
 	//triangulate in a triangle-fan fashion
-	size_t size = indices.size();
-	const uint64_t i0 = indices[0];
-	uint64_t i1 = indices[1];
-	uint64_t i2 = indices[2];
-	size_t next = 3;
-
-	while (size-- > 3) {
-		outIndices->push_back(i0);
-		outIndices->push_back(i1);
-		outIndices->push_back(i2);
-		i1 = i2;
-		i2 = indices[next++];
+	const uint32_t i0 = polygon[0];
+	for (size_t i = 2; i < vertexCount; i++) {
+		outIndices.push_back(i0);
+		outIndices.push_back(polygon[i - 1]);
+		outIndices.push_back(polygon[i]);
 	}
-
-	outIndices->push_back(i0);
-	outIndices->push_back(i1);
-	outIndices->push_back(i2);
 }
@@ -15,19 +15,28 @@ namespace SoftRP {
 
 	class SHClipper : public Clipper{				
 	public:
-		SHClipper() = default;
+		SHClipper();
 		virtual ~SHClipper() = default;
 		
 		/*
 		If SOFTRP_USE_SIMD is defined, the implementation requires Vertexs' data to be 16-byte aligned.
 		*/
 #ifdef SOFTRP_MULTI_THREAD
-		virtual ThreadPool::Fence clipTriangles(std::vector<Vertex>& vertices, uint64_t* inIndices, 
-												size_t triangleCount, std::vector<uint64_t>& outIndices, 
+		virtual ThreadPool::Fence clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, 
+												size_t triangleCount, std::vector<uint32_t>& outIndices, 
 												ThreadPool& threadPool) override final;
 #else
-		virtual void clipTriangles(std::vector<Vertex>& vertices, uint64_t* inIndices, 
-						  size_t triangleCount, std::vector<uint64_t>& outIndices) override final;
+		virtual void clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, 
+						  size_t triangleCount, std::vector<uint32_t>& outIndices) override final;
+#endif
+#ifdef SOFTRP_MULTI_THREAD
+		virtual ThreadPool::Fence clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, const uint32_t* inTags,
+												size_t triangleCount, std::vector<uint32_t>& outIndices, 
+												std::vector<uint32_t>& outTags, ThreadPool& threadPool) override final;
+#else
+		virtual void clipTriangles(std::vector<Vertex>& vertices, uint32_t* inIndices, const uint32_t* inTags,
+								   size_t triangleCount, std::vector<uint32_t>& outIndices, 
+								   std::vector<uint32_t>& outTags) override final;
 #endif
 
 	protected:
@@ -37,31 +46,80 @@ namespace SoftRP {
 		SHClipper& operator=(SHClipper&&) = delete;
 
 	private:
-		
-		void clipTriangleTask(std::vector<Vertex>* vertices, uint64_t* inIndices, size_t triangleOutputIndex);
-		void prepareOutputTask(size_t triangleCount, std::vector<uint64_t>* outIndices);		
-		
-		struct TriangleTaskOutput;
-		std::vector<TriangleTaskOutput> m_triangleTaskOutputs{};
-#ifdef SOFTRP_MULTI_THREAD		
-		std::mutex m_mutex{};
-#endif
-		
-		struct TriangleTaskOutput {
-			TriangleTaskOutput() = default;
-			~TriangleTaskOutput() = default;
-			TriangleTaskOutput(const TriangleTaskOutput&) = delete;			
-			TriangleTaskOutput& operator=(const TriangleTaskOutput&) = delete;
-			TriangleTaskOutput(TriangleTaskOutput&& tto);
-			TriangleTaskOutput& operator=(TriangleTaskOutput&&) = delete;
 
+		//clip the triangles, tagging them if inTags is not null (see Clipper::clipTriangles)
 #ifdef SOFTRP_MULTI_THREAD
-			bool done{ false };
-			std::mutex mutex{};
-			std::condition_variable triangleClippedReady{};
+		ThreadPool::Fence clip(std::vector<Vertex>& vertices, const uint32_t* inIndices, const uint32_t* inTags,
+							   size_t triangleCount, std::vector<uint32_t>& outIndices, std::vector<uint32_t>* outTags,
+							   ThreadPool& threadPool);
+#else
+		void clip(std::vector<Vertex>& vertices, const uint32_t* inIndices, const uint32_t* inTags,
+				  size_t triangleCount, std::vector<uint32_t>& outIndices, std::vector<uint32_t>* outTags);
+#endif
+
+		//compute the outcodes of the vertices in [first, last) to m_outcodes
+		void computeOutcodesScalar(const std::vector<Vertex>& vertices, size_t first, size_t last);
+#ifdef SOFTRP_USE_SIMD
+		void computeOutcodesSSE(const std::vector<Vertex>& vertices, size_t first, size_t last);
+		void computeOutcodesAVX2(const std::vector<Vertex>& vertices, size_t first, size_t last);
 #endif
-			std::vector<uint64_t> indices{};
+		using OutcodesKernel = void (SHClipper::*)(const std::vector<Vertex>&, size_t, size_t);
+		
+		struct Chunk;
+
+		//classify the triangles of the chunk-th chunk and clip the ones which need it, writing the result to its buffers
+		void clipChunk(const std::vector<Vertex>& vertices, const uint32_t* inIndices, const uint32_t* inTags, 
+					   size_t triangleCount, size_t chunk);
+		//clip a triangle against the clipping planes and append the triangulation of the result to the chunk's buffers
+		void clipTriangle(const std::vector<Vertex>& vertices, const uint32_t* triangle, Chunk& chunk);
+		/*
+		copy the indices and tags written by the chunk-th chunk to outIndices and outTags, at its offset, and bind the 
+		vertices it generated to vertices, from its vertex offset. outTags is null if the triangles are not tagged
+		*/
+		void compactChunk(std::vector<Vertex>& vertices, uint32_t* outIndices, uint32_t* outTags, size_t chunk);
+
+		//number of triangles of a chunk, the unit of work of the clipping
+		static constexpr size_t CHUNK_SIZE = 512;
+		//tag of the indices which refer to the vertices generated by a chunk, until they are compacted. It limits the
+		//vertices of a call to 2^31
+		static constexpr uint32_t GENERATED_VERTEX = uint32_t{ 1 } << 31;
+
+		struct ArenaDeleter {
+			void operator()(float* data) const;
 		};
+
+		struct Chunk {
+			//data of the vertex generated by the chunk with the given (untagged) index
+			float* generatedVertex(size_t index);
+			//data of the vertex with the given index, either an input one or a generated one
+			const float* vertexData(const std::vector<Vertex>& vertices, uint32_t index) const;
+			//append a vertex to the arena, growing it if full, and return its tagged index
+			uint32_t addVertex();
+
+			//indices of the triangles produced by the chunk, in primitive order
+			std::vector<uint32_t> indices{};
+			//tags of the triangles produced by the chunk, if tagged
+			std::vector<uint32_t> tags{};
+			//position of the indices in the output, i.e. the number of indices produced by the previous chunks
+			size_t offset{ 0 };
+			/*
+			16-byte aligned arena the chunk writes the vertices it generates to, vertexStride floats each. The 
+			vertices passed to clipTriangles reference it, see Clipper::clipTriangles.
+			*/
+			std::unique_ptr<float, ArenaDeleter> arena{};
+			size_t arenaCapacity{ 0 };
+			size_t vertexStride{ 0 };
+			size_t vertexCount{ 0 };
+			//position of the generated vertices in the output, assigned as the offset of the indices
+			size_t vertexOffset{ 0 };
+		};
+
+		//kernel selected for the host at construction
+		OutcodesKernel m_outcodesKernel{ &SHClipper::computeOutcodesScalar };
+		//outcodes of the vertices passed to clipTriangles, one per vertex
+		std::vector<uint32_t> m_outcodes{};
+		//the chunks' buffers are kept across calls, so that they don't allocate once they are large enough
+		std::vector<Chunk> m_chunks{};
 	};
 
 	/*
@@ -5,5 +5,78 @@
 #include <emmintrin.h>
 #include <xmmintrin.h>
 #include <immintrin.h>
+#include <cstdint>
+#include <cstddef>
+
+/*
+The code is compiled for SSE2, which every x86-64 host supports. SOFTRP_TARGET_SSE4 and SOFTRP_TARGET_AVX2 mark a 
+function which uses SSE4.1, or AVX2 and FMA, instructions and which is executed only if the host supports them (see 
+CPUFeatures.h). GCC and Clang require them to accept the corresponding intrinsics without enabling the instruction 
+sets for the whole program, whereas MSVC accepts any intrinsic.
+*/
+#if defined(_MSC_VER)
+#define SOFTRP_TARGET_SSE4
+#define SOFTRP_TARGET_AVX2
+#else
+#define SOFTRP_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define SOFTRP_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace SoftRP {
+
+	/*
+	Portable access to the lanes of SIMD registers. MSVC exposes them through the m128_f32, m128i_i32, ... members
+	of its vector types, GCC and Clang through the subscript operator of theirs.
+	*/
+
+	inline float laneF32(const __m128& v, size_t i) {
+#if defined(_MSC_VER)
+		return v.m128_f32[i];
+#else
+		return v[i];
+#endif
+	}
+
+	inline void setLaneF32(__m128& v, size_t i, float value) {
+#if defined(_MSC_VER)
+		v.m128_f32[i] = value;
+#else
+		v[i] = value;
+#endif
+	}
+
+	//the i-th lane of v reinterpreted as an integer
+	inline int32_t laneI32(const __m128& v, size_t i) {
+#if defined(_MSC_VER)
+		return v.m128_i32[i];
+#else
+		return reinterpret_cast<__v4si>(v)[i];
+#endif
+	}
+
+	inline int32_t laneI32(const __m128i& v, size_t i) {
+#if defined(_MSC_VER)
+		return v.m128i_i32[i];
+#else
+		return reinterpret_cast<__v4si>(v)[i];
+#endif
+	}
+
+	inline float laneF32(const __m256& v, size_t i) {
+#if defined(_MSC_VER)
+		return v.m256_f32[i];
+#else
+		return v[i];
+#endif
+	}
+
+	inline void setLaneF32(__m256& v, size_t i, float value) {
+#if defined(_MSC_VER)
+		v.m256_f32[i] = value;
+#else
+		v[i] = value;
+#endif
+	}
+}
 #endif
 #endif
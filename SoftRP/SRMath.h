@@ -5,4 +5,5 @@
 #include "Matrix.h"
 #include "FVector.h"
 #include "FMatrix.h"
+#include "FQuad.h"
 #endif
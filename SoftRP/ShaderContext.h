@@ -1,8 +1,8 @@
 #ifndef SOFTRP_SHADER_CONTEXT_H_
 #define SOFTRP_SHADER_CONTEXT_H_
+#include "ConstantBuffer.h"
 namespace SoftRP {
 
-	class ConstantBuffer;
 	class TextureUnit;
 
 	/*
@@ -27,14 +27,28 @@ namespace SoftRP {
 		/* getters */
 		ConstantBuffer* const * constantBuffers() const;
 		TextureUnit* const * textureUnits() const;
+		//null if the instances of all the ConstantBuffers are not offset
+		const size_t* constantBufferOffsets() const;
 
 		/* setters */
 		void setConstantBuffers(ConstantBuffer* const * constantBuffers);
 		void setTextureUnits(TextureUnit* const * textureUnits);		
+		/*
+		offset the instances of the fields accessed through constantBufferField, one offset per ConstantBuffer. 
+		It lets draws share a ConstantBuffer, each one with its own instances of the fields
+		*/
+		void setConstantBufferOffsets(const size_t* constantBufferOffsets);
+
+		/*
+		the i-th field of the ConstantBuffer bound to slot, of the instance offset by the slot's offset. 
+		Shaders should access the ConstantBuffers with it, so that they can be drawn by Renderer::multiDrawIndexed
+		*/
+		const ConstantBuffer::ConstantBufferField constantBufferField(size_t slot, size_t i, size_t instance = 0) const;
 		
 	private:
 		ConstantBuffer* const * m_constantBuffers;
 		TextureUnit* const * m_textureUnits;
+		const size_t* m_constantBufferOffsets{ nullptr };
 	};
 }
 #include "ShaderContextImpl.inl"
@@ -18,5 +18,18 @@ namespace SoftRP {
 	inline TextureUnit* const * ShaderContext::textureUnits() const {
 		return m_textureUnits;
 	}
+
+	inline void ShaderContext::setConstantBufferOffsets(const size_t* constantBufferOffsets) {
+		m_constantBufferOffsets = constantBufferOffsets;
+	}
+
+	inline const size_t* ShaderContext::constantBufferOffsets() const {
+		return m_constantBufferOffsets;
+	}
+
+	inline const ConstantBuffer::ConstantBufferField ShaderContext::constantBufferField(size_t slot, size_t i, size_t instance) const {
+		const ConstantBuffer& constantBuffer = *m_constantBuffers[slot];
+		return constantBuffer.getField(i, m_constantBufferOffsets ? m_constantBufferOffsets[slot] + instance : instance);
+	}
 }
 #endif
@@ -12,6 +12,7 @@
 #include "VertexLayout.h"
 
 #include "DepthBuffer.h"
+#include "VisibilityBuffer.h"
 #include "Texture2D.h"
 #include "TextureUnit.h"
 
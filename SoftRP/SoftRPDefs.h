@@ -4,6 +4,11 @@
 #define SOFTRP_USE_SIMD
 
 #ifdef SOFTRP_USE_SIMD
+/*
+FMath's types are compiled for SSE2, which every x86-64 host supports, and do not dispatch at runtime. The rasterizer 
+and the clipper instead select their kernels (scalar, SSE4.1 or AVX2 and FMA) according to the host's features, see 
+CPUFeatures.h.
+*/
 #define SOFTRP_FMATH_SIMD
 #endif
 
@@ -15,6 +15,10 @@ namespace SoftRP {
 		virtual void operator() (const ShaderContext& sc, 
 								 const PSExecutionContext& psec, 
 								 size_t instance, Math::Vector4* out) const override;
+		virtual void shadeBatch(const ShaderContext& sc,
+								const PSBatchContext& psbc,
+								size_t instance, Math::Vector4* out) const override;
+		virtual bool batched() const override;
 	protected:
 		SolidColorPixelShader(const SolidColorPixelShader&) = delete;
 		SolidColorPixelShader(SolidColorPixelShader&&) = delete;
@@ -4,7 +4,21 @@
 namespace SoftRP {
 	template<unsigned int r, unsigned int g, unsigned int b, unsigned int a>
 	inline void SolidColorPixelShader<r, g, b, a>::operator() (const ShaderContext& sc, const PSExecutionContext& psec, size_t instance, Math::Vector4* out) const {
-		out[i] = Math::Vector4{ r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f };
+		for (unsigned int i = 0; i < 4; i++)
+			out[i] = Math::Vector4{ r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f };
+	}
+
+	template<unsigned int r, unsigned int g, unsigned int b, unsigned int a>
+	inline void SolidColorPixelShader<r, g, b, a>::shadeBatch(const ShaderContext& sc, const PSBatchContext& psbc, size_t instance, Math::Vector4* out) const {
+		const Math::Vector4 color{ r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f };
+		const size_t pixelCount = 4 * psbc.quadCount;
+		for (size_t i = 0; i < pixelCount; i++)
+			out[i] = color;
+	}
+
+	template<unsigned int r, unsigned int g, unsigned int b, unsigned int a>
+	inline bool SolidColorPixelShader<r, g, b, a>::batched() const {
+		return true;
 	}
 }
 #endif
@@ -1,51 +1,74 @@
 #ifndef SOFTRP_TASK_CONSUMER_H_
 #define SOFTRP_TASK_CONSUMER_H_
-#include<queue>
+#include<deque>
 #include<mutex>
 #include<thread>
-#include<functional>
+#include "InlineTask.h"
 namespace SoftRP {
 
+	struct FenceEpoch;
+
+	/*
+	Priority of the tasks of a ThreadPool over the ones of the other ThreadPools sharing its TaskConsumers,
+	in decreasing order (see ThreadPool).
+	*/
+	enum class TaskPriority {
+		HIGH,
+		NORMAL,
+		LOW
+	};
+	constexpr size_t TASK_PRIORITY_COUNT = 3;
+
 	/*
-	Concrete data type which represents a thread that executes tasks submitted in 
-	a common producer-consumer fashion.
+	Concrete data type which represents a thread of a ThreadPool along with its own deques of tasks, one per
+	TaskPriority.
+	The tasks submitted by the thread itself are pushed and popped at the bottom of a deque, the most
+	recent first, while the other threads of the ThreadPool steal them from the top, the oldest first, once
+	they have run out of work. The loop executed by the thread is provided by the ThreadPool.
 	*/
 
 	class TaskConsumer {
 	public:
-		using TaskType = std::function<void(void)>;
+		using TaskType = InlineTask;
 
-		TaskConsumer() = default;		
+		//a task along with the fence epoch it has been submitted in (see ThreadPool)
+		struct Task {
+			TaskType function{};
+			FenceEpoch* epoch{ nullptr };
+		};
+
+		TaskConsumer() = default;
 		~TaskConsumer();
-		
+
 		//copy
 		TaskConsumer(const TaskConsumer&) = delete;
 		TaskConsumer& operator=(const TaskConsumer&) = delete;
 		//move
-		TaskConsumer(TaskConsumer&& tc);		
-		TaskConsumer& operator=(TaskConsumer&& tc);
-
-		//submit a new task for execution
-		void addTask(TaskType task);
-		//are there pending tasks?
-		bool hasTasks();
-		//block the calling thread until all task have been executed
-		void waitForConsumation();
-		//terminate the thread when all the pending tasks have been executed
-		void terminate();
-		
-	private:
+		TaskConsumer(TaskConsumer&&) = delete;
+		TaskConsumer& operator=(TaskConsumer&&) = delete;
 
-		void operator()();
-		void move(TaskConsumer&& tc);
+		//start the thread, which executes loop until it returns
+		template<typename F>
+		void start(F loop);
+		//block the calling thread until the thread has returned from its loop
+		void join();
+		//pin the thread to a logical processor of the host, return false if it can't be done
+		bool pin(unsigned int processor);
 
-		bool m_terminate{false};
-		bool m_executing{ false };
+		//push a task at the bottom of the deque of its priority
+		void push(Task task, TaskPriority priority);
+		//pop the task at the bottom of the deque of the given priority, if any
+		bool pop(Task& task, TaskPriority priority);
+		/*
+		steal the task at the top of the deque of the given priority, if any. Gives up if the deques are being 
+		accessed by another thread
+		*/
+		bool steal(Task& task, TaskPriority priority);
+
+	private:
 		std::mutex m_mtx{};
-		std::condition_variable m_availableTasks{};
-		std::condition_variable m_consumedTask{};		
-		std::queue<TaskType> m_tasks{};
-		std::thread t{ &TaskConsumer::operator(), this };
+		std::deque<Task> m_tasks[TASK_PRIORITY_COUNT];
+		std::thread m_thread{};
 	};
 }
 #include "TaskConsumerImpl.inl"
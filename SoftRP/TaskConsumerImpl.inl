@@ -1,95 +1,57 @@
 #ifndef SOFTRP_TASK_CONSUMER_IMPL_INL_
 #define SOFTRP_TASK_CONSUMER_IMPL_INL_
 #include "TaskConsumer.h"
+#include "CPUFeatures.h"
 namespace SoftRP {
 
 	inline TaskConsumer::~TaskConsumer() {
-		terminate();
-		t.join();
+		join();
 	}
 
-	inline TaskConsumer::TaskConsumer(TaskConsumer&& tc) {
-		std::lock_guard<std::mutex> lock{ tc.m_mtx };
-		move(std::move(tc));
+	template<typename F>
+	inline void TaskConsumer::start(F loop) {
+		m_thread = std::thread{ std::move(loop) };
 	}
 
-	inline TaskConsumer& TaskConsumer::operator=(TaskConsumer&& tc) {
-		if (&tc == this)
-			return *this;
-
-		std::unique_lock<std::mutex> thisLock{ m_mtx, std::defer_lock };
-		std::unique_lock<std::mutex> tcLock{ tc.m_mtx, std::defer_lock };
-		std::lock(thisLock, tcLock);
-		move(std::move(tc));
-
-		return *this;
+	inline void TaskConsumer::join() {
+		if (m_thread.joinable())
+			m_thread.join();
 	}
 
-	inline void TaskConsumer::addTask(TaskType task) {
-		{
-			std::lock_guard<std::mutex> lock{ m_mtx };
-			if (!m_terminate)
-				m_tasks.push(std::move(task));
-		}
-		m_availableTasks.notify_one();
+	inline bool TaskConsumer::pin(unsigned int processor) {
+		return pinThread(m_thread, processor);
 	}
 
-	inline bool TaskConsumer::hasTasks() {
+	inline void TaskConsumer::push(Task task, TaskPriority priority) {
 		std::lock_guard<std::mutex> lock{ m_mtx };
-		return m_tasks.size() != 0 || m_executing;
-	}
-
-	inline void TaskConsumer::waitForConsumation() {
-		std::unique_lock<std::mutex> lock{ m_mtx };
-		while (m_tasks.size() != 0 || m_executing)
-			m_consumedTask.wait(lock);
-	}
-
-	inline void TaskConsumer::terminate() {
-		{
-			std::lock_guard<std::mutex> lock{ m_mtx };
-			m_terminate = true;
-		}
-		m_availableTasks.notify_one();
+		m_tasks[static_cast<size_t>(priority)].push_back(std::move(task));
 	}
 
-	inline void TaskConsumer::operator() () {
-
-		std::unique_lock<std::mutex> lock{ m_mtx };
-
-		while (!m_terminate) {
-
-			while (m_tasks.size() == 0) {
-				m_availableTasks.wait(lock);
-				if (m_terminate)
-					return;
-			}
-			/*
-			moving the task is important; keeping a reference
-			might cause problems (like in the previous versions).
-			Because the lock is released during execution, if a new task is added (by a new thread)
-			the tasks could be moved in an other memory area by m_tasks. This
-			causes the concurrent execution of the task and its destructor.
-			*/
-			TaskType task{ std::move(m_tasks.front()) };
-			m_tasks.pop();
-			m_executing = true;
-			lock.unlock();
-			task();
-			lock.lock();
-			m_executing = false;
-			if (m_tasks.size() == 0) {
-				lock.unlock();
-				m_consumedTask.notify_all();
-				lock.lock();
-			}
-		}
-	}
-
-	inline void TaskConsumer::move(TaskConsumer&& tc) {
-		m_tasks = std::move(tc.m_tasks);
-		m_terminate = tc.m_terminate;
+	inline bool TaskConsumer::pop(Task& task, TaskPriority priority) {
+		std::lock_guard<std::mutex> lock{ m_mtx };
+		std::deque<Task>& tasks = m_tasks[static_cast<size_t>(priority)];
+		if (tasks.empty())
+			return false;
+		/*
+		moving the task is important; keeping a reference might cause problems (like in the previous versions).
+		Because the lock is released during execution, the other tasks could be moved in an other memory area
+		by m_tasks, causing the concurrent execution of the task and its destructor.
+		*/
+		task = std::move(tasks.back());
+		tasks.pop_back();
+		return true;
+	}
+
+	inline bool TaskConsumer::steal(Task& task, TaskPriority priority) {
+		//a thief doesn't wait for the owner or another thief, it moves on to the next TaskConsumer instead
+		std::unique_lock<std::mutex> lock{ m_mtx, std::try_to_lock };
+		std::deque<Task>& tasks = m_tasks[static_cast<size_t>(priority)];
+		if (!lock.owns_lock() || tasks.empty())
+			return false;
+		task = std::move(tasks.front());
+		tasks.pop_front();
+		return true;
 	}
 
 }
-#endif
\ No newline at end of file
+#endif
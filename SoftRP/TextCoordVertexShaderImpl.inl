@@ -5,17 +5,10 @@
 #include "FVector.h"
 #include "FMatrix.h"
 namespace SoftRP {
-#ifdef SOFTRP_MULTI_THREAD		
-	inline ThreadPool::Fence TextCoordVertexShader::operator()(const ShaderContext& sc,
-															   const Vertex* input, Vertex* output, size_t vertexCount, size_t instance,
-															   ThreadPool& threadPool) const
-#else
-	inline void TextCoordVertexShader::operator()(const ShaderContext& sc,
-												  const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const
-#endif
-
+	inline void TextCoordVertexShader::shadeBatch(const ShaderContext& sc,
+												const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const
 	{
-		const Math::Matrix4* projViewWorld = sc.constantBuffers()[0]->getField(0, instance).asMatrix4();
+		const Math::Matrix4* projViewWorld = sc.constantBufferField(0, 0, instance).asMatrix4();
 		const FMatrix fprojViewWorld = createFM(*projViewWorld);
 		for (size_t i = 0; i < vertexCount; i++, input++, output++) {
 			FVector fv = createFV(input->position());
@@ -25,10 +18,6 @@ namespace SoftRP {
 			for (unsigned int i = 0; i < 2; i++)
 				textCoords[i] = inputTextCoords[i];
 		}
-
-#ifdef SOFTRP_MULTI_THREAD
-		return threadPool.currFence();
-#endif
 	}
 
 }
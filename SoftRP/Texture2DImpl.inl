@@ -63,7 +63,7 @@ namespace SoftRP {
 		m_width = width;
 		m_height = height;
 		m_count = width*height;
-		m_data.reset(new T[m_count]{});
+		m_data.reset(new T[m_count]());
 		m_mipmaps.reset(nullptr);
 	}
 
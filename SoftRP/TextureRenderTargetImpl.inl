@@ -10,12 +10,14 @@ namespace SoftRP {
 
 	inline TextureRenderTarget& TextureRenderTarget::operator=(const TextureRenderTarget& rt) {
 		m_texture = rt.m_texture;
+		return *this;
 	}
 
 	inline TextureRenderTarget::TextureRenderTarget(TextureRenderTarget&& rt) : m_texture{ std::move(rt.m_texture) } {}
 
 	inline TextureRenderTarget& TextureRenderTarget::operator=(TextureRenderTarget&& rt) {
 		m_texture = std::move(rt.m_texture);
+		return *this;
 	}
 
 	inline unsigned int TextureRenderTarget::width() const{
@@ -75,7 +75,7 @@ namespace SoftRP {
 		const Math::Vector2 textureSize{ static_cast<float>(m_texture->width()), static_cast<float>(m_texture->height()) };
 		const float squaredLen1 = (textureSize*dtcdx).squaredLength();
 		const float squaredLen2 = (textureSize*dtcdy).squaredLength();
-		return std::log2f(std::sqrtf(std::max(squaredLen1, squaredLen2)));
+		return std::log2(std::sqrt(std::max(squaredLen1, squaredLen2)));
 	}
 
 
@@ -2,16 +2,41 @@
 #define SOFTRP_THREAD_POOL_H_
 #include "SoftRPDefs.h"
 #include "TaskConsumer.h"
-#include <functional>
 #include <mutex>
-#include <unordered_map>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
 namespace SoftRP {
+
+	class ThreadPool;
+
+	/*
+	The tasks submitted to a ThreadPool between two fences, counted so that the second fence is reached once
+	all of them have been executed (see ThreadPool).
+	*/
+	struct FenceEpoch {
+		//the epoch holds one more count until it is closed by its fence, so that it can't be drained before
+		std::atomic<size_t> pendingTasks{ 1 };
+		bool drained{ false };
+		//the ThreadPool the tasks have been submitted to, which may not be the one executing them
+		ThreadPool* threadPool{ nullptr };
+	};
 	
 	/*
-	Concrete data type which represents a manager of a set of TaskConsumers to whom the tasks
-	submitted are distributed.
+	Concrete data type which represents a manager of a set of TaskConsumers which execute the tasks
+	submitted, scheduling them by work stealing.
+	The tasks submitted by the TaskConsumers' threads are pushed to their own deques, the others to a 
+	shared injection queue. A TaskConsumer executes the tasks of its own deque first, then the ones of the 
+	injection queue, and then steals from the other TaskConsumers, so that no thread sits idle while 
+	tasks are waiting behind a slow one.
 	A fence mechanism is also offered to the clients. This can be used to keep track of the 
-	progress of the TaskConsumers.	
+	progress of the TaskConsumers, or to submit tasks which depend on the completion of others without 
+	blocking any thread.
+	A ThreadPool can also be constructed on the TaskConsumers of another one, so that several clients (ex. the
+	stages of a pipeline) share the same threads instead of oversubscribing the host, while keeping their own 
+	fences. The tasks of the ThreadPools sharing the TaskConsumers are executed in order of TaskPriority.
 	*/
 
 	class ThreadPool {
@@ -20,7 +45,17 @@ namespace SoftRP {
 		using Fence = uint64_t;
 		using TaskType = TaskConsumer::TaskType;
 
-		ThreadPool(size_t maxTaskConsumerCount = 64);		
+		/*
+		construct a ThreadPool with maxTaskConsumerCount TaskConsumers, or one per logical processor of the host if 
+		it is 0. If pinTaskConsumers is true, each TaskConsumer's thread is pinned to a logical processor, in the 
+		order given by hostProcessorsByCore. The tasks submitted have TaskPriority::NORMAL.
+		*/
+		ThreadPool(size_t maxTaskConsumerCount = 64, bool pinTaskConsumers = false);
+		/*
+		construct a ThreadPool without threads of its own, whose tasks are executed with the given priority by the 
+		TaskConsumers of threadPool (or of the ThreadPool it shares them with), which must outlive it.
+		*/
+		ThreadPool(ThreadPool& threadPool, TaskPriority priority);
 		~ThreadPool();
 
 		//copy
@@ -31,13 +66,16 @@ namespace SoftRP {
 		ThreadPool(ThreadPool&&) = delete;
 		ThreadPool& operator=(ThreadPool&&) = delete;
 
-		//submit a task for execution which will be handed to a TaskConsumer
+		/*
+		submit a task for execution which will be executed by a TaskConsumer. The task is stored inline, without
+		allocating memory, if what it captures fits in an InlineTask
+		*/
 		void addTask(TaskType task);
 		
-		//are there any pending task in any TaskConsumer?
+		//are there any pending task?
 		bool hasTasks();
 		
-		//block the calling thread until all TaskConsumers has executed all the pending tasks
+		//block the calling thread until all the pending tasks have been executed
 		void waitForPendingTasks();		
 
 		/*
@@ -46,34 +84,127 @@ namespace SoftRP {
 		*/
 		Fence addFence();
 
-		//block the calling thread until the fence has been reached by all TaskConsumers
+		/*
+		block the calling thread until the fence has been reached, i.e. until all the tasks submitted before 
+		it has been added have been executed. The fence may be added after the call.
+		*/
 		void waitForFence(Fence f);
 
 		//combine in an unique operation the submission of a task and the increment of the Fence
 		Fence addTaskAndFence(TaskType task);	
+
+		/*
+		submit a task which is executed once the fence f of threadPool has been reached: the task is queued by the 
+		thread which reaches the fence, so that no thread waits for it. The fence may be added after the call.
+		If called by a task of this ThreadPool and threadPool is another one, the task submitted belongs to the same 
+		fence as the calling one, so that a chain of dependent tasks is waited for as a whole by the fence added 
+		after the first one.
+		If threadPool is this ThreadPool, f must have been added already: the task belongs to the current fence, 
+		which could otherwise never be reached since it would wait for its own task.
+		*/
+		void addTaskAfterFence(ThreadPool& threadPool, Fence f, TaskType task);
 		
 		//get the value of the last fence added, which may not have been reached yet
 		Fence currFence();		
+
+		//get the number of TaskConsumers the tasks are distributed to
+		size_t taskConsumerCount()const;
+
+		/*
+		execute function(i) for each i in [0, count): the calling thread executes function(0) while the others are 
+		submitted as tasks, then it waits until all of them have been executed. No Fence is added, so that the 
+		Fences returned to the clients are not affected. 
+		If the calling thread is one of the TaskConsumers, it executes the queued tasks while waiting, so that it 
+		can be called by a task without waiting for itself.
+		*/
+		template<typename F>
+		void parallelFor(size_t count, const F& function);
 		
 	private:
 
+		using Task = TaskConsumer::Task;
+
+		//the TaskConsumer the calling thread belongs to, if any, and the epoch of the task it is executing
+		struct CurrentTaskConsumer {
+			const ThreadPool* threadPool;
+			size_t index;
+			FenceEpoch* epoch;
+		};
+		static CurrentTaskConsumer& currentTaskConsumer();
+
+		//the loop of the index-th TaskConsumer's thread
+		void consume(size_t index);
+		bool hasQueuedTasks() const;
+		/*
+		find a task for the index-th TaskConsumer, looking at its deque, at the injection queue and at the other 
+		deques for each priority in turn
+		*/
+		bool findTask(size_t index, Task& task);
+		//execute a task found by findTask and account its completion
+		void runTask(Task& task);
+		//account a task submitted in the current epoch
+		Task prepareTaskUnsafe(TaskType function);
+		/*
+		push a task to the deque of the calling thread, if it is one of the TaskConsumers, or to the injection 
+		queue of its priority
+		*/
+		void enqueue(Task task, TaskPriority priority);
+		//account the completion of a task
+		void completeTask(FenceEpoch* epoch);
 		Fence addFenceUnsafe();
-		void decrementFence(Fence f);
+		//mark the epoch as drained, once its count has dropped to 0
+		void drainEpochUnsafe(FenceEpoch* epoch);
+		//advance the reached fence over the epochs which have been drained, queueing the tasks which depend on it
+		void advanceFenceUnsafe();
 
-		size_t m_nextTaskConsumer{ 0 };		
+		//the ThreadPool whose TaskConsumers execute the tasks, this one if it has TaskConsumers of its own
+		ThreadPool* const m_workers;
+		const TaskPriority m_priority;
 		const size_t m_maxTaskConsumerCount;
-		Fence m_fenceValue{ 0 };		
 		std::unique_ptr<TaskConsumer[]> m_taskConsumers;
+
+		/*
+		The tasks submitted after the fence f-1 has been added and before f is, belong to the epoch f, which is 
+		drained when they have all been executed. The fence f is reached once all the epochs up to f have been 
+		drained, in order: m_epochs[i] is the epoch m_reachedFence + 1 + i, the last one being the current epoch, 
+		m_fenceValue + 1.
+		The tasks count their completion on the atomic counter of their epoch, so that the mutex is only taken 
+		by the last task of an epoch, to advance the reached fence, and by the waiting threads.
+		*/
 		std::mutex m_mtx{};
-		
-		struct FenceCounter {
-			FenceCounter(uint64_t _remaining);
-			uint64_t remaining;
-			uint64_t waiting{ 0 };
-			std::condition_variable fenceReached{};
+		std::condition_variable m_fenceReached{};
+		Fence m_fenceValue{ 0 };
+		std::atomic<Fence> m_reachedFence{ 0 };
+		std::deque<std::unique_ptr<FenceEpoch>> m_epochs{};
+		//drained epochs, reused by the next fences
+		std::vector<std::unique_ptr<FenceEpoch>> m_freeEpochs{};
+		std::atomic<size_t> m_pendingTaskCount{ 0 };
+		//threads waiting for a fence or for the pending tasks, which need to be notified
+		size_t m_waitingCount{ 0 };
+
+		//a task, already accounted by its ThreadPool, which is queued once a fence of this one is reached
+		struct DependentTask {
+			Fence fence;
+			ThreadPool* threadPool;
+			Task task;
 		};
+		std::vector<DependentTask> m_dependentTasks{};
+
+		//tasks submitted by threads which are not TaskConsumers of the ThreadPool, per priority
+		std::mutex m_injectionMtx{};
+		std::deque<Task> m_injectedTasks[TASK_PRIORITY_COUNT];
 
-		std::unordered_map<Fence, FenceCounter> m_fenceCounters{};		
+		/*
+		the TaskConsumers without work sleep until a task is queued. The tasks waiting in the queues are counted 
+		per priority, so that the TaskConsumers don't have to look at all the queues before sleeping or to find a 
+		task of a given priority, and the sleeping ones, so that the producers don't have to notify them if there 
+		are none.
+		*/
+		std::mutex m_sleepMtx{};
+		std::condition_variable m_availableTasks{};
+		std::atomic<size_t> m_queuedTaskCounts[TASK_PRIORITY_COUNT];
+		std::atomic<size_t> m_sleepingCount{ 0 };
+		bool m_terminate{ false };
 	};	
 }
 #include "ThreadPoolImpl.inl"
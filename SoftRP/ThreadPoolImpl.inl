@@ -1,47 +1,114 @@
 #ifndef SOFTRP_THREAD_POOL_IMPL_INL_
 #define SOFTRP_THREAD_POOL_IMPL_INL_
 #include "ThreadPool.h"
+#include "CPUFeatures.h"
+#include <cassert>
 namespace SoftRP {
 
-	inline ThreadPool::ThreadPool(size_t maxTaskConsumerCount)
-		: m_taskConsumers{ new TaskConsumer[maxTaskConsumerCount] },
-		m_maxTaskConsumerCount{ maxTaskConsumerCount } {}
+	inline ThreadPool::ThreadPool(size_t maxTaskConsumerCount, bool pinTaskConsumers)
+		: m_workers{ this }, m_priority{ TaskPriority::NORMAL },
+		m_maxTaskConsumerCount{ maxTaskConsumerCount != 0 ? maxTaskConsumerCount : hostProcessorsByCore().size() },
+		m_taskConsumers{ new TaskConsumer[m_maxTaskConsumerCount] } {
+		//the current epoch
+		m_epochs.emplace_back(new FenceEpoch{});
+		m_epochs.back()->threadPool = this;
+		for (size_t p = 0; p < TASK_PRIORITY_COUNT; p++)
+			m_queuedTaskCounts[p].store(0);
+		const std::vector<unsigned int>& processors = hostProcessorsByCore();
+		for (size_t i = 0; i < m_maxTaskConsumerCount; i++) {
+			m_taskConsumers[i].start([this, i]() { consume(i); });
+			if (pinTaskConsumers)
+				m_taskConsumers[i].pin(processors[i % processors.size()]);
+		}
+	}
+
+	inline ThreadPool::ThreadPool(ThreadPool& threadPool, TaskPriority priority)
+		: m_workers{ threadPool.m_workers }, m_priority{ priority },
+		m_maxTaskConsumerCount{ threadPool.m_maxTaskConsumerCount }, m_taskConsumers{} {
+		m_epochs.emplace_back(new FenceEpoch{});
+		m_epochs.back()->threadPool = this;
+		for (size_t p = 0; p < TASK_PRIORITY_COUNT; p++)
+			m_queuedTaskCounts[p].store(0);
+	}
 
 	inline ThreadPool::~ThreadPool() {
 		waitForPendingTasks();
+		{
+			//the last task accounts its completion under the mutex, which must be released before it is destroyed
+			std::lock_guard<std::mutex> lock{ m_mtx };
+		}
+		if (m_workers != this)
+			return;
+		{
+			std::lock_guard<std::mutex> lock{ m_sleepMtx };
+			m_terminate = true;
+		}
+		m_availableTasks.notify_all();
+		for (size_t i = 0; i < m_maxTaskConsumerCount; i++)
+			m_taskConsumers[i].join();
 	}
 
 	inline void ThreadPool::addTask(TaskType task) {
-		size_t taskIndex;
+		Task t;
 		{
 			std::lock_guard<std::mutex> lock{ m_mtx };
-			//round-robin policy
-			taskIndex = m_nextTaskConsumer++;
-			if (m_nextTaskConsumer >= m_maxTaskConsumerCount)
-				m_nextTaskConsumer = 0;
+			t = prepareTaskUnsafe(std::move(task));
 		}
-		m_taskConsumers[taskIndex].addTask(task);
+		m_workers->enqueue(std::move(t), m_priority);
 	}
 
 	inline ThreadPool::Fence ThreadPool::addTaskAndFence(TaskType task) {
-		std::lock_guard<std::mutex> lock{ m_mtx };
-		m_taskConsumers[m_nextTaskConsumer].addTask(task);
-		m_nextTaskConsumer++;
-		if (m_nextTaskConsumer >= m_maxTaskConsumerCount)
-			m_nextTaskConsumer = 0;
-		return addFenceUnsafe();
+		Task t;
+		Fence f;
+		{
+			std::lock_guard<std::mutex> lock{ m_mtx };
+			t = prepareTaskUnsafe(std::move(task));
+			f = addFenceUnsafe();
+		}
+		m_workers->enqueue(std::move(t), m_priority);
+		return f;
+	}
+
+	inline void ThreadPool::addTaskAfterFence(ThreadPool& threadPool, Fence f, TaskType task) {
+		Task t;
+		FenceEpoch* callerEpoch = currentTaskConsumer().epoch;
+		/*
+		the fences of this ThreadPool can't wait for the caller's epoch, which may be the epoch f or precede it: 
+		the task joins the current epoch, which follows f
+		*/
+		if (callerEpoch && callerEpoch->threadPool == this && &threadPool != this) {
+			//the calling task is still pending, so its epoch can't be drained before the count is incremented
+			callerEpoch->pendingTasks.fetch_add(1, std::memory_order_relaxed);
+			m_pendingTaskCount.fetch_add(1, std::memory_order_relaxed);
+			t = Task{ std::move(task), callerEpoch };
+		} else {
+			std::lock_guard<std::mutex> lock{ m_mtx };
+			assert(&threadPool != this || f <= m_fenceValue);
+			t = prepareTaskUnsafe(std::move(task));
+		}
+		{
+			//the fence is advanced under the mutex, so it is either reached or the task is found by advanceFenceUnsafe
+			std::lock_guard<std::mutex> lock{ threadPool.m_mtx };
+			if (threadPool.m_reachedFence.load(std::memory_order_relaxed) < f) {
+				threadPool.m_dependentTasks.push_back(DependentTask{ f, this, std::move(t) });
+				return;
+			}
+		}
+		m_workers->enqueue(std::move(t), m_priority);
 	}
 
 	inline bool ThreadPool::hasTasks() {
-		for (size_t i = 0; i < m_maxTaskConsumerCount; i++)
-			if (m_taskConsumers[i].hasTasks())
-				return true;
-		return false;
+		return m_pendingTaskCount.load(std::memory_order_acquire) != 0;
 	}
 
 	inline void ThreadPool::waitForPendingTasks() {
-		for (size_t i = 0; i < m_maxTaskConsumerCount; i++)
-			m_taskConsumers[i].waitForConsumation();
+		if (m_pendingTaskCount.load(std::memory_order_acquire) == 0)
+			return;
+		std::unique_lock<std::mutex> lock{ m_mtx };
+		m_waitingCount++;
+		while (m_pendingTaskCount.load(std::memory_order_acquire) != 0)
+			m_fenceReached.wait(lock);
+		m_waitingCount--;
 	}
 
 	inline ThreadPool::Fence ThreadPool::addFence() {
@@ -54,59 +121,235 @@ namespace SoftRP {
 		return m_fenceValue;
 	}
 
+	inline size_t ThreadPool::taskConsumerCount()const {
+		return m_maxTaskConsumerCount;
+	}
+
+	template<typename F>
+	inline void ThreadPool::parallelFor(size_t count, const F& function) {
+		if (count == 0)
+			return;
+
+		std::mutex mutex{};
+		std::condition_variable done{};
+		size_t remaining = count - 1;
+
+		for (size_t i = 1; i < count; i++) {
+			addTask([&mutex, &done, &remaining, &function, i]() {
+				function(i);
+				//notify while holding the lock: the waiting thread destroys the condition variable as soon as it returns
+				std::lock_guard<std::mutex> lock{ mutex };
+				remaining--;
+				done.notify_one();
+			});
+		}
+
+		function(0);
+
+		const CurrentTaskConsumer& current = currentTaskConsumer();
+		if (current.threadPool == m_workers) {
+			/*
+			the tasks submitted by a TaskConsumer are pushed to its own deque: either it finds them or they have been 
+			stolen and are being executed, so it sleeps only when the remaining ones are executed by other threads
+			*/
+			Task task{};
+			while (true) {
+				if (m_workers->findTask(current.index, task)) {
+					m_workers->runTask(task);
+					continue;
+				}
+				std::unique_lock<std::mutex> lock{ mutex };
+				if (remaining == 0)
+					break;
+				done.wait(lock);
+			}
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock{ mutex };
+		while (remaining > 0)
+			done.wait(lock);
+	}
+
 	inline void ThreadPool::waitForFence(Fence f) {
+		//fast path: a reached fence doesn't need the mutex
+		if (m_reachedFence.load(std::memory_order_acquire) >= f)
+			return;
 		std::unique_lock<std::mutex> lock{ m_mtx };
-		auto it = m_fenceCounters.find(f);
+		m_waitingCount++;
+		while (m_reachedFence.load(std::memory_order_acquire) < f)
+			m_fenceReached.wait(lock);
+		m_waitingCount--;
+	}
+
+	inline ThreadPool::CurrentTaskConsumer& ThreadPool::currentTaskConsumer() {
+		static thread_local CurrentTaskConsumer current{ nullptr, 0, nullptr };
+		return current;
+	}
 
-		if (it == m_fenceCounters.end()) {
-			//the fence has already been reached
-			if (f <= m_fenceValue)
+	inline void ThreadPool::consume(size_t index) {
+		currentTaskConsumer() = CurrentTaskConsumer{ this, index, nullptr };
+		Task task{};
+		while (true) {
+			if (findTask(index, task)) {
+				runTask(task);
+				continue;
+			}
+			/*
+			the count of the queued tasks is checked after the thread has been counted as sleeping, while the
+			producers check the sleeping ones after counting their task: at least one of the two sees the other
+			*/
+			std::unique_lock<std::mutex> lock{ m_sleepMtx };
+			m_sleepingCount++;
+			while (!hasQueuedTasks() && !m_terminate)
+				m_availableTasks.wait(lock);
+			m_sleepingCount--;
+			if (m_terminate && !hasQueuedTasks())
 				return;
-			//the fence has not been added yet; create the counter
-			it = m_fenceCounters.emplace(f, m_maxTaskConsumerCount).first;
 		}
+	}
 
-		FenceCounter& fenceCounter = it->second;
-		fenceCounter.waiting++;
-		while (fenceCounter.remaining > 0)
-			fenceCounter.fenceReached.wait(lock);
+	inline bool ThreadPool::hasQueuedTasks() const {
+		for (size_t p = 0; p < TASK_PRIORITY_COUNT; p++)
+			if (m_queuedTaskCounts[p].load() != 0)
+				return true;
+		return false;
+	}
 
-		/*
-		allow more threads to wait on the same FenceCounter
-		(i.e. avoid multiple erase() calls with potentially invalid iterators...it happend the first time)
-		*/
+	inline bool ThreadPool::findTask(size_t index, Task& task) {
+		for (size_t p = 0; p < TASK_PRIORITY_COUNT; p++) {
+			//skip the priorities without tasks, without looking at their queues
+			if (m_queuedTaskCounts[p].load() == 0)
+				continue;
+			const TaskPriority priority = static_cast<TaskPriority>(p);
+			bool found = m_taskConsumers[index].pop(task, priority);
+			if (!found) {
+				std::lock_guard<std::mutex> lock{ m_injectionMtx };
+				std::deque<Task>& injectedTasks = m_injectedTasks[p];
+				if (!injectedTasks.empty()) {
+					task = std::move(injectedTasks.front());
+					injectedTasks.pop_front();
+					found = true;
+				}
+			}
+			//steal starting from the next TaskConsumer, so that the thieves spread over the deques
+			for (size_t i = 1; i < m_maxTaskConsumerCount && !found; i++)
+				found = m_taskConsumers[(index + i) % m_maxTaskConsumerCount].steal(task, priority);
+			if (found) {
+				m_queuedTaskCounts[p]--;
+				return true;
+			}
+		}
+		return false;
+	}
 
-		fenceCounter.waiting--;
-		if (fenceCounter.waiting == 0)
-			m_fenceCounters.erase(it);
+	inline void ThreadPool::runTask(Task& task) {
+		//the tasks executed while waiting in parallelFor are nested in the waiting one
+		CurrentTaskConsumer& current = currentTaskConsumer();
+		FenceEpoch* outerEpoch = current.epoch;
+		current.epoch = task.epoch;
+		task.function();
+		current.epoch = outerEpoch;
+		task.epoch->threadPool->completeTask(task.epoch);
+		//release what the task captured before looking for the next one
+		task.function = nullptr;
 	}
 
-	inline ThreadPool::FenceCounter::FenceCounter(uint64_t _remaining) : remaining{ _remaining } {}
+	inline ThreadPool::Task ThreadPool::prepareTaskUnsafe(TaskType function) {
+		//the mutex orders the increment with the closing of the epoch by addFenceUnsafe
+		FenceEpoch* epoch = m_epochs.back().get();
+		epoch->pendingTasks.fetch_add(1, std::memory_order_relaxed);
+		m_pendingTaskCount.fetch_add(1, std::memory_order_relaxed);
+		return Task{ std::move(function), epoch };
+	}
+
+	inline void ThreadPool::enqueue(Task task, TaskPriority priority) {
+		//counted before it is queued, so that the count never falls behind the tasks taken
+		m_queuedTaskCounts[static_cast<size_t>(priority)]++;
+		const CurrentTaskConsumer& current = currentTaskConsumer();
+		if (current.threadPool == this) {
+			m_taskConsumers[current.index].push(std::move(task), priority);
+		} else {
+			std::lock_guard<std::mutex> lock{ m_injectionMtx };
+			m_injectedTasks[static_cast<size_t>(priority)].push_back(std::move(task));
+		}
+		if (m_sleepingCount.load() > 0) {
+			//taking the lock makes sure that a thread about to sleep either sees the task or is notified
+			std::lock_guard<std::mutex> lock{ m_sleepMtx };
+			m_availableTasks.notify_one();
+		}
+	}
+
+	inline void ThreadPool::completeTask(FenceEpoch* epoch) {
+		//the last task of a closed epoch drains it
+		if (epoch->pendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			std::lock_guard<std::mutex> lock{ m_mtx };
+			drainEpochUnsafe(epoch);
+		}
+		/*
+		the last pending task is accounted under the mutex, so that the threads waiting for the pending tasks 
+		(ex. the destructor) can't return while it is still using the ThreadPool
+		*/
+		size_t count = m_pendingTaskCount.load(std::memory_order_relaxed);
+		while (count > 1 && !m_pendingTaskCount.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel,
+																	   std::memory_order_relaxed));
+		if (count <= 1) {
+			std::lock_guard<std::mutex> lock{ m_mtx };
+			if (m_pendingTaskCount.fetch_sub(1, std::memory_order_acq_rel) == 1 && m_waitingCount != 0)
+				m_fenceReached.notify_all();
+		}
+	}
 
 	inline ThreadPool::Fence ThreadPool::addFenceUnsafe() {
-		Fence targetFence = ++m_fenceValue;
-		if (m_fenceCounters.find(targetFence) == m_fenceCounters.end())
-			m_fenceCounters.emplace(targetFence, m_maxTaskConsumerCount);
-		auto decrTask = [this, targetFence]() {
-			decrementFence(targetFence);
-		};
-		for (size_t i = 0; i < m_maxTaskConsumerCount; i++)
-			m_taskConsumers[i].addTask(decrTask);
-		return targetFence;
+		//open a new epoch, reusing a drained one if possible, and close the current one
+		std::unique_ptr<FenceEpoch> epoch{};
+		if (m_freeEpochs.empty()) {
+			epoch.reset(new FenceEpoch{});
+		} else {
+			epoch = std::move(m_freeEpochs.back());
+			m_freeEpochs.pop_back();
+			epoch->pendingTasks.store(1, std::memory_order_relaxed);
+			epoch->drained = false;
+		}
+		epoch->threadPool = this;
+		FenceEpoch* closedEpoch = m_epochs.back().get();
+		m_epochs.push_back(std::move(epoch));
+		++m_fenceValue;
+		if (closedEpoch->pendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			drainEpochUnsafe(closedEpoch);
+		return m_fenceValue;
 	}
 
-	inline void ThreadPool::decrementFence(Fence f) {
-		std::lock_guard<std::mutex> lock{ m_mtx };
-		auto it = m_fenceCounters.find(f);
-#ifdef _DEBUG
-		if (it == m_fenceCounters.end())
-			throw std::runtime_error{ "Unexpected error : decrementing removed fence" };
-#endif
-		FenceCounter& fenceCounter = it->second;
-		fenceCounter.remaining--;
+	inline void ThreadPool::drainEpochUnsafe(FenceEpoch* epoch) {
+		epoch->drained = true;
+		advanceFenceUnsafe();
+	}
 
-		if (fenceCounter.remaining == 0)
-			fenceCounter.fenceReached.notify_all(); //TODO: this should be done without lock
+	inline void ThreadPool::advanceFenceUnsafe() {
+		//the epochs may be drained in any order, the fences are reached in order. the current epoch is never drained
+		bool reached = false;
+		while (m_epochs.front()->drained) {
+			m_freeEpochs.push_back(std::move(m_epochs.front()));
+			m_epochs.pop_front();
+			m_reachedFence.store(m_reachedFence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			reached = true;
+		}
+		if (!reached)
+			return;
+		if (m_waitingCount != 0)
+			m_fenceReached.notify_all();
+		//queueing a task doesn't take the mutex of a ThreadPool, so it can be done while holding this one
+		const Fence reachedFence = m_reachedFence.load(std::memory_order_relaxed);
+		size_t waitingCount = 0;
+		for (DependentTask& dependentTask : m_dependentTasks) {
+			if (dependentTask.fence <= reachedFence) {
+				ThreadPool* threadPool = dependentTask.threadPool;
+				threadPool->m_workers->enqueue(std::move(dependentTask.task), threadPool->m_priority);
+			} else {
+				m_dependentTasks[waitingCount++] = std::move(dependentTask);
+			}
+		}
+		m_dependentTasks.resize(waitingCount);
 	}
 }
 #endif
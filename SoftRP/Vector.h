@@ -72,20 +72,20 @@ namespace SoftRP{
 			T length()const;			
 
 			//ctors - part 2
-			template<typename U = T, typename = std::enable_if<(DIMENSION != 4)>::type>
+			template<typename U = T, typename = typename std::enable_if<(sizeof(U) > 0 && DIMENSION != 4)>::type>
 			explicit Vector(Vector<T, DIMENSION + 1> v) {
 				for (unsigned int i = 0; i < DIMENSION; i++)
 					m_data[i] = v[i];
 			}
 
-			template<typename U = T, typename = std::enable_if<(DIMENSION != 2)>::type>
+			template<typename U = T, typename = typename std::enable_if<(sizeof(U) > 0 && DIMENSION != 2)>::type>
 			explicit Vector(Vector<T, DIMENSION - 1> v, T last = 0) {
 				for (unsigned int i = 0; i < DIMENSION - 1; i++)
 					m_data[i] = v[i];
 				m_data[DIMENSION - 1] = last;
 			}
 
-			template<typename U = T, typename = std::enable_if<(DIMENSION == 4)>::type>
+			template<typename U = T, typename = typename std::enable_if<(sizeof(U) > 0 && DIMENSION == 4)>::type>
 			explicit Vector(Vector<T, DIMENSION - 2> v, T z = 0, T w = 0) {
 				for (unsigned int i = 0; i < DIMENSION - 2; i++)
 					m_data[i] = v[i];
@@ -112,14 +112,14 @@ namespace SoftRP{
 			}
 
 			/* setters - part 2 */
-			template<typename = std::enable_if<(DIMENSION >= 3)>::type>
+			template<typename U = T, typename = typename std::enable_if<(sizeof(U) > 0 && DIMENSION >= 3)>::type>
 			void set(T x, T y, T z) {
 				m_data[0] = x;
 				m_data[1] = y;
 				m_data[2] = z;
 			}
 
-			template<typename = std::enable_if<(DIMENSION == 4)>::type>
+			template<typename U = T, typename = typename std::enable_if<(sizeof(U) > 0 && DIMENSION == 4)>::type>
 			void set(T x, T y, T z, T w) {
 				m_data[0] = x;
 				m_data[1] = y;
@@ -128,7 +128,7 @@ namespace SoftRP{
 			}
 
 			/* operators part 2 */
-			template<typename U = T, typename = std::enable_if<(DIMENSION == 3)>::type>
+			template<typename U = T, typename = typename std::enable_if<(sizeof(U) > 0 && DIMENSION == 3)>::type>
 			Vector& cross(const Vector& v) {
 				const T uYvZ = m_data[1] * v.m_data[2];
 				const T uZvX = m_data[2] * v.m_data[0];
@@ -78,7 +78,7 @@ namespace SoftRP {
 			return reinterpret_cast<const Vector<T, N>*>(data);
 		}
 
-		template<unsigned int N, unsigned int M, typename = std::enable_if<(M > N)>::type, typename T>
+		template<unsigned int N, unsigned int M, typename = typename std::enable_if<(M > N)>::type, typename T>
 		inline const Vector<T, N>* vectorFromPtr(const Vector<T, M>* data) {
 			return reinterpret_cast<const Vector<T, N>*>(data);
 		}
@@ -54,7 +54,7 @@ namespace SoftRP {
 		inline T* Vector<T, N>::begin() { return m_data; }
 		
 		template<typename T, unsigned int N>
-		inline T* Vector<T, N>::end() { return m_data + DIMENSION; }
+		inline T* Vector<T, N>::end() { return m_data + N; }
 		
 		template<typename T, unsigned int N>
 		inline T* Vector<T, N>::data() { return m_data; }
@@ -75,7 +75,7 @@ namespace SoftRP {
 		inline const T* Vector<T, N>::begin() const { return m_data; }
 		
 		template<typename T, unsigned int N>
-		inline const T* Vector<T, N>::end() const { return m_data + DIMENSION; }
+		inline const T* Vector<T, N>::end() const { return m_data + N; }
 
 		template<typename T, unsigned int N>
 		inline const T* Vector<T, N>::data()const { return m_data; }
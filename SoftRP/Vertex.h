@@ -24,9 +24,9 @@ namespace SoftRP {
 		//copy
 		Vertex(const Vertex& v);
 		Vertex& operator=(const Vertex& v);
-		//move
-		Vertex(Vertex&& v);
-		Vertex& operator=(Vertex&& v);				
+		//move, noexcept so that a std::vector of Vertexs moves them instead of copying their data when it grows
+		Vertex(Vertex&& v) noexcept;
+		Vertex& operator=(Vertex&& v) noexcept;				
 
 		/*
 		set the reference to the data. The data layout must be the one 
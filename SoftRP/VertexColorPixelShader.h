@@ -14,6 +14,10 @@ namespace SoftRP{
 		virtual void operator() (const ShaderContext& sc, 
 								 const PSExecutionContext& psec, 
 								 size_t instance, Math::Vector4* out) const override;
+		virtual void shadeBatch(const ShaderContext& sc,
+								const PSBatchContext& psbc,
+								size_t instance, Math::Vector4* out) const override;
+		virtual bool batched() const override;
 	protected:
 		VertexColorPixelShader(const VertexColorPixelShader&) = delete;
 		VertexColorPixelShader(VertexColorPixelShader&&) = delete;
@@ -1,6 +1,7 @@
 #ifndef SOFTRP_VERTEX_COLOR_PIXEL_SHADER_IMPL_INL_
 #define SOFTRP_VERTEX_COLOR_PIXEL_SHADER_IMPL_INL_
 #include "VertexColorPixelShader.h"
+#include "FQuad.h"
 namespace SoftRP {
 
 	inline void VertexColorPixelShader::operator() (const ShaderContext& sc,
@@ -12,5 +13,20 @@ namespace SoftRP {
 		}
 	}
 
+	inline void VertexColorPixelShader::shadeBatch(const ShaderContext& sc,
+												   const PSBatchContext& psbc,
+												   size_t instance, Math::Vector4* out) const {
+		const float* colorLanes = psbc.fieldComponent(1, 0);
+		const FQuad one = splatFQ(1.0f);
+		for (size_t q = 0; q < psbc.quadCount; q++) {
+			const FQuadVector3 color = loadFQV3(colorLanes + 4 * q, PSBatchContext::LANES);
+			storeFQV4(out + 4 * q, FQuadVector4{ color.x, color.y, color.z, one });
+		}
+	}
+
+	inline bool VertexColorPixelShader::batched() const {
+		return true;
+	}
+
 }
 #endif
\ No newline at end of file
@@ -13,14 +13,8 @@ namespace SoftRP {
 		VertexColorVertexShader() = default;
 		virtual ~VertexColorVertexShader() = default;
 
-#ifdef SOFTRP_MULTI_THREAD		
-		virtual ThreadPool::Fence operator()(const ShaderContext& sc,
-											 const Vertex* input, Vertex* output, size_t vertexCount, size_t instance,
-											 ThreadPool& threadPool) const override;
-#else
-		virtual void operator()(const ShaderContext& sc,
+		virtual void shadeBatch(const ShaderContext& sc,
 								const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const override;
-#endif
 	protected:
 		VertexColorVertexShader(const VertexColorVertexShader&) = delete;
 		VertexColorVertexShader(VertexColorVertexShader&&) = delete;
@@ -21,11 +21,11 @@ namespace SoftRP {
 		return *this;
 	}
 
-	inline Vertex::Vertex(Vertex&& v) {
+	inline Vertex::Vertex(Vertex&& v) noexcept {
 		move(std::move(v));
 	}
 
-	inline Vertex& Vertex::operator=(Vertex&& v) {
+	inline Vertex& Vertex::operator=(Vertex&& v) noexcept {
 		move(std::move(v));
 		return *this;
 	}
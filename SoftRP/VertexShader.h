@@ -8,21 +8,31 @@ namespace SoftRP {
 	
 	/*
 	Abstract data type which represents a vertex shader.
+	The implementations shade a batch of vertices in shadeBatch, on the calling thread. The default operator() 
+	splits the vertices in batches of VERTEX_BATCH_SIZE, sized to keep their input and output data in cache, which
+	in the multithreaded version are shaded in parallel by the tasks of the ThreadPool. The ShaderContext and the 
+	vertices must be kept until the Fence returned has been reached.
 	*/
 	class VertexShader{
 	public:
 		
 		VertexShader() = default;
 		virtual ~VertexShader() = default;
+
+		constexpr static size_t VERTEX_BATCH_SIZE{ 1024 };
 		
 #ifdef SOFTRP_MULTI_THREAD
 		virtual ThreadPool::Fence operator()(const ShaderContext& sc,
 											 const Vertex* input, Vertex* output, size_t vertexCount, size_t instance,
-											 ThreadPool& threadPool) const = 0;
+											 ThreadPool& threadPool) const;
 #else
 		virtual void operator()(const ShaderContext& sc, 
-								const Vertex* input, Vertex* output, size_t vertexCount, size_t instance = 0)const = 0;
+								const Vertex* input, Vertex* output, size_t vertexCount, size_t instance = 0)const;
 #endif
+
+		//shade vertexCount vertices of an instance, writing output[i] from input[i]
+		virtual void shadeBatch(const ShaderContext& sc,
+								const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const = 0;
 				
 	protected:
 		VertexShader(const VertexShader&) = delete;
@@ -31,4 +41,5 @@ namespace SoftRP {
 		VertexShader& operator=(VertexShader&&) = delete;
 	};	
 }
-#endif
\ No newline at end of file
+#include "VertexShaderImpl.inl"
+#endif
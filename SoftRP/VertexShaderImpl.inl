@@ -0,0 +1,40 @@
+#ifndef SOFTRP_VERTEX_SHADER_IMPL_INL_
+#define SOFTRP_VERTEX_SHADER_IMPL_INL_
+#include "VertexShader.h"
+#include <algorithm>
+namespace SoftRP {
+
+#ifdef SOFTRP_MULTI_THREAD
+	inline ThreadPool::Fence VertexShader::operator()(const ShaderContext& sc,
+													  const Vertex* input, Vertex* output, size_t vertexCount, size_t instance,
+													  ThreadPool& threadPool) const {
+		if (vertexCount <= VERTEX_BATCH_SIZE) {
+			shadeBatch(sc, input, output, vertexCount, instance);
+			return threadPool.currFence();
+		}
+		//the calling thread shades the first batch, the others are submitted as tasks
+		const size_t batchSize = VERTEX_BATCH_SIZE;
+		for (size_t first = batchSize; first < vertexCount; first += batchSize) {
+			const size_t count = std::min(batchSize, vertexCount - first);
+			const Vertex* batchInput = input + first;
+			Vertex* batchOutput = output + first;
+			const ShaderContext* scPtr = &sc;
+			threadPool.addTask([this, scPtr, batchInput, batchOutput, count, instance]() {
+				shadeBatch(*scPtr, batchInput, batchOutput, count, instance);
+			});
+		}
+		const ThreadPool::Fence fence = threadPool.addFence();
+		shadeBatch(sc, input, output, batchSize, instance);
+		return fence;
+	}
+#else
+	inline void VertexShader::operator()(const ShaderContext& sc,
+										 const Vertex* input, Vertex* output, size_t vertexCount, size_t instance) const {
+		const size_t batchSize = VERTEX_BATCH_SIZE;
+		for (size_t first = 0; first < vertexCount; first += batchSize)
+			shadeBatch(sc, input + first, output + first, std::min(batchSize, vertexCount - first), instance);
+	}
+#endif
+
+}
+#endif
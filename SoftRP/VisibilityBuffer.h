@@ -0,0 +1,61 @@
+#ifndef SOFTRP_VISIBILITY_BUFFER_H_
+#define SOFTRP_VISIBILITY_BUFFER_H_
+#include "Texture2D.h"
+#include <cstdint>
+namespace SoftRP {
+
+	/*
+	Concrete data type which identifies the primitive visible at a pixel: the draw it belongs to and its index 
+	among the primitives rasterized by that draw.
+	*/
+	struct VisibilitySample {
+		static constexpr uint32_t INVALID_ID = 0xFFFFFFFF;
+
+		uint32_t drawId;
+		uint32_t primitiveId;
+
+		//is there no primitive visible?
+		bool empty() const;
+		bool operator==(const VisibilitySample& other) const;
+		bool operator!=(const VisibilitySample& other) const;
+	};
+
+	/*
+	Specialization of Texture2D which stores a VisibilitySample per pixel.
+	When it is given to a Rasterizer, the Rasterizer writes the samples of the primitives passing the depth test in 
+	place of invoking the PixelShader, so that each pixel is shaded once, later, regardless of the overdraw 
+	(see Renderer::resolveVisibility).
+	*/
+	class VisibilityBuffer : public Texture2D<VisibilitySample> {
+	public:
+
+		//ctor
+		VisibilityBuffer(const unsigned int width = 1, const unsigned int height = 1);
+
+		//dtor
+		~VisibilityBuffer() = default;
+
+		//copy
+		VisibilityBuffer(const VisibilityBuffer&) = default;
+		VisibilityBuffer& operator=(const VisibilityBuffer&) = default;
+		//move
+		VisibilityBuffer(VisibilityBuffer&&) = default;
+		VisibilityBuffer& operator=(VisibilityBuffer&&) = default;
+
+		/* dimensions */
+		//the samples are cleared after resizing
+		void resize(const unsigned int width, const unsigned int height);
+
+		/* clearing */
+		//set all the samples to the empty one
+		void clear();
+#ifdef SOFTRP_MULTI_THREAD
+		void clear(ThreadPool& threadPool);
+#endif
+
+		//the sample of a pixel where no primitive is visible
+		static VisibilitySample emptySample();
+	};
+}
+#include "VisibilityBufferImpl.inl"
+#endif
@@ -0,0 +1,42 @@
+#ifndef SOFTRP_VISIBILITY_BUFFER_IMPL_INL_
+#define SOFTRP_VISIBILITY_BUFFER_IMPL_INL_
+#include "VisibilityBuffer.h"
+namespace SoftRP {
+
+	inline bool VisibilitySample::empty() const {
+		return drawId == INVALID_ID;
+	}
+
+	inline bool VisibilitySample::operator==(const VisibilitySample& other) const {
+		return drawId == other.drawId && primitiveId == other.primitiveId;
+	}
+
+	inline bool VisibilitySample::operator!=(const VisibilitySample& other) const {
+		return !(*this == other);
+	}
+
+	inline VisibilityBuffer::VisibilityBuffer(const unsigned int width, const unsigned int height)
+		: Texture2D<VisibilitySample>{ width, height } {
+		clear();
+	}
+
+	inline void VisibilityBuffer::resize(const unsigned int width, const unsigned int height) {
+		Texture2D<VisibilitySample>::resize(width, height);
+		clear();
+	}
+
+	inline VisibilitySample VisibilityBuffer::emptySample() {
+		return VisibilitySample{ VisibilitySample::INVALID_ID, VisibilitySample::INVALID_ID };
+	}
+
+	inline void VisibilityBuffer::clear() {
+		Texture2D<VisibilitySample>::clear(emptySample());
+	}
+
+#ifdef SOFTRP_MULTI_THREAD
+	inline void VisibilityBuffer::clear(ThreadPool& threadPool) {
+		Texture2D<VisibilitySample>::clear(emptySample(), threadPool);
+	}
+#endif
+}
+#endif